@@ -0,0 +1,1728 @@
+#ifndef ANALYSES_HPP
+#define ANALYSES_HPP
+
+#include "./region_loader.hpp"
+#include "./elev_hist_kernel.hpp"
+#include "./local_relief_kernel.hpp"
+#include "./gradient_kernels.hpp"
+#include "./cross_section.hpp"
+#include "./get_prominence.hpp"
+#include "./table_writer.hpp"
+#include "./progress.hpp"
+#include "./stats.hpp"
+#include "./cmdline.hpp"
+#include "./work_stealing_pool.hpp"
+#include "./result_cache.hpp"
+#include "./shard_file.hpp"
+#include "./memory_plan.hpp"
+#include "./sample_reservoir.hpp"
+
+#include <cmath>
+#include <array>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <latch>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <iterator>
+#include <ranges>
+#include <algorithm>
+
+/**
+ * Splits a region into bands of rows. The pixel analyses process one band per chunk. Bands are
+ * always counted over the whole region, but only the part of them inside rows is processed, so
+ * bands outside rows are empty.
+*/
+struct row_bands
+{
+	static constexpr size_t band_height = 64;
+	static constexpr char const* unit = "pixels";
+
+	size_t width;
+	size_t height;
+	row_range rows{};
+
+	size_t count() const
+	{ return (height + band_height - 1)/band_height; }
+
+	size_t row_begin(size_t k) const
+	{ return std::clamp(k*band_height, rows.begin, std::min(rows.end, height)); }
+
+	size_t row_end(size_t k) const
+	{ return std::clamp(std::min((k + 1)*band_height, height), rows.begin, std::min(rows.end, height)); }
+
+	size_t work(size_t k) const
+	{ return (row_end(k) - row_begin(k))*width; }
+
+	size_t total_work() const
+	{ return (std::min(rows.end, height) - std::min(rows.begin, height))*width; }
+};
+
+/**
+ * Splits a region into bands of rows, like row_bands, but with a band height chosen by the
+ * analysis. Used by analyses that read far outside each band, so that larger bands amortize the
+ * rows read around them. Since the extra rows are needed, a region cannot be streamed.
+*/
+struct window_bands
+{
+	static constexpr char const* unit = "pixels";
+
+	size_t band_height;
+	size_t width;
+	size_t height;
+	row_range rows{};
+
+	size_t count() const
+	{ return (height + band_height - 1)/band_height; }
+
+	size_t row_begin(size_t k) const
+	{ return std::clamp(k*band_height, rows.begin, std::min(rows.end, height)); }
+
+	size_t row_end(size_t k) const
+	{ return std::clamp(std::min((k + 1)*band_height, height), rows.begin, std::min(rows.end, height)); }
+
+	size_t work(size_t k) const
+	{ return (row_end(k) - row_begin(k))*width; }
+
+	size_t total_work() const
+	{ return (std::min(rows.end, height) - std::min(rows.begin, height))*width; }
+};
+
+/**
+ * Partial results of tiles, keyed on a hash of everything the result of a tile depends on,
+ * including params, the cache_params of the analysis. Chunk tasks only read the stored entries,
+ * and each tile writes its own slot of the current entries, so no locking is needed. A tile
+ * that is found refers to its stored entry, so the entries are only copied when they are written.
+*/
+template<class Partial>
+class tile_store
+{
+public:
+	using key_type = result_cache::key_type;
+	using entry = std::pair<key_type, Partial>;
+
+	explicit tile_store(std::string params, std::vector<entry>&& stored):
+		m_params{std::move(params)},
+		m_stored{std::move(stored)},
+		m_hits{0}
+	{ std::ranges::sort(m_stored, std::less<>{}, &entry::first); }
+
+	std::string const& params() const
+	{ return m_params; }
+
+	Partial const* find(key_type key) const
+	{
+		auto const i = std::ranges::lower_bound(m_stored, key, std::less<>{}, &entry::first);
+		return i != std::end(m_stored) && i->first == key ? &i->second : nullptr;
+	}
+
+	void resize(size_t tile_count)
+	{
+		m_current.resize(tile_count);
+		m_computed.resize(tile_count);
+	}
+
+	/**
+	 * Records a tile that was found, with the value returned by find
+	*/
+	void set(size_t tile, key_type key, Partial const* stored)
+	{
+		m_current[tile] = std::pair{key, stored};
+		m_hits.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Records a tile that was computed, and returns its value
+	*/
+	Partial const& set(size_t tile, key_type key, Partial&& computed)
+	{
+		m_computed[tile] = std::move(computed);
+		m_current[tile] = std::pair{key, &m_computed[tile]};
+		return m_computed[tile];
+	}
+
+	size_t tile_count() const
+	{ return std::size(m_current); }
+
+	size_t hit_count() const
+	{ return m_hits.load(std::memory_order_relaxed); }
+
+	/**
+	 * Returns true if the current entries differ from the stored ones. Since the key of a tile
+	 * covers its position, they are the same if every tile was found and nothing else was stored.
+	*/
+	bool changed() const
+	{ return hit_count() != tile_count() || std::size(m_stored) != tile_count(); }
+
+	/**
+	 * Writes the current entries in the same format as a std::vector<entry>
+	*/
+	friend void write_binary(FILE* dest, tile_store const& tiles)
+	{
+		write_binary(dest, static_cast<uint64_t>(tiles.tile_count()));
+		for(auto const& item : tiles.m_current)
+		{
+			write_binary(dest, item.first);
+			write_binary(dest, *item.second);
+		}
+	}
+
+private:
+	std::string m_params;
+	std::vector<entry> m_stored;
+	std::vector<std::pair<key_type, Partial const*>> m_current;
+	std::vector<Partial> m_computed;
+	std::atomic<size_t> m_hits;
+};
+
+/**
+ * Row bands, where each band is processed as tiles of tile_width columns. If tiles is set, the
+ * result of each tile is looked up there before it is computed, and recorded afterwards. Tiles
+ * are wide, so that the stored results stay small next to the pixels they cover.
+*/
+template<class Partial>
+struct tiled_row_bands:row_bands
+{
+	static constexpr size_t tile_width = 4096;
+
+	tile_store<Partial>* tiles{nullptr};
+
+	size_t tiles_per_band() const
+	{ return (width + tile_width - 1)/tile_width; }
+
+	size_t tile_count() const
+	{ return count()*tiles_per_band(); }
+};
+
+/**
+ * Returns the key of the tile with rows [row_begin, row_end) and the given columns. The key
+ * covers the pixels of the tile and of its neighbours, since stencils read them, the mask of the
+ * tile, the region geometry, and the analysis parameters params.
+*/
+template<class Analysis>
+result_cache::key_type get_tile_key(loaded_region const& region, std::string const& params, size_t row_begin,
+	size_t row_end, column_range columns)
+{
+	auto const w = region.info.size.sizes[0];
+	auto const h = region.info.size.sizes[1];
+
+	content_hasher hasher;
+	hasher.update(Analysis::name)
+		.update(params)
+		.update(std::to_string(region.pixels.index()))
+		.update(&region.info.size, sizeof(region.info.size))
+		.update(&region.domain, sizeof(region.domain))
+		.update(&region.R_e, sizeof(region.R_e))
+		.update(&region.R_p, sizeof(region.R_p));
+
+	std::array const rect{row_begin, row_end, columns.begin, columns.end};
+	hasher.update(std::data(rect), sizeof(rect));
+
+	auto const x_begin = std::max(columns.begin, size_t{1}) - 1;
+	auto const x_end = std::min(columns.end + 1, static_cast<size_t>(w));
+	region.visit_view([&hasher, x_begin, x_end, y_begin = std::max(row_begin, size_t{1}) - 1,
+		y_end = std::min(row_end + 1, static_cast<size_t>(h)), row_begin, row_end, columns](auto const& view){
+		for(auto y = y_begin; y != y_end; ++y)
+		{
+			auto x = x_begin;
+			while(x != x_end)
+			{
+				auto const n = std::min(view.pixels.get_contiguous_run(x, y), x_end - x);
+				hasher.update(&view.pixels(x, y), n*sizeof(view.pixels(x, y)));
+				x += n;
+			}
+		}
+
+		if(view.mask.data() != nullptr)
+		{
+			for(auto y = row_begin; y != row_end; ++y)
+			{ hasher.update(&view.mask(columns.begin, y), columns.end - columns.begin); }
+		}
+	});
+	return hasher.value();
+}
+
+/**
+ * Computes band k of plan one tile at a time, with Analysis::process_tile, and combines the
+ * tiles in order. Tiles found in plan.tiles are not computed.
+*/
+template<class Analysis>
+typename Analysis::partial_result process_tiles(loaded_region const& region,
+	typename Analysis::plan_type const& plan, size_t k)
+{
+	typename Analysis::partial_result ret{};
+	auto const row_begin = plan.row_begin(k);
+	auto const row_end = plan.row_end(k);
+	for(size_t t = 0; t != plan.tiles_per_band(); ++t)
+	{
+		column_range const columns{t*plan.tile_width, std::min((t + 1)*plan.tile_width, plan.width)};
+		if(plan.tiles == nullptr)
+		{
+			Analysis::combine(ret, Analysis::process_tile(region, plan, row_begin, row_end, columns));
+			continue;
+		}
+
+		auto const key = get_tile_key<Analysis>(region, plan.tiles->params(), row_begin, row_end, columns);
+		auto const tile = k*plan.tiles_per_band() + t;
+		if(auto const stored = plan.tiles->find(key); stored != nullptr)
+		{
+			plan.tiles->set(tile, key, stored);
+			Analysis::combine(ret, typename Analysis::partial_result{*stored});
+			continue;
+		}
+
+		auto const& computed = plan.tiles->set(tile, key,
+			Analysis::process_tile(region, plan, row_begin, row_end, columns));
+		Analysis::combine(ret, typename Analysis::partial_result{computed});
+	}
+	return ret;
+}
+
+/**
+ * A set of rays, that are processed in blocks
+*/
+struct ray_blocks
+{
+	static constexpr size_t block_size = 256;
+	static constexpr char const* unit = "rays";
+
+	std::vector<ray> rays;
+
+	size_t count() const
+	{ return (std::size(rays) + block_size - 1)/block_size; }
+
+	size_t work(size_t k) const
+	{ return std::min((k + 1)*block_size, std::size(rays)) - k*block_size; }
+
+	size_t total_work() const
+	{ return std::size(rays); }
+
+	std::span<ray const> get_block(size_t k) const
+	{ return std::span{std::data(rays) + k*block_size, work(k)}; }
+};
+
+template<class T>
+std::vector<T>& get_bucket_samples(std::vector<T>& bucket)
+{ return bucket; }
+
+template<class T>
+std::vector<T>& get_bucket_samples(sample_reservoir<T>& bucket)
+{ return bucket.samples; }
+
+/**
+ * Shuffles each bucket, and writes at most sample_reservoir_capacity samples from each of them
+*/
+template<class Histogram, class RowFunc>
+void write_bucket_samples(Histogram& histogram, std::mt19937& rng, FILE* dest, table_format format,
+	RowFunc&& get_row)
+{
+	{
+		scoped_timer timer{"reduction"};
+		std::ranges::for_each(histogram, [&rng](auto& item) {
+			auto& samples = get_bucket_samples(item);
+			std::shuffle(std::begin(samples), std::end(samples), rng);
+		});
+	}
+
+	scoped_timer timer{"output"};
+	table_writer output{dest, format, {{std::chars_format::general, 8}, {std::chars_format::general, 8}}};
+	std::ranges::for_each(histogram, [&output, &get_row](auto& bucket) {
+		auto const& item = get_bucket_samples(bucket);
+		auto const n = std::min(std::size(item), sample_reservoir_capacity);
+		std::for_each(std::begin(item), std::begin(item) + n, [&output, &get_row](auto const& val) {
+			auto const row = get_row(val);
+			output.write_row({row.first, row.second});
+		});
+	});
+	output.finish();
+}
+
+/**
+ * The area of each elevation band
+*/
+class elev_hist_analysis
+{
+public:
+	static constexpr char const* name = "elev_hist";
+	static constexpr char const* output_suffix = "elevhist";
+	static constexpr bool has_combined_output = false;
+
+	using partial_result = elev_histogram;
+
+	struct plan_type:tiled_row_bands<partial_result>
+	{
+		histogram_bins bins;
+	};
+
+	static constexpr std::array output_columns{column_format{std::chars_format::scientific, 8},
+		column_format{std::chars_format::general, 16}};
+
+	elev_hist_analysis():m_histogram(m_bins.size())
+	{}
+
+	/**
+	 * --bins=<scale>:<min>:<max>:<step> sets the bins, as described in histogram_bins, for
+	 * example --bins=log2:1:8192:12. --bucket_size=<m> is short for linear bins of m metres
+	 * between 0 and the default maximum. Pixels outside the bins are added to the underflow and
+	 * overflow bins, whose areas are reported on stderr.
+	*/
+	explicit elev_hist_analysis(command_line const& options):
+		m_bins{get_bins(options)},
+		m_histogram(m_bins.size())
+	{}
+
+	plan_type prepare(loaded_region const& region)
+	{ return plan_type{{{region.info.size.sizes[0], region.info.size.sizes[1], region.active_rows}}, m_bins}; }
+
+	static partial_result process_tile(loaded_region const& region, plan_type const& plan, size_t row_begin,
+		size_t row_end, column_range columns)
+	{ return process_sample(region, plan, row_begin, row_end, columns, pixel_sample{}); }
+
+	static partial_result process_sample(loaded_region const& region, plan_type const& plan, size_t row_begin,
+		size_t row_end, column_range columns, pixel_sample const& sample)
+	{
+		partial_result ret(plan.bins.size());
+		region.visit_view([&plan, row_begin, row_end, columns, &sample, &ret](auto const& view){
+			accumulate_elev_hist(view, row_begin, row_end, plan.bins, ret, columns, sample);
+		});
+		return ret;
+	}
+
+	/**
+	 * Processes a block as soon as it is decoded, without loading the region. Called from
+	 * several threads at the same time.
+	*/
+	partial_result process_block(region_block const& block) const
+	{
+		partial_result ret(m_bins.size());
+		scoped_timer timer{"elev_hist", block.rows.size()*(block.columns.end - block.columns.begin)};
+		accumulate_elev_hist(block.region, block.rows.begin, block.rows.end, m_bins, ret, block.columns);
+		return ret;
+	}
+
+	static partial_result process_chunk(loaded_region const& region, plan_type const& plan, size_t k)
+	{
+		scoped_timer timer{"elev_hist", plan.work(k)};
+		return process_tiles<elev_hist_analysis>(region, plan, k);
+	}
+
+	/**
+	 * An empty partial result, from a chunk without pixels, adds nothing
+	*/
+	static void combine(partial_result& into, partial_result&& partial)
+	{
+		if(into.empty())
+		{ into = std::move(partial); }
+		else
+		{ std::ranges::transform(into, partial, std::begin(into), std::plus<>{}); }
+	}
+
+	void merge(partial_result&& partial)
+	{ combine(m_histogram, std::move(partial)); }
+
+	std::string cache_params() const
+	{
+		return std::string{"bins="}.append(m_bins.scale() == bin_scale::log2 ? "log2" : "linear")
+			.append(":").append(to_exact_string(m_bins.min()))
+			.append(":").append(to_exact_string(m_bins.max()))
+			.append(":").append(to_exact_string(m_bins.step()));
+	}
+
+	/**
+	 * Returns the (elevation, area per metre of elevation) rows of the output for histogram,
+	 * one per bin between min and max. The elevation is the centre of the bin.
+	*/
+	std::vector<std::pair<double, double>> get_rows(partial_result const& histogram) const
+	{
+		std::vector<std::pair<double, double>> ret;
+		for(size_t k = 0; k != m_bins.count(); ++k)
+		{
+			auto const z0 = m_bins.edge(k);
+			auto const z1 = m_bins.edge(k + 1);
+			auto const area = k + 1 < std::size(histogram) ? histogram[k + 1] : 0.0;
+			ret.push_back(std::pair{m_bins.centre(k), area/(z1 - z0)});
+		}
+		return ret;
+	}
+
+	void write(FILE* dest, table_format format)
+	{
+		scoped_timer timer{"output"};
+		if(m_histogram.front() != 0.0 || m_histogram.back() != 0.0)
+		{
+			fprintf(stderr, "elev_hist: %.8g m² below %.8g m and %.8g m² at or above %.8g m are outside the bins\n",
+				m_histogram.front(), m_bins.min(), m_histogram.back(), m_bins.max());
+		}
+
+		table_writer output{dest, format, {std::begin(output_columns), std::end(output_columns)}};
+		for(auto const& row : get_rows(m_histogram))
+		{ output.write_row({row.first, row.second}); }
+		output.finish();
+	}
+
+private:
+	static histogram_bins get_bins(command_line const& options)
+	{
+		if(options.find("bins") != std::end(options))
+		{ return get_or(options, "bins", histogram_bins{}); }
+
+		histogram_bins const defaults{};
+		return histogram_bins{bin_scale::linear, defaults.min(), defaults.max(),
+			get_or(options, "bucket_size", value<float>{defaults.step()}).get()};
+	}
+
+	histogram_bins m_bins;
+	elev_histogram m_histogram;
+};
+
+/**
+ * The mean elevation change in each slope direction
+*/
+class slopedir_analysis
+{
+public:
+	static constexpr char const* name = "slopedir";
+	static constexpr char const* output_suffix = "slopedir";
+	static constexpr bool has_combined_output = false;
+
+	using partial_result = slope_direction_sums;
+	using plan_type = tiled_row_bands<partial_result>;
+
+	static constexpr std::array output_columns{column_format{std::chars_format::general, 8},
+		column_format{std::chars_format::general, 8}};
+
+	plan_type prepare(loaded_region const& region)
+	{ return plan_type{{region.info.size.sizes[0], region.info.size.sizes[1], region.active_rows}}; }
+
+	static partial_result process_tile(loaded_region const& region, plan_type const& plan, size_t row_begin,
+		size_t row_end, column_range columns)
+	{ return process_sample(region, plan, row_begin, row_end, columns, pixel_sample{}); }
+
+	static partial_result process_sample(loaded_region const& region, plan_type const&, size_t row_begin,
+		size_t row_end, column_range columns, pixel_sample const& sample)
+	{
+		partial_result ret{};
+		region.visit_view([row_begin, row_end, columns, &sample, &ret](auto const& view){
+			accumulate_slope_directions(view, row_begin, row_end, ret, columns, sample);
+		});
+		return ret;
+	}
+
+	static partial_result process_chunk(loaded_region const& region, plan_type const& plan, size_t k)
+	{
+		scoped_timer timer{"gradient_stencil", plan.work(k)};
+		return process_tiles<slopedir_analysis>(region, plan, k);
+	}
+
+	static void combine(partial_result& into, partial_result&& partial)
+	{
+		std::ranges::transform(into, partial, std::begin(into), [](auto const& a, auto const& b){
+			return std::pair{a.first + b.first, a.second + b.second};
+		});
+	}
+
+	void merge(partial_result&& partial)
+	{ combine(m_data, std::move(partial)); }
+
+	static std::string cache_params()
+	{ return std::string{"direction_count="}.append(std::to_string(slope_direction_count)); }
+
+	/**
+	 * Returns the (direction, mean elevation change) rows of the output for data
+	*/
+	std::vector<std::pair<double, double>> get_rows(partial_result const& data) const
+	{
+		std::vector<std::pair<double, double>> ret;
+		for(size_t k = 0; k != std::size(data); ++k)
+		{
+			auto const theta = static_cast<double>(k)/slope_direction_count;
+			ret.push_back(std::pair{theta, data[k].first/data[k].second});
+		}
+		return ret;
+	}
+
+	void write(FILE* dest, table_format format)
+	{
+		scoped_timer timer{"output"};
+		table_writer output{dest, format, {std::begin(output_columns), std::end(output_columns)}};
+		for(auto const& row : get_rows(m_data))
+		{ output.write_row({row.first, row.second}); }
+		output.finish();
+	}
+
+private:
+	slope_direction_sums m_data{};
+};
+
+/**
+ * Local relief, mean and standard deviation of elevation in square windows of each of
+ * local_relief_scales, averaged over the window centres in each elevation band
+*/
+class local_relief_analysis
+{
+public:
+	static constexpr char const* name = "local_relief";
+	static constexpr char const* output_suffix = "local_relief";
+	static constexpr bool has_combined_output = false;
+
+	using partial_result = std::array<relief_histogram, std::size(local_relief_scales)>;
+
+	struct plan_type : window_bands
+	{
+		std::array<window_radius, std::size(local_relief_scales)> radii;
+	};
+
+	/**
+	 * Window radii are taken at the centre of the region. Bands are at least as high as the
+	 * largest window, so that each row is read at most three times per scale.
+	*/
+	plan_type prepare(loaded_region const& region)
+	{
+		plan_type ret{};
+		region.visit_view([&ret](auto const& view){
+			std::ranges::transform(local_relief_scales, std::begin(ret.radii), [&view](auto scale){
+				return get_window_radius(view, scale);
+			});
+		});
+		auto const max_radius = std::ranges::max(ret.radii, {}, &window_radius::y).y;
+		ret.band_height = std::max(size_t{256}, (2*max_radius + 63)/64*64);
+		ret.width = region.info.size.sizes[0];
+		ret.height = region.info.size.sizes[1];
+		ret.rows = region.active_rows;
+		return ret;
+	}
+
+	static partial_result process_chunk(loaded_region const& region, plan_type const& plan, size_t k)
+	{
+		partial_result ret{};
+		scoped_timer timer{"local_relief", plan.work(k)};
+		region.visit_view([&region, &plan, &ret, k](auto const& view){
+			for(size_t s = 0; s != std::size(ret); ++s)
+			{ accumulate_local_relief(view, plan.row_begin(k), plan.row_end(k), plan.radii[s], ret[s], region.loaded_rows); }
+		});
+		return ret;
+	}
+
+	static void combine(partial_result& into, partial_result&& partial)
+	{
+		for(size_t s = 0; s != std::size(into); ++s)
+		{
+			std::ranges::transform(into[s], partial[s], std::begin(into[s]), [](auto const& a, auto const& b){
+				return relief_sums{a.area + b.area, a.relief + b.relief, a.mean + b.mean, a.std_dev + b.std_dev};
+			});
+		}
+	}
+
+	void merge(partial_result&& partial)
+	{ combine(m_data, std::move(partial)); }
+
+	static std::string cache_params()
+	{
+		std::string ret{"bucket_size="};
+		ret.append(to_exact_string(elev_hist_bucket_size))
+			.append(",bucket_count=").append(std::to_string(elev_hist_bucket_count))
+			.append(",scales=");
+		for(auto scale : local_relief_scales)
+		{ ret.append(to_exact_string(scale)).append(";"); }
+		return ret;
+	}
+
+	/**
+	 * Writes one row per elevation bucket, with the bucket elevation, the area per metre of
+	 * elevation, and the mean relief, window mean and window standard deviation of each scale.
+	 * Empty buckets have zero means.
+	*/
+	void write(FILE* dest, table_format format)
+	{
+		scoped_timer timer{"output"};
+		std::vector<column_format> columns{{std::chars_format::scientific, 8}, {std::chars_format::general, 16}};
+		columns.resize(2 + 3*std::size(m_data), column_format{std::chars_format::general, 8});
+		table_writer output{dest, format, std::move(columns)};
+		std::vector<double> row;
+		for(size_t bucket = 0; bucket != elev_hist_bucket_count; ++bucket)
+		{
+			row.clear();
+			row.push_back(elev_hist_bucket_size*(static_cast<double>(bucket) + 0.5));
+			row.push_back(m_data[0][bucket].area/elev_hist_bucket_size);
+			for(auto const& histogram : m_data)
+			{
+				auto const& item = histogram[bucket];
+				auto const area = item.area != 0.0 ? item.area : 1.0;
+				row.push_back(item.relief/area);
+				row.push_back(item.mean/area);
+				row.push_back(item.std_dev/area);
+			}
+			output.write_row(row);
+		}
+		output.finish();
+	}
+
+private:
+	partial_result m_data{};
+};
+
+/**
+ * Samples of (elevation, gradient) pairs. Only a sample_reservoir of each bucket is kept, so
+ * partial results, and thus cache entries and shards, stay small.
+*/
+class grad_at_points_analysis
+{
+public:
+	static constexpr char const* name = "grad_at_points";
+	static constexpr char const* output_suffix = "elevgrad";
+	static constexpr bool has_combined_output = true;
+
+	using partial_result = bucket_reservoirs<gradient_samples::value_type::value_type,
+		std::tuple_size_v<gradient_samples>>;
+
+	/**
+	 * A chunk collects at most one sample per pixel before they are cut to a reservoir, in
+	 * vectors that may have twice the capacity they use
+	*/
+	static constexpr size_t chunk_bytes_per_pixel = 2*sizeof(gradient_samples::value_type::value_type);
+
+	row_bands prepare(loaded_region const& region)
+	{ return row_bands{region.info.size.sizes[0], region.info.size.sizes[1], region.active_rows}; }
+
+	/**
+	 * The samples picked only depend on the rows, so they do not depend on how the region is
+	 * loaded
+	*/
+	static partial_result process_chunk(loaded_region const& region, row_bands const& plan, size_t k)
+	{
+		gradient_samples ret;
+		scoped_timer timer{"gradient_stencil", plan.work(k)};
+		region.visit_view([&plan, &ret, k](auto const& view){
+			collect_gradients(view, plan.row_begin(k), plan.row_end(k), ret);
+		});
+		return make_bucket_reservoirs(std::move(ret), plan.row_begin(k));
+	}
+
+	static partial_result process_sample(loaded_region const& region, row_bands const&, size_t row_begin,
+		size_t row_end, column_range columns, pixel_sample const& sample)
+	{
+		gradient_samples ret;
+		region.visit_view([row_begin, row_end, columns, &sample, &ret](auto const& view){
+			collect_gradients(view, row_begin, row_end, ret, columns, sample);
+		});
+		return make_bucket_reservoirs(std::move(ret), splitmix64(splitmix64(sample.seed ^ row_begin) ^ columns.begin));
+	}
+
+	static void combine(partial_result& into, partial_result&& partial)
+	{ combine_samples(into, std::move(partial)); }
+
+	void merge(partial_result&& partial)
+	{ combine(m_histogram, std::move(partial)); }
+
+	static std::string cache_params()
+	{
+		return std::string{"bucket_count="}.append(std::to_string(std::tuple_size_v<gradient_samples>))
+			.append(",min_elevation=").append(to_exact_string(gradient_min_elevation))
+			.append(",min_gradient=").append(to_exact_string(gradient_min_value))
+			.append(",reservoir=").append(std::to_string(sample_reservoir_capacity));
+	}
+
+	/**
+	 * Adds the samples collected so far to other. This must be done before write, which
+	 * shuffles the samples.
+	*/
+	void merge_into(grad_at_points_analysis& other) const
+	{ combine(other.m_histogram, partial_result{m_histogram}); }
+
+	void write(FILE* dest, table_format format)
+	{
+		write_bucket_samples(m_histogram, m_rng, dest, format, [](auto const& val) {
+			return std::pair{std::get<0>(val), std::get<1>(val)};
+		});
+	}
+
+private:
+	std::mt19937 m_rng;
+	partial_result m_histogram;
+};
+
+/**
+ * Samples of peak and valley elevations along random cross sections. Only a sample_reservoir of
+ * each bucket is kept.
+*/
+class peak_valley_elev_analysis
+{
+public:
+	static constexpr char const* name = "peak_valley_elev";
+	static constexpr char const* output_suffix = "peak_valley_elev";
+	static constexpr bool has_combined_output = true;
+
+	using partial_result = bucket_reservoirs<peak_data, std::tuple_size_v<peak_samples>>;
+
+	peak_valley_elev_analysis() = default;
+
+	/**
+	 * --seed=<n> seeds the random sequence that picks the rays and the written samples
+	*/
+	explicit peak_valley_elev_analysis(command_line const& options):
+		m_rng{get_or(options, "seed", value<uint32_t>{std::mt19937::default_seed}).get()}
+	{}
+
+	/**
+	 * Picks all rays up front, so the random sequence, and thus the result, does not depend on
+	 * the order in which blocks are processed
+	*/
+	ray_blocks prepare(loaded_region const& region)
+	{
+		auto const mask = region.mask.get();
+		auto const pixel_count = mask == nullptr ?
+			region.pixel_count() :
+			static_cast<size_t>(std::count_if(mask, mask + region.pixel_count(),
+				[](auto const val) { return val != 0; }));
+		fprintf(stderr, "pixel_count: %zu\n", pixel_count);
+		auto const N = (8lu * 65536lu * 8192lu)/static_cast<size_t>(std::sqrt(pixel_count));
+		fprintf(stderr, "N: %zu\n", N);
+
+		ray_blocks ret;
+		ret.rays.reserve(N);
+		region.visit_view([this, &ret, N](auto const& view){
+			std::generate_n(std::back_inserter(ret.rays), N, [this, &view](){ return make_random_ray(view, m_rng); });
+		});
+		return ret;
+	}
+
+	static partial_result process_chunk(loaded_region const& region, ray_blocks const& plan, size_t k)
+	{
+		auto const block = plan.get_block(k);
+		std::vector<curve> curves;
+		{
+			scoped_timer timer{"ray_march", std::size(block), "rays"};
+			region.visit_view([block, &curves](auto const& view){
+				std::ranges::for_each(block, [&view, &curves](auto const& r) {
+					std::ranges::move(get_cross_section(r, view), std::back_inserter(curves));
+				});
+			});
+		}
+
+		peak_samples ret;
+		scoped_timer timer{"extrema", std::size(block), "rays"};
+		std::ranges::for_each(curves, [&ret](auto const& val) {
+			collect_peaks(val, ret);
+		});
+		return make_bucket_reservoirs(std::move(ret), k);
+	}
+
+	static void combine(partial_result& into, partial_result&& partial)
+	{ combine_samples(into, std::move(partial)); }
+
+	void merge(partial_result&& partial)
+	{ combine(m_histogram, std::move(partial)); }
+
+	/**
+	 * Returns the state of the random sequence, which continues across regions, so that the
+	 * output of merged shards can be shuffled in the same way as in a single run
+	*/
+	std::string shard_state() const
+	{
+		std::ostringstream ret;
+		ret << m_rng;
+		return ret.str();
+	}
+
+	void restore_shard_state(std::string const& state)
+	{
+		std::istringstream src{state};
+		src >> m_rng;
+		if(!src)
+		{ throw std::runtime_error{"Invalid random state in shard file"}; }
+	}
+
+	void write(FILE* dest, table_format format)
+	{
+		write_bucket_samples(m_histogram, m_rng, dest, format, [](auto const& val) {
+			return std::pair{val.min, val.max};
+		});
+	}
+
+private:
+	std::mt19937 m_rng;
+	partial_result m_histogram;
+};
+
+/**
+ * Samples of peak elevations and the elevations of their key cols
+*/
+class prominence_analysis
+{
+public:
+	static constexpr char const* name = "prominence";
+	static constexpr char const* output_suffix = "prominence";
+	static constexpr bool has_combined_output = true;
+
+	void process(loaded_region const& region)
+	{
+		auto const pixels = std::get_if<raster<float>>(&region.pixels);
+		if(pixels == nullptr || pixels->layout() != raster_layout::row_major())
+		{ throw std::runtime_error{"Prominence requires a row-major float32 raster"}; }
+
+		auto const pixel_count = region.pixel_count();
+		auto const progress = get_progress().begin_region(region.name, pixel_count);
+		scoped_timer timer{"prominence", pixel_count};
+		auto const peaks = get_prominence(std::span{static_cast<float const*>(pixels->data()), pixel_count},
+			region.info.size,
+			[src_ptr = pixels->data(), mask_ptr = region.mask.get()](size_t k) {
+				return (mask_ptr == nullptr || mask_ptr[k] != 0) && src_ptr[k] >= 1.0f;
+			});
+		progress->advance(pixel_count);
+		fprintf(stderr, "peak_count: %zu\n", std::size(peaks));
+
+		std::ranges::for_each(peaks, [this](auto const& item) {
+			auto const min = item.key_col_value;
+			auto const max = item.summit_value;
+			auto const bucket = static_cast<size_t>(max < 1.0f ? 0.0f : 12.0f*std::log2(max));
+			if(max - min > 32.0f)
+			{ m_histogram[bucket].push_back(sample{min, max}); }
+		});
+	}
+
+	void merge_into(prominence_analysis& other) const
+	{
+		for(size_t k = 0; k != std::size(m_histogram); ++k)
+		{ std::ranges::copy(m_histogram[k], std::back_inserter(other.m_histogram[k])); }
+	}
+
+	void write(FILE* dest, table_format format)
+	{
+		write_bucket_samples(m_histogram, m_rng, dest, format, [](auto const& val) {
+			return std::pair{val.min, val.max};
+		});
+	}
+
+private:
+	struct sample
+	{
+		float min;
+		float max;
+	};
+
+	std::mt19937 m_rng;
+	std::array<std::vector<sample>, 159> m_histogram;
+};
+
+/**
+ * Creates an analysis from the options of a run, for analyses that have options
+*/
+template<class Analysis>
+Analysis make_analysis(command_line const& options)
+{
+	if constexpr(std::is_constructible_v<Analysis, command_line const&>)
+	{ return Analysis{options}; }
+	else
+	{ return Analysis{}; }
+}
+
+/**
+ * An analysis that splits each region into independent chunks. The results of the chunks are
+ * combined in chunk order into one partial result per region, which is then merged into the
+ * analysis, so the result does not depend on how the chunks are scheduled.
+*/
+template<class Analysis>
+concept chunked_analysis = requires(Analysis& analysis, loaded_region const& region,
+	typename Analysis::partial_result& partial)
+{
+	{ analysis.prepare(region).count() } -> std::convertible_to<size_t>;
+	Analysis::combine(partial, std::move(partial));
+};
+
+/**
+ * A chunked analysis whose per-region partial result depends only on the region and on
+ * cache_params, so it can be stored in a result_cache
+*/
+template<class Analysis>
+concept cacheable_analysis = chunked_analysis<Analysis> && requires(Analysis const& analysis)
+{
+	{ analysis.cache_params() } -> std::convertible_to<std::string>;
+};
+
+/**
+ * A cacheable analysis that can also reuse the results of unchanged tiles of a changed region
+*/
+template<class Analysis>
+concept tile_cacheable_analysis = cacheable_analysis<Analysis>
+	&& requires(decltype(std::declval<Analysis&>().prepare(std::declval<loaded_region const&>())) plan)
+{
+	{ plan.tiles->find(result_cache::key_type{}) };
+};
+
+/**
+ * A chunked analysis that processes bands of rows independently, so that a region can be loaded
+ * a few rows at a time
+*/
+template<class Analysis>
+concept row_band_analysis = chunked_analysis<Analysis>
+	&& std::derived_from<decltype(std::declval<Analysis&>().prepare(std::declval<loaded_region const&>())), row_bands>;
+
+/**
+ * Returns the number of bytes per pixel that a running chunk of Analysis holds besides the
+ * region, as given by Analysis::chunk_bytes_per_pixel
+*/
+template<class Analysis>
+constexpr size_t get_chunk_bytes_per_pixel()
+{
+	if constexpr(requires{ { Analysis::chunk_bytes_per_pixel } -> std::convertible_to<size_t>; })
+	{ return Analysis::chunk_bytes_per_pixel; }
+	else
+	{ return 0; }
+}
+
+/**
+ * A chunked analysis that only reads the pixels of each block, so that it can consume the blocks
+ * of a region as they are decoded, with visit_region
+*/
+template<class Analysis>
+concept block_visiting_analysis = chunked_analysis<Analysis>
+	&& requires(Analysis const& analysis, region_block const& block)
+{
+	{ analysis.process_block(block) } -> std::same_as<typename Analysis::partial_result>;
+};
+
+/**
+ * A chunked analysis that can process a pixel_sample of a tile, instead of all of its pixels
+*/
+template<class Analysis>
+concept sampleable_analysis = chunked_analysis<Analysis>
+	&& requires(loaded_region const& region, pixel_sample const& sample,
+		decltype(std::declval<Analysis&>().prepare(std::declval<loaded_region const&>())) const& plan)
+{
+	{ Analysis::process_sample(region, plan, size_t{}, size_t{}, column_range{}, sample) }
+		-> std::same_as<typename Analysis::partial_result>;
+};
+
+/**
+ * A sampleable analysis whose output rows are estimates that can be computed from any partial
+ * result, and are written with output_columns
+*/
+template<class Analysis>
+concept estimable_analysis = sampleable_analysis<Analysis>
+	&& requires(Analysis const& analysis, typename Analysis::partial_result const& partial)
+{
+	{ analysis.get_rows(partial) } -> std::same_as<std::vector<std::pair<double, double>>>;
+	{ Analysis::output_columns[1] } -> std::convertible_to<column_format>;
+};
+
+/**
+ * Runs Analysis on a stratified sample of the pixels, where each tile of each row band is one
+ * stratum. Samples are weighted by 1/fraction, so sums are unbiased. Regions are still loaded
+ * and decoded in full, so only the time spent in the kernel shrinks with the fraction.
+ *
+ * For an estimable analysis, the pixels are drawn as replicate_count independent samples of
+ * fraction/replicate_count each. The first two columns of the output are written as by Analysis,
+ * so that they can be compared with an exact run. A third column holds the half width of an
+ * approximate 95 % confidence interval of each row, from the spread of the replicates, using the
+ * Student t distribution with replicate_count - 1 degrees of freedom. Rows that are ratios, as in
+ * slopedir, are averaged over the replicates, which biases them slightly at small fractions.
+ * Other analyses use one sample, and write the same output as Analysis.
+*/
+template<sampleable_analysis Analysis>
+class sampled_analysis
+{
+public:
+	static constexpr char const* name = Analysis::name;
+	static constexpr char const* output_suffix = Analysis::output_suffix;
+	static constexpr bool has_combined_output = Analysis::has_combined_output;
+	static constexpr size_t replicate_count = estimable_analysis<Analysis> ? 8 : 1;
+
+	using partial_result = std::array<typename Analysis::partial_result, replicate_count>;
+	using analysis_plan = decltype(std::declval<Analysis&>().prepare(std::declval<loaded_region const&>()));
+
+	struct plan_type:row_bands
+	{
+		static constexpr size_t tile_width = 256;
+
+		pixel_sample sample;
+		analysis_plan analysis;
+	};
+
+	/**
+	 * --sample_fraction=<f> sets the fraction of pixels, and --sample_seed=<n> selects the
+	 * sample. Since the partial results depend on both, they are neither cached nor sharded.
+	*/
+	explicit sampled_analysis(command_line const& options):
+		m_analysis{make_analysis<Analysis>(options)},
+		m_sample{get_or(options, "sample_fraction", sample_fraction_option{}).value,
+			get_or(options, "sample_seed", value<uint64_t>{0}).get()}
+	{
+		if(options.find("cache_dir") != std::end(options) || options.find("shard_output") != std::end(options))
+		{ throw std::runtime_error{"--sample_fraction cannot be combined with --cache_dir or --shard_output"}; }
+	}
+
+	plan_type prepare(loaded_region const& region)
+	{
+		return plan_type{{region.info.size.sizes[0], region.info.size.sizes[1], region.active_rows}, m_sample,
+			m_analysis.prepare(region)};
+	}
+
+	static partial_result process_chunk(loaded_region const& region, plan_type const& plan, size_t k)
+	{
+		partial_result ret{};
+		scoped_timer timer{"sampled", plan.work(k)};
+		for(size_t r = 0; r != replicate_count; ++r)
+		{
+			pixel_sample const sample{plan.sample.fraction/replicate_count, plan.sample.seed*replicate_count + r};
+			for(size_t x = 0; x < plan.width; x += plan_type::tile_width)
+			{
+				column_range const columns{x, std::min(x + plan_type::tile_width, plan.width)};
+				Analysis::combine(ret[r], Analysis::process_sample(region, plan.analysis, plan.row_begin(k), plan.row_end(k),
+					columns, sample));
+			}
+		}
+		return ret;
+	}
+
+	static void combine(partial_result& into, partial_result&& partial)
+	{
+		for(size_t r = 0; r != replicate_count; ++r)
+		{ Analysis::combine(into[r], std::move(partial[r])); }
+	}
+
+	void merge(partial_result&& partial)
+	{ combine(m_replicates, std::move(partial)); }
+
+	void write(FILE* dest, table_format format)
+	{
+		if constexpr(estimable_analysis<Analysis>)
+		{
+			// The 97.5 % quantile of the Student t distribution with 7 degrees of freedom
+			static_assert(replicate_count == 8);
+			constexpr auto t = 2.36462;
+
+			scoped_timer timer{"output"};
+			std::array<std::vector<std::pair<double, double>>, replicate_count> rows;
+			std::ranges::transform(m_replicates, std::begin(rows), [this](auto const& item){
+				return m_analysis.get_rows(item);
+			});
+
+			table_writer output{dest, format,
+				{Analysis::output_columns[0], Analysis::output_columns[1], Analysis::output_columns[1]}};
+			for(size_t k = 0; k != std::size(rows[0]); ++k)
+			{
+				auto const mean = std::accumulate(std::begin(rows), std::end(rows), 0.0, [k](double sum, auto const& item){
+					return sum + item[k].second;
+				})/replicate_count;
+				auto const sum_sq = std::accumulate(std::begin(rows), std::end(rows), 0.0, [k, mean](double sum, auto const& item){
+					return sum + (item[k].second - mean)*(item[k].second - mean);
+				});
+				output.write_row({rows[0][k].first, mean, t*std::sqrt(sum_sq/((replicate_count - 1)*replicate_count))});
+			}
+			output.finish();
+		}
+		else
+		{
+			for(auto& item : m_replicates)
+			{ m_analysis.merge(std::move(item)); }
+			m_analysis.write(dest, format);
+		}
+	}
+
+private:
+	Analysis m_analysis;
+	pixel_sample m_sample;
+	partial_result m_replicates{};
+};
+
+template<class Analysis>
+void process_region(Analysis& analysis, loaded_region const& region)
+{
+	if constexpr(chunked_analysis<Analysis>)
+	{
+		auto const plan = analysis.prepare(region);
+		auto const progress = get_progress().begin_region(region.name, plan.total_work(), plan.unit);
+		typename Analysis::partial_result region_result{};
+		for(size_t k = 0; k != plan.count(); ++k)
+		{
+			if(plan.work(k) == 0)
+			{ continue; }
+			Analysis::combine(region_result, Analysis::process_chunk(region, plan, k));
+			progress->advance(plan.work(k));
+		}
+		analysis.merge(std::move(region_result));
+	}
+	else
+	{ analysis.process(region); }
+}
+
+/**
+ * Runs analysis over tif_name without loading it, by processing each tile or strip as it is
+ * decoded, with thread_count threads. Blocks finish in any order, but their partial results are
+ * combined in block order, so the result does not depend on scheduling. Since visit_blocks does
+ * not run far ahead of the first unfinished block, fewer than 4*thread_count partial results wait
+ * to be combined.
+*/
+template<block_visiting_analysis Analysis>
+typename Analysis::partial_result visit_region(Analysis const& analysis, std::string const& tif_name,
+	std::optional<std::string> const& mask_name, size_t thread_count)
+{
+	auto const size = get_input_size(tif_name);
+	auto const progress = get_progress().begin_region(tif_name, size.sizes[0]*size.sizes[1], "pixels");
+
+	typename Analysis::partial_result ret{};
+	std::mutex mutex;
+	std::map<size_t, typename Analysis::partial_result> pending;
+	size_t next_block = 0;
+	visit_region_blocks(tif_name, mask_name, thread_count, [&](region_block const& block){
+		auto partial = analysis.process_block(block);
+		progress->advance(block.rows.size()*(block.columns.end - block.columns.begin));
+
+		std::lock_guard lock{mutex};
+		pending.emplace(block.index, std::move(partial));
+		for(auto i = std::begin(pending); i != std::end(pending) && i->first == next_block; ++next_block)
+		{
+			Analysis::combine(ret, std::move(i->second));
+			i = pending.erase(i);
+		}
+	});
+	return ret;
+}
+
+/**
+ * Feeds the contents of tif_name into hasher. For a mosaic, the contents of all of its tiles are
+ * included too.
+*/
+inline void hash_input(content_hasher& hasher, std::string const& tif_name)
+{
+	hash_file(hasher, tif_name);
+	if(!is_mosaic(tif_name))
+	{ return; }
+
+	for(auto const& item : read_mosaic_list(tif_name))
+	{
+		hasher.update(item);
+		hash_file(hasher, item);
+	}
+}
+
+/**
+ * Returns the key of the result of Analysis for the given input files. The key covers the
+ * contents of the files, the analysis parameters, and the pixel format, but not settings that
+ * do not change the result, such as the number of threads or the raster layout.
+*/
+template<cacheable_analysis Analysis>
+result_cache::key_type get_cache_key(Analysis const& analysis, std::string const& tif_name,
+	std::optional<std::string> const& mask_name, pixel_format format)
+{
+	scoped_timer timer{"cache_key"};
+	content_hasher hasher;
+	hasher.update(Analysis::name)
+		.update(analysis.cache_params())
+		.update(std::to_string(static_cast<int>(format)));
+	hash_input(hasher, tif_name);
+	hasher.update(mask_name.has_value() ? std::string_view{"mask"} : std::string_view{"no mask"});
+	if(mask_name.has_value())
+	{ hash_file(hasher, *mask_name); }
+	return hasher.value();
+}
+
+/**
+ * Creates a result_cache according to --cache_dir=<dir> and --cache_refresh=0|1. Returns
+ * std::nullopt if no cache directory is given.
+*/
+inline std::optional<result_cache> make_result_cache(command_line const& options)
+{
+	auto const dir = get_or(options, "cache_dir", std::string{});
+	if(dir.empty())
+	{ return std::nullopt; }
+	return result_cache{dir, get_or(options, "cache_refresh", value<int>{0}).get() != 0};
+}
+
+/**
+ * Returns the parameters that must match between shards that are merged
+*/
+template<chunked_analysis Analysis>
+std::string get_shard_params(Analysis const& analysis, pixel_format format)
+{
+	auto ret = std::string{"pixel_format="}.append(std::to_string(static_cast<int>(format)));
+	if constexpr(cacheable_analysis<Analysis>)
+	{ ret.append(",").append(analysis.cache_params()); }
+	return ret;
+}
+
+/**
+ * Returns the state that the output of analysis depends on besides its merged partial results.
+ * Only analyses that keep a random sequence across regions have any.
+*/
+template<chunked_analysis Analysis>
+std::string get_shard_state(Analysis const& analysis)
+{
+	if constexpr(requires{ { analysis.shard_state() } -> std::convertible_to<std::string>; })
+	{ return analysis.shard_state(); }
+	else
+	{ return std::string{}; }
+}
+
+template<chunked_analysis Analysis>
+void restore_shard_state(Analysis& analysis, std::string const& state)
+{
+	if constexpr(requires{ analysis.restore_shard_state(state); })
+	{ analysis.restore_shard_state(state); }
+}
+
+/**
+ * A region whose chunks have been submitted to a work_stealing_pool. If a shard is given, only
+ * the chunks of that shard are processed.
+*/
+template<chunked_analysis Analysis>
+class parallel_region_job
+{
+public:
+	using plan_type = decltype(std::declval<Analysis&>().prepare(std::declval<loaded_region const&>()));
+	using partial_result = typename Analysis::partial_result;
+
+	/**
+	 * Called with the partial result of the whole region, before it is merged
+	*/
+	using completion_callback = std::function<void(partial_result const&)>;
+
+	/**
+	 * Called with the plan of the region, before any chunk is submitted
+	*/
+	using plan_callback = std::function<void(plan_type&)>;
+
+	explicit parallel_region_job(Analysis& analysis, loaded_region&& region, work_stealing_pool& pool,
+		completion_callback on_completion = nullptr, plan_callback configure_plan = nullptr,
+		shard_option shard = shard_option{}):
+		parallel_region_job{analysis, std::make_shared<loaded_region const>(std::move(region)), pool,
+			std::move(on_completion), std::move(configure_plan), shard}
+	{}
+
+	/**
+	 * Creates a job for a region that is shared with its owner, which may keep it loaded after
+	 * the job is done
+	*/
+	explicit parallel_region_job(Analysis& analysis, std::shared_ptr<loaded_region const> region,
+		work_stealing_pool& pool, completion_callback on_completion = nullptr,
+		plan_callback configure_plan = nullptr, shard_option shard = shard_option{}):
+		m_region{std::move(region)},
+		m_plan{analysis.prepare(*m_region)},
+		m_chunk_count{m_plan.count()},
+		m_first_chunk{shard.chunk_begin(m_chunk_count)},
+		m_partials(shard.chunk_end(m_chunk_count) - m_first_chunk),
+		m_remaining{static_cast<ptrdiff_t>(std::ranges::count_if(get_chunks(), [this](size_t k){
+			return m_plan.work(k) != 0;
+		}))},
+		m_on_completion{std::move(on_completion)}
+	{
+		if(configure_plan)
+		{ configure_plan(m_plan); }
+
+		size_t total_work = 0;
+		for(auto k : get_chunks())
+		{ total_work += m_plan.work(k); }
+
+		// Empty chunks, outside the rows that are loaded, keep an empty partial result
+		m_progress = get_progress().begin_region(m_region->name, total_work, m_plan.unit);
+		std::vector<work_stealing_pool::task> tasks;
+		for(auto k : get_chunks())
+		{
+			if(m_plan.work(k) != 0)
+			{ tasks.push_back([this, k](){ run_chunk(k); }); }
+		}
+		pool.submit(std::move(tasks));
+	}
+
+	/**
+	 * Creates a job for chunks that have already been processed, for example one slab of rows
+	 * at a time
+	*/
+	explicit parallel_region_job(shard_region<partial_result>&& chunks, completion_callback on_completion = nullptr):
+		m_region{},
+		m_plan{},
+		m_chunk_count{chunks.chunk_count},
+		m_first_chunk{chunks.first_chunk},
+		m_partials{std::move(chunks.partials)},
+		m_remaining{0},
+		m_on_completion{std::move(on_completion)}
+	{}
+
+	/**
+	 * Creates a job for a region whose partial result is already known, for example from a
+	 * result_cache
+	*/
+	explicit parallel_region_job(partial_result&& region_result):
+		parallel_region_job{shard_region<partial_result>{{}, 1, 0, {}}}
+	{ m_partials.push_back(std::move(region_result)); }
+
+	parallel_region_job(parallel_region_job const&) = delete;
+	parallel_region_job& operator=(parallel_region_job const&) = delete;
+
+	~parallel_region_job()
+	{ m_remaining.wait(); }
+
+	/**
+	 * Waits for all chunks, and merges their results into analysis
+	*/
+	void merge_into(Analysis& analysis)
+	{
+		m_remaining.wait();
+		if(m_error)
+		{ std::rethrow_exception(m_error); }
+
+		scoped_timer timer{"merge"};
+		partial_result region_result{};
+		std::ranges::for_each(m_partials, [&region_result](auto& item){
+			Analysis::combine(region_result, std::move(item));
+		});
+		m_partials.clear();
+		if(m_on_completion)
+		{ m_on_completion(region_result); }
+		analysis.merge(std::move(region_result));
+	}
+
+	/**
+	 * Waits for all chunks, and returns the part of the region they cover, without combining
+	 * their results
+	*/
+	shard_region<partial_result> take_shard(std::string input)
+	{
+		m_remaining.wait();
+		if(m_error)
+		{ std::rethrow_exception(m_error); }
+
+		return shard_region<partial_result>{std::move(input), m_chunk_count, m_first_chunk,
+			std::move(m_partials)};
+	}
+
+private:
+	auto get_chunks() const
+	{ return std::views::iota(m_first_chunk, m_first_chunk + std::size(m_partials)); }
+
+	void run_chunk(size_t k) noexcept
+	{
+		try
+		{
+			get_run_stats().begin_region(m_region->name);
+			m_partials[k - m_first_chunk] = Analysis::process_chunk(*m_region, m_plan, k);
+			m_progress->advance(m_plan.work(k));
+		}
+		catch(...)
+		{
+			std::lock_guard lock{m_error_mutex};
+			if(!m_error)
+			{ m_error = std::current_exception(); }
+		}
+		m_remaining.count_down();
+	}
+
+	std::shared_ptr<loaded_region const> m_region;
+	plan_type m_plan;
+	size_t m_chunk_count;
+	size_t m_first_chunk;
+	std::vector<partial_result> m_partials;
+	std::latch m_remaining;
+	std::mutex m_error_mutex;
+	std::exception_ptr m_error;
+	completion_callback m_on_completion;
+	std::shared_ptr<region_progress> m_progress;
+};
+
+/**
+ * Processes region like process_region, but runs the chunks of a chunked analysis on pool
+*/
+template<class Analysis>
+void process_region(Analysis& analysis, std::shared_ptr<loaded_region const> const& region,
+	work_stealing_pool& pool)
+{
+	if constexpr(chunked_analysis<Analysis>)
+	{
+		parallel_region_job<Analysis> job{analysis, region, pool};
+		job.merge_into(analysis);
+	}
+	else
+	{ analysis.process(*region); }
+}
+
+/**
+ * Returns the rows of a region of the given height that are covered by the row bands of shard
+*/
+inline row_range get_shard_rows(shard_option shard, size_t height)
+{
+	constexpr auto band_height = row_bands::band_height;
+	auto const chunk_count = (height + band_height - 1)/band_height;
+	return row_range{std::min(shard.chunk_begin(chunk_count)*band_height, height),
+		std::min(shard.chunk_end(chunk_count)*band_height, height)};
+}
+
+/**
+ * Processes the chunks of a region that belong to shard, loading plan.slab_height rows at a time.
+ * Slabs start at band boundaries, so each band is processed within one slab, and the result is
+ * the same as if the region was loaded at once.
+*/
+template<row_band_analysis Analysis>
+std::unique_ptr<parallel_region_job<Analysis>> run_streamed(Analysis& analysis, std::string const& tif_name,
+	std::optional<std::string> const& mask_name, raster_alloc_params const& alloc_params, memory_plan const& plan,
+	work_stealing_pool& pool, shard_option shard,
+	typename parallel_region_job<Analysis>::completion_callback on_completion)
+{
+	constexpr auto band_height = row_bands::band_height;
+	auto const chunk_count = (static_cast<size_t>(plan.size.sizes[1]) + band_height - 1)/band_height;
+	shard_region<typename Analysis::partial_result> ret{{}, chunk_count, shard.chunk_begin(chunk_count), {}};
+	ret.partials.resize(shard.chunk_end(chunk_count) - ret.first_chunk);
+	auto const shard_rows = get_shard_rows(shard, static_cast<size_t>(plan.size.sizes[1]));
+
+	for(auto y = plan.rows.begin; y < plan.rows.end; y += plan.slab_height)
+	{
+		row_range const slab{y, std::min(y + plan.slab_height, plan.rows.end)};
+		if(slab.end <= shard_rows.begin || slab.begin >= shard_rows.end)
+		{ continue; }
+
+		parallel_region_job<Analysis> job{analysis, load_region(tif_name, mask_name, alloc_params, slab), pool,
+			nullptr, nullptr, shard};
+		auto slab_result = job.take_shard(std::string{});
+		for(size_t k = 0; k != std::size(ret.partials); ++k)
+		{
+			auto const band_begin = (ret.first_chunk + k)*band_height;
+			if(band_begin >= slab.begin && band_begin < slab.end)
+			{ ret.partials[k] = std::move(slab_result.partials[k]); }
+		}
+	}
+	return std::make_unique<parallel_region_job<Analysis>>(std::move(ret), std::move(on_completion));
+}
+
+/**
+ * Runs Analysis over all inputs given on the command line, and writes the result to stdout.
+ * Chunks from all inputs share one work-stealing pool, and regions are loaded, read from the
+ * result cache, sharded, planned within a memory budget or visited block by block as the options
+ * described in README.md select.
+*/
+template<class Analysis>
+int run_analyzer(analyzer_args const& args)
+{
+	configure_run_stats(args.options);
+	auto const reporter = make_progress_reporter(args.options, std::size(args.inputs));
+
+	auto analysis = make_analysis<Analysis>(args.options);
+	if constexpr(chunked_analysis<Analysis>)
+	{
+		auto const thread_count = get_or(args.options, "threads",
+			value<size_t>{std::thread::hardware_concurrency()}).get();
+		auto const max_resident = std::max(get_or(args.options, "max_resident_regions", value<size_t>{2}).get(),
+			size_t{1});
+		auto const pin = get_or(args.options, "pin_threads", value<int>{0}).get() != 0;
+		auto const mem_budget = get_or(args.options, "mem_budget", value<size_t>{0}).get()*1024*1024;
+
+		auto const cache = make_result_cache(args.options);
+		auto const visit = get_or(args.options, "visit_blocks", value<int>{1}).get() != 0;
+		auto const shard = get_or(args.options, "shard", shard_option{});
+		auto const shard_output = get_or(args.options, "shard_output", std::string{});
+		if(shard_output.empty() && shard.count != 1)
+		{ throw std::runtime_error{"--shard requires --shard_output"}; }
+		if(!shard_output.empty() && cache.has_value())
+		{ throw std::runtime_error{"--shard_output cannot be combined with --cache_dir"}; }
+
+		std::deque<std::unique_ptr<parallel_region_job<Analysis>>> active;
+		std::deque<std::string> active_inputs;
+		work_stealing_pool pool{thread_count, pin};
+		raster_alloc_params const alloc_params{
+			get_or(args.options, "huge_pages", huge_page_mode_option{}).value,
+			pool.thread_count(),
+			row_bands::band_height,
+			pin,
+			get_or(args.options, "raster_layout", raster_layout_option{}).blocked,
+			get_or(args.options, "block_size", value<size_t>{0}).get(),
+			get_or(args.options, "pixel_format", pixel_format_option{}).value
+		};
+
+		std::optional<shard_writer> shard_dest;
+		if(!shard_output.empty())
+		{
+			shard_dest.emplace(shard_output, shard_header{shard_file_version, Analysis::name,
+				get_shard_params(analysis, alloc_params.format), shard.index, shard.count, std::size(args.inputs)});
+		}
+
+		auto const retire_front = [&active, &active_inputs, &shard_dest, &analysis](){
+			if(shard_dest.has_value())
+			{ shard_dest->write_region(active.front()->take_shard(std::move(active_inputs.front()))); }
+			else
+			{ active.front()->merge_into(analysis); }
+			active.pop_front();
+			active_inputs.pop_front();
+		};
+
+		for(auto item : args.inputs)
+		{
+			if(std::size(active) == max_resident)
+			{ retire_front(); }
+
+			auto [tif_name, mask_name] = split_input_pair(item);
+			get_run_stats().begin_region(tif_name);
+			auto const progress = get_progress().begin_region(tif_name);
+			if constexpr(block_visiting_analysis<Analysis>)
+			{
+				if(visit && !cache.has_value() && shard_output.empty() && !is_mosaic(tif_name)
+					&& alloc_params.format == pixel_format::float32)
+				{
+					// Regions are merged in input order
+					while(!active.empty())
+					{ retire_front(); }
+					analysis.merge(visit_region(analysis, tif_name, mask_name, pool.thread_count()));
+					continue;
+				}
+			}
+
+			typename parallel_region_job<Analysis>::completion_callback store_region;
+			typename parallel_region_job<Analysis>::completion_callback on_completion;
+			typename parallel_region_job<Analysis>::plan_callback configure_plan;
+			if constexpr(cacheable_analysis<Analysis>)
+			{
+				if(cache.has_value())
+				{
+					auto const key = get_cache_key(analysis, tif_name, mask_name, alloc_params.format);
+					if(auto cached = cache->template load<typename Analysis::partial_result>(Analysis::name, key);
+						cached.has_value())
+					{
+						fprintf(stderr, "Using cached result for %s\n", tif_name.c_str());
+						active.push_back(std::make_unique<parallel_region_job<Analysis>>(std::move(*cached)));
+						active_inputs.push_back(item);
+						continue;
+					}
+					store_region = [&cache = *cache, key](auto const& region_result){
+						cache.store(Analysis::name, key, region_result);
+					};
+					on_completion = store_region;
+
+					if constexpr(tile_cacheable_analysis<Analysis>)
+					{
+						// The tiles of a region are stored together, under the name of the region.
+						// Each tile is still found by content, so only changed tiles are recomputed.
+						using store_type = tile_store<typename Analysis::partial_result>;
+						auto const tiles_name = std::string{Analysis::name}.append("_tiles");
+						auto const tiles_key = content_hasher{}.update(tiles_name).update(tif_name).value();
+						auto const tiles = std::make_shared<store_type>(analysis.cache_params(),
+							cache->template load<std::vector<typename store_type::entry>>(tiles_name, tiles_key)
+								.value_or(std::vector<typename store_type::entry>{}));
+
+						configure_plan = [tiles](auto& plan){
+							tiles->resize(plan.tile_count());
+							plan.tiles = tiles.get();
+						};
+						on_completion = [&cache = *cache, key, tiles_name, tiles_key, tiles, tif_name](auto const& region_result){
+							fprintf(stderr, "Reused %zu of %zu tiles of %s\n", tiles->hit_count(),
+								tiles->tile_count(), tif_name.c_str());
+							cache.store(Analysis::name, key, region_result);
+							if(tiles->changed())
+							{ cache.store(tiles_name, tiles_key, *tiles); }
+						};
+					}
+				}
+			}
+
+			auto const plan = mem_budget == 0 ?
+				memory_plan{image_size{}, load_strategy::whole_region, row_range{}, 0, 0} :
+				plan_memory(tif_name, mask_name, memory_plan_params{mem_budget/max_resident,
+					get_pixel_size(alloc_params.format), row_bands::band_height, row_band_analysis<Analysis>,
+					get_decode_buffer_bytes(tif_name, alloc_params), pool.thread_count()*get_chunk_bytes_per_pixel<Analysis>()});
+			if(mem_budget != 0)
+			{ log_memory_plan(stderr, tif_name, plan, mem_budget/max_resident); }
+
+			auto rows = plan.rows;
+			if constexpr(row_band_analysis<Analysis>)
+			{
+				if(shard.count != 1 && plan.strategy != load_strategy::streamed)
+				{
+					// A shard only loads the rows of its own bands, within the rows of the plan
+					auto const height = static_cast<size_t>(get_input_size(tif_name).sizes[1]);
+					auto const shard_rows = get_shard_rows(shard, height);
+					auto const first_row = std::max(plan.rows.begin, shard_rows.begin);
+					rows = row_range{first_row, std::max(std::min(plan.rows.end, shard_rows.end), first_row)};
+					if(rows.size() == 0)
+					{
+						auto const chunk_count = (height + row_bands::band_height - 1)/row_bands::band_height;
+						shard_region<typename Analysis::partial_result> empty{{}, chunk_count, shard.chunk_begin(chunk_count), {}};
+						empty.partials.resize(shard.chunk_end(chunk_count) - empty.first_chunk);
+						active.push_back(std::make_unique<parallel_region_job<Analysis>>(std::move(empty)));
+						active_inputs.push_back(item);
+						continue;
+					}
+				}
+			}
+
+			if(plan.strategy == load_strategy::whole_region || (plan.strategy == load_strategy::mask_rows && rows.size() != 0))
+			{
+				active.push_back(std::make_unique<parallel_region_job<Analysis>>(analysis,
+					load_region(tif_name, mask_name, alloc_params, rows), pool, std::move(on_completion),
+					std::move(configure_plan), shard));
+			}
+			else
+			{
+				// Tiles are not reused here, since each slab only has a part of the tiles
+				if constexpr(row_band_analysis<Analysis>)
+				{
+					active.push_back(run_streamed(analysis, tif_name, mask_name, alloc_params, plan, pool, shard,
+						std::move(store_region)));
+				}
+			}
+			active_inputs.push_back(item);
+		}
+
+		get_run_stats().begin_region("all");
+		while(!active.empty())
+		{ retire_front(); }
+
+		if(shard_dest.has_value())
+		{
+			shard_dest->finish(get_shard_state(analysis));
+			write_stats_report(args.options);
+			return 0;
+		}
+	}
+	else
+	{
+		if(args.options.find("shard_output") != std::end(args.options))
+		{ throw std::runtime_error{std::string{Analysis::name}.append(" does not support shards")}; }
+
+		auto const mem_budget = get_or(args.options, "mem_budget", value<size_t>{0}).get()*1024*1024;
+
+		for(auto item : args.inputs)
+		{
+			auto const [tif_name, mask_name] = split_input_pair(item);
+			get_run_stats().begin_region(tif_name);
+			auto const progress = get_progress().begin_region(tif_name);
+			if(mem_budget != 0)
+			{
+				// The whole region is always needed here, so the plan is only reported
+				auto const plan = plan_memory(tif_name, mask_name, memory_plan_params{mem_budget, sizeof(float), 1, false});
+				log_memory_plan(stderr, tif_name, plan, mem_budget);
+			}
+			auto const region = load_region(tif_name, mask_name, raster_alloc_params{
+				get_or(args.options, "huge_pages", huge_page_mode_option{}).value});
+			process_region(analysis, region);
+		}
+	}
+
+	get_run_stats().begin_region("all");
+	analysis.write(stdout, get_or(args.options, "output_format", table_format_option{}).value);
+	write_stats_report(args.options);
+	return 0;
+}
+
+/**
+ * Runs Analysis over the inputs given on the command line. With --sample_fraction=<f> below 1,
+ * elev_hist, slopedir and grad_at_points run as a sampled_analysis, which visits about a
+ * fraction f of the pixels. Regions are still decoded in full, so the kernels get faster, but
+ * loading does not. With a fraction of 1, the run is the same as without the option.
+*/
+template<class Analysis>
+int run_analyzer(int argc, char** argv)
+{
+	auto const args = parse_analyzer_args(argc, argv);
+	if constexpr(sampleable_analysis<Analysis>)
+	{
+		if(get_or(args.options, "sample_fraction", sample_fraction_option{}).value < 1.0)
+		{ return run_analyzer<sampled_analysis<Analysis>>(args); }
+	}
+	return run_analyzer<Analysis>(args);
+}
+
+#endif
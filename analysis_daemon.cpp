@@ -0,0 +1,577 @@
+//@	{"target":{"name":"analysis_daemon.o"}}
+
+#include "./analyses.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+class socket_handle
+{
+public:
+	socket_handle() = default;
+
+	explicit socket_handle(int fd):m_fd{fd}
+	{}
+
+	socket_handle(socket_handle&& other) noexcept:m_fd{std::exchange(other.m_fd, -1)}
+	{}
+
+	socket_handle& operator=(socket_handle&& other) noexcept
+	{
+		std::swap(m_fd, other.m_fd);
+		return *this;
+	}
+
+	~socket_handle()
+	{
+		if(m_fd != -1)
+		{ close(m_fd); }
+	}
+
+	int get() const
+	{ return m_fd; }
+
+private:
+	int m_fd{-1};
+};
+
+/**
+ * Creates a Unix domain socket listening on socket_name. A socket left behind by an earlier run
+ * is replaced, but any other kind of file is kept.
+*/
+socket_handle make_server_socket(std::string const& socket_name)
+{
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	if(std::size(socket_name) >= sizeof(addr.sun_path))
+	{ throw std::runtime_error{std::string{"Socket name too long: "}.append(socket_name)}; }
+	std::ranges::copy(socket_name, addr.sun_path);
+
+	struct stat info{};
+	if(stat(socket_name.c_str(), &info) == 0)
+	{
+		if(!S_ISSOCK(info.st_mode))
+		{ throw std::runtime_error{socket_name + " exists and is not a socket"}; }
+		unlink(socket_name.c_str());
+	}
+
+	socket_handle ret{socket(AF_UNIX, SOCK_STREAM, 0)};
+	if(ret.get() == -1)
+	{ throw std::runtime_error{std::string{"Failed to create socket: "}.append(strerror(errno))}; }
+
+	if(bind(ret.get(), reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0)
+	{ throw std::runtime_error{std::string{"Failed to bind "}.append(socket_name).append(": ").append(strerror(errno))}; }
+
+	if(listen(ret.get(), 16) != 0)
+	{ throw std::runtime_error{std::string{"Failed to listen on "}.append(socket_name)}; }
+	return ret;
+}
+
+/**
+ * Makes reads from and writes to fd fail when they wait for longer than timeout, so that a client
+ * that stops reading or writing does not block the daemon
+*/
+void set_socket_timeout(int fd, std::chrono::seconds timeout)
+{
+	timeval const val{static_cast<time_t>(timeout.count()), 0};
+	if(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &val, sizeof(val)) != 0
+		|| setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &val, sizeof(val)) != 0)
+	{ throw std::runtime_error{std::string{"Failed to set socket timeout: "}.append(strerror(errno))}; }
+}
+
+/**
+ * Reads one request, which ends at the first newline, or when the client stops writing. The
+ * whole request must arrive within timeout.
+*/
+std::string read_request(int fd, std::chrono::seconds timeout)
+{
+	auto const deadline = std::chrono::steady_clock::now() + timeout;
+	std::string ret;
+	std::array<char, 4096> buffer{};
+	while(true)
+	{
+		auto const n = read(fd, std::data(buffer), std::size(buffer));
+		if(n < 0)
+		{
+			if(errno == EINTR)
+			{ continue; }
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{ throw std::runtime_error{"Timed out waiting for the request"}; }
+			throw std::runtime_error{std::string{"Failed to read request: "}.append(strerror(errno))};
+		}
+
+		if(n == 0)
+		{ return ret; }
+
+		auto const end = std::find(std::data(buffer), std::data(buffer) + n, '\n');
+		ret.append(std::data(buffer), end);
+		if(end != std::data(buffer) + n)
+		{ return ret; }
+
+		if(std::size(ret) > 65536)
+		{ throw std::runtime_error{"Request too long"}; }
+
+		if(std::chrono::steady_clock::now() > deadline)
+		{ throw std::runtime_error{"Timed out waiting for the request"}; }
+	}
+}
+
+/**
+ * Writes all of data, and returns false if the client has gone away
+*/
+bool send_all(int fd, std::string_view data)
+{
+	while(!data.empty())
+	{
+		auto const n = send(fd, std::data(data), std::size(data), MSG_NOSIGNAL);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+			{ continue; }
+			return false;
+		}
+		data.remove_prefix(static_cast<size_t>(n));
+	}
+	return true;
+}
+
+/**
+ * Writes analysis in format, and returns what was written
+*/
+template<class Analysis>
+std::string write_to_string(Analysis& analysis, table_format format)
+{
+	char* buffer = nullptr;
+	size_t size = 0;
+	{
+		std::unique_ptr<FILE, decltype(&fclose)> dest{open_memstream(&buffer, &size), fclose};
+		if(dest == nullptr)
+		{ throw std::runtime_error{"Failed to create output buffer"}; }
+		analysis.write(dest.get(), format);
+	}
+	std::unique_ptr<char, decltype(&free)> const owner{buffer, free};
+	return std::string{buffer, size};
+}
+
+template<class T>
+size_t get_byte_size(T const& val);
+
+inline size_t get_byte_size(std::string const& val);
+
+template<class T>
+size_t get_byte_size(std::vector<T> const& val);
+
+template<class T>
+size_t get_byte_size(sample_reservoir<T> const& val);
+
+/**
+ * Returns about the number of bytes that val uses, including the memory it owns
+*/
+template<class T>
+size_t get_byte_size(T const& val)
+{
+	if constexpr(std::ranges::range<T const>)
+	{
+		return std::accumulate(std::begin(val), std::end(val), size_t{0}, [](size_t sum, auto const& item){
+			return sum + get_byte_size(item);
+		});
+	}
+	else
+	{ return sizeof(T); }
+}
+
+inline size_t get_byte_size(std::string const& val)
+{ return sizeof(val) + val.capacity(); }
+
+template<class T>
+size_t get_byte_size(std::vector<T> const& val)
+{
+	return std::accumulate(std::begin(val), std::end(val), sizeof(val) + (val.capacity() - std::size(val))*sizeof(T),
+		[](size_t sum, auto const& item){ return sum + get_byte_size(item); });
+}
+
+template<class T>
+size_t get_byte_size(sample_reservoir<T> const& val)
+{ return sizeof(val) - sizeof(val.samples) + get_byte_size(val.samples); }
+
+/**
+ * An output that has been written from a resident_result
+*/
+struct resident_output
+{
+	std::string data;
+	size_t last_use;
+};
+
+/**
+ * The partial result of an analysis of one region, the state that its output depends on, and
+ * the outputs that have been written from it, by their options
+*/
+template<class Analysis>
+struct resident_result
+{
+	typename Analysis::partial_result region_result;
+	std::string state;
+	size_t last_use;
+	std::map<std::string, resident_output> outputs;
+};
+
+template<class Analysis>
+using resident_results_of = std::map<std::string, resident_result<Analysis>>;
+
+using resident_results = std::tuple<resident_results_of<elev_hist_analysis>,
+	resident_results_of<slopedir_analysis>,
+	resident_results_of<grad_at_points_analysis>,
+	resident_results_of<peak_valley_elev_analysis>>;
+
+struct resident_region
+{
+	std::shared_ptr<loaded_region const> region;
+	size_t last_use;
+	resident_results results;
+};
+
+/**
+ * Returns the options that the partial result of a query depends on. The output format only
+ * changes how the result is written, and is included only if include_output_options is true.
+*/
+std::string get_result_key(command_line const& options, bool include_output_options)
+{
+	std::string ret;
+	for(auto const& item : options)
+	{
+		if(!include_output_options && item.first == "output_format")
+		{ continue; }
+		ret.append(item.first).append("=").append(item.second).append(";");
+	}
+	return ret;
+}
+
+/**
+ * Keeps decoded regions, and the results of the queries on them, in memory. When more than
+ * max_resident regions are needed, the region that was used longest ago is unloaded. When the
+ * results and outputs of all regions use more than result_budget bytes, those that were used
+ * longest ago are dropped.
+*/
+class analysis_daemon
+{
+public:
+	explicit analysis_daemon(size_t thread_count, bool pin, size_t max_resident, size_t result_budget,
+		raster_alloc_params alloc_params):
+		m_pool{thread_count, pin},
+		m_max_resident{std::max(max_resident, size_t{1})},
+		m_result_budget{result_budget},
+		m_alloc_params{alloc_params},
+		m_use_count{0}
+	{ m_alloc_params.touch_threads = m_pool.thread_count(); }
+
+	template<class Analysis>
+	std::string query(std::string const& input, command_line const& options)
+	{
+		auto& resident = get_region(input);
+		auto& results = std::get<resident_results_of<Analysis>>(resident.results);
+		auto const key = get_result_key(options, false);
+		auto i = results.find(key);
+		if(i == std::end(results))
+		{
+			auto analysis = make_analysis<Analysis>(options);
+			resident_result<Analysis> result{};
+			{
+				parallel_region_job<Analysis> job{analysis, resident.region, m_pool,
+					[&result](auto const& region_result){ result.region_result = region_result; }};
+				job.merge_into(analysis);
+			}
+			result.state = get_shard_state(analysis);
+			i = results.emplace(key, std::move(result)).first;
+		}
+		i->second.last_use = ++m_use_count;
+
+		auto& outputs = i->second.outputs;
+		auto const output_key = get_result_key(options, true);
+		if(auto const output = outputs.find(output_key); output != std::end(outputs))
+		{
+			output->second.last_use = m_use_count;
+			return output->second.data;
+		}
+
+		// Writing shuffles the samples, so the output is written from a copy, which starts from
+		// the same state every time
+		auto analysis = make_analysis<Analysis>(options);
+		auto region_result = i->second.region_result;
+		analysis.merge(std::move(region_result));
+		restore_shard_state(analysis, i->second.state);
+		auto ret = write_to_string(analysis, get_or(options, "output_format", table_format_option{}).value);
+		outputs.emplace(output_key, resident_output{ret, m_use_count});
+		trim_results();
+		return ret;
+	}
+
+	std::string load(std::string const& input)
+	{
+		auto const& region = *get_region(input).region;
+		return std::string{region.name}.append(" ")
+			.append(std::to_string(region.info.size.sizes[0])).append("x")
+			.append(std::to_string(region.info.size.sizes[1])).append("\n");
+	}
+
+	void unload(std::string const& input)
+	{
+		if(m_regions.erase(input) == 0)
+		{ throw std::runtime_error{input + " is not loaded"}; }
+	}
+
+	std::string list() const
+	{
+		std::string ret;
+		for(auto const& item : m_regions)
+		{ ret.append(item.first).append("\n"); }
+		return ret;
+	}
+
+private:
+	resident_region& get_region(std::string const& input)
+	{
+		auto i = m_regions.find(input);
+		if(i == std::end(m_regions))
+		{
+			while(std::size(m_regions) >= m_max_resident)
+			{
+				m_regions.erase(std::ranges::min_element(m_regions, [](auto const& a, auto const& b){
+					return a.second.last_use < b.second.last_use;
+				}));
+			}
+
+			auto const [tif_name, mask_name] = split_input_pair(input);
+			get_run_stats().begin_region(tif_name);
+			auto region = std::make_shared<loaded_region const>(load_region(tif_name, mask_name, m_alloc_params));
+			i = m_regions.emplace(input, resident_region{std::move(region), 0, resident_results{}}).first;
+		}
+		i->second.last_use = ++m_use_count;
+		return i->second;
+	}
+
+	/**
+	 * Drops the result or output that was used longest ago, until the results and outputs of
+	 * all regions fit within m_result_budget. The outputs of a result are dropped with it.
+	*/
+	void trim_results()
+	{
+		while(true)
+		{
+			size_t total = 0;
+			size_t oldest_use = static_cast<size_t>(-1);
+			std::function<void()> drop_oldest;
+			for(auto& region : m_regions)
+			{
+				std::apply([&](auto& ... items){
+					(..., [&](auto& results){
+						for(auto i = std::begin(results); i != std::end(results); ++i)
+						{
+							auto& result = i->second;
+							total += get_byte_size(result.region_result) + get_byte_size(result.state);
+							if(result.last_use < oldest_use)
+							{
+								oldest_use = result.last_use;
+								drop_oldest = [&results, i](){ results.erase(i); };
+							}
+
+							for(auto j = std::begin(result.outputs); j != std::end(result.outputs); ++j)
+							{
+								total += get_byte_size(j->second.data);
+								if(j->second.last_use < oldest_use)
+								{
+									oldest_use = j->second.last_use;
+									drop_oldest = [&outputs = result.outputs, j](){ outputs.erase(j); };
+								}
+							}
+						}
+					}(items));
+				}, region.second.results);
+			}
+
+			if(total <= m_result_budget || !drop_oldest)
+			{ return; }
+			drop_oldest();
+		}
+	}
+
+	work_stealing_pool m_pool;
+	size_t m_max_resident;
+	size_t m_result_budget;
+	raster_alloc_params m_alloc_params;
+	size_t m_use_count;
+	std::map<std::string, resident_region> m_regions;
+};
+
+/**
+ * Runs a request of the form
+ *
+ *   <command> [<tif>[,<mask>]] [<key>=<value> ...]
+ *
+ * where command is an analysis, load, unload, list or shutdown. Returns the payload of the
+ * response.
+*/
+std::string handle_request(analysis_daemon& daemon, std::string_view request, bool& running)
+{
+	std::vector<std::string_view> fields;
+	while(!request.empty())
+	{
+		auto const i = request.find_first_of(" \t\r");
+		if(i != 0)
+		{ fields.push_back(request.substr(0, i)); }
+		request = i == std::string_view::npos ? std::string_view{} : request.substr(i + 1);
+	}
+
+	if(fields.empty())
+	{ throw std::runtime_error{"Empty request"}; }
+
+	auto const command = fields.front();
+	std::string input;
+	std::vector<std::string_view> options;
+	for(auto field : std::span{fields}.subspan(1))
+	{
+		if(field.find('=') != std::string_view::npos)
+		{ options.push_back(field); }
+		else
+		if(input.empty())
+		{ input = field; }
+		else
+		{ throw std::runtime_error{std::string{"Unexpected argument "}.append(field)}; }
+	}
+
+	if(command == "list")
+	{ return daemon.list(); }
+
+	if(command == "shutdown")
+	{
+		running = false;
+		return std::string{};
+	}
+
+	if(input.empty())
+	{ throw std::runtime_error{std::string{command}.append(" requires an input")}; }
+
+	if(command == "load")
+	{ return daemon.load(input); }
+
+	if(command == "unload")
+	{
+		daemon.unload(input);
+		return std::string{};
+	}
+
+	command_line const query_options{options};
+	std::string ret;
+	auto found = false;
+	std::apply([&](auto ... item){
+		(..., [&]<class analysis_type>(analysis_type){
+			if(command != analysis_type::name)
+			{ return; }
+
+			found = true;
+			ret = daemon.template query<analysis_type>(input, query_options);
+		}(item));
+	}, std::tuple<elev_hist_analysis, slopedir_analysis, grad_at_points_analysis, peak_valley_elev_analysis>{});
+
+	if(!found)
+	{ throw std::runtime_error{std::string{"Unsupported command "}.append(command)}; }
+	return ret;
+}
+
+/**
+ * Keeps regions loaded, and answers analysis requests on the Unix domain socket given by
+ * --socket=<name>. Each connection carries one request line, such as
+ *
+ *   elev_hist dem.tif,mask.data bins=linear:0:8192:64 output_format=npy
+ *   peak_valley_elev dem.tif,mask.data seed=7
+ *
+ * and is answered with "ok <size>\n" followed by size bytes of output, in the same format as the
+ * analyzer writes for a single region, or with "error <message>\n". A region is loaded the first
+ * time it is used, and results are kept per region and options, so a repeated query is answered
+ * from memory. Use unload to drop a region whose files have changed.
+ *
+ * --threads, --pin_threads, --pixel_format, --raster_layout, --block_size and --huge_pages work
+ * as for the analyzers. At most --max_resident_regions regions are kept loaded, and the results
+ * and outputs kept for them use at most --result_budget=<MiB>, 256 by default. Connections are
+ * served one at a time, so a client that does not send its request, or read the response, within
+ * --client_timeout=<seconds>, 10 by default, is given up.
+*/
+int main(int argc, char** argv)
+{
+	auto const args = parse_analyzer_args(argc, argv);
+	configure_run_stats(args.options);
+	auto const socket_name = args.options["socket"];
+	analysis_daemon daemon{
+		get_or(args.options, "threads", value<size_t>{std::thread::hardware_concurrency()}).get(),
+		get_or(args.options, "pin_threads", value<int>{0}).get() != 0,
+		get_or(args.options, "max_resident_regions", value<size_t>{4}).get(),
+		get_or(args.options, "result_budget", value<size_t>{256}).get()*1024*1024,
+		raster_alloc_params{
+			get_or(args.options, "huge_pages", huge_page_mode_option{}).value,
+			1,
+			row_bands::band_height,
+			get_or(args.options, "pin_threads", value<int>{0}).get() != 0,
+			get_or(args.options, "raster_layout", raster_layout_option{}).blocked,
+			get_or(args.options, "block_size", value<size_t>{0}).get(),
+			get_or(args.options, "pixel_format", pixel_format_option{}).value
+		}
+	};
+
+	auto const client_timeout = std::chrono::seconds{
+		get_or(args.options, "client_timeout", value<int64_t>{10}).get()};
+	if(client_timeout.count() <= 0)
+	{ throw std::runtime_error{"--client_timeout must be positive"}; }
+	auto const server = make_server_socket(socket_name);
+	fprintf(stderr, "Listening on %s\n", socket_name.c_str());
+	auto running = true;
+	while(running)
+	{
+		socket_handle const client{accept(server.get(), nullptr, nullptr)};
+		if(client.get() == -1)
+		{
+			if(errno == EINTR)
+			{ continue; }
+			throw std::runtime_error{std::string{"Failed to accept connection: "}.append(strerror(errno))};
+		}
+
+		std::string response;
+		try
+		{
+			set_socket_timeout(client.get(), client_timeout);
+			auto const request = read_request(client.get(), client_timeout);
+			fprintf(stderr, "Request: %s\n", request.c_str());
+			auto const payload = handle_request(daemon, request, running);
+			response = std::string{"ok "}.append(std::to_string(std::size(payload))).append("\n").append(payload);
+		}
+		catch(std::exception const& err)
+		{
+			fprintf(stderr, "Request failed: %s\n", err.what());
+			response = std::string{"error "}.append(err.what()).append("\n");
+		}
+
+		if(!send_all(client.get(), response))
+		{ fprintf(stderr, "Client went away before the response was sent\n"); }
+	}
+
+	unlink(socket_name.c_str());
+	write_stats_report(args.options);
+	return 0;
+}
@@ -0,0 +1,269 @@
+//@	{"target":{"name":"batch_analyze.o"}}
+
+#include "./analyses.hpp"
+
+#include <cstdio>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+
+struct batch_job
+{
+	std::string region;
+	std::string tif_name;
+	std::optional<std::string> mask_name;
+	std::vector<std::string> analyses;
+};
+
+template<class Analysis>
+struct combined_result
+{
+	Analysis analysis;
+	bool used{false};
+};
+
+using combined_results = std::tuple<combined_result<elev_hist_analysis>,
+	combined_result<slopedir_analysis>,
+	combined_result<local_relief_analysis>,
+	combined_result<grad_at_points_analysis>,
+	combined_result<peak_valley_elev_analysis>,
+	combined_result<prominence_analysis>>;
+
+template<class Func>
+void for_each_analysis(combined_results& results, Func&& f)
+{
+	std::apply([&f](auto& ... item){ (..., f(item)); }, results);
+}
+
+/**
+ * Creates the combined results, with analyses configured from options
+*/
+combined_results make_combined_results(command_line const& options)
+{
+	return [&options]<class ... Analysis>(std::type_identity<std::tuple<combined_result<Analysis>...>>){
+		return combined_results{combined_result<Analysis>{make_analysis<Analysis>(options)}...};
+	}(std::type_identity<combined_results>{});
+}
+
+bool is_known_analysis(std::string_view name)
+{
+	return [name]<class ... Analysis>(std::type_identity<std::tuple<combined_result<Analysis>...>>){
+		return ((name == Analysis::name) || ...);
+	}(std::type_identity<combined_results>{});
+}
+
+std::vector<std::string> split(std::string_view str, char delim)
+{
+	std::vector<std::string> ret;
+	while(!str.empty())
+	{
+		auto const i = str.find(delim);
+		ret.push_back(std::string{str.substr(0, i)});
+		str = i == std::string_view::npos ? std::string_view{} : str.substr(i + 1);
+	}
+	return ret;
+}
+
+/**
+ * Reads a job list. Each line has the form
+ *
+ *   region tif mask analysis[,analysis...]
+ *
+ * where fields are separated by spaces or tabs, and mask may be - for no mask. Empty lines,
+ * and lines starting with #, are ignored.
+*/
+std::vector<batch_job> load_jobs(char const* filename)
+{
+	file const src{filename, "rb"};
+	std::vector<batch_job> ret;
+	std::array<char, 4096> line{};
+	size_t line_number = 0;
+	while(fgets(std::data(line), static_cast<int>(std::size(line)), src.get()) != nullptr)
+	{
+		++line_number;
+		std::string_view line_content{std::data(line)};
+		while(!line_content.empty() && (line_content.back() == '\n' || line_content.back() == '\r'))
+		{ line_content.remove_suffix(1); }
+
+		std::string normalized{line_content};
+		std::ranges::replace(normalized, '\t', ' ');
+
+		std::vector<std::string> fields;
+		std::ranges::copy_if(split(normalized, ' '), std::back_inserter(fields), [](auto const& item){
+			return !item.empty();
+		});
+		if(fields.empty() || fields[0].starts_with('#'))
+		{ continue; }
+
+		if(std::size(fields) != 4)
+		{
+			throw std::runtime_error{std::string{filename}.append(":").append(std::to_string(line_number))
+				.append(": expected region, tif, mask and analyses")};
+		}
+
+		batch_job job{fields[0], fields[1], std::nullopt, split(fields[3], ',')};
+		if(fields[2] != "-")
+		{ job.mask_name = fields[2]; }
+
+		for(auto const& item : job.analyses)
+		{
+			if(!is_known_analysis(item))
+			{ throw std::runtime_error{std::string{"Unsupported analysis "}.append(item)}; }
+		}
+		ret.push_back(std::move(job));
+	}
+	return ret;
+}
+
+struct batch_params
+{
+	std::string output_dir;
+	table_format format;
+};
+
+std::string get_output_name(batch_params const& params, std::string_view prefix, char const* suffix)
+{
+	return std::string{params.output_dir}.append("/")
+		.append(prefix)
+		.append("_")
+		.append(suffix)
+		.append(params.format == table_format::npy ? ".npy" : ".txt");
+}
+
+template<class Analysis>
+void run_job(std::shared_ptr<loaded_region const> const& region,
+	std::string const& region_name,
+	combined_result<Analysis>& combined,
+	batch_params const& params,
+	command_line const& options,
+	work_stealing_pool& pool)
+{
+	auto analysis = make_analysis<Analysis>(options);
+	process_region(analysis, region, pool);
+	if constexpr(Analysis::has_combined_output)
+	{
+		// Samples must be merged before the per-region output is written, since writing
+		// shuffles them. Analyses that cannot be merged are run again on the combined state,
+		// which gives the same result as running the tool on all regions.
+		if constexpr(requires { analysis.merge_into(combined.analysis); })
+		{ analysis.merge_into(combined.analysis); }
+		else
+		{ process_region(combined.analysis, region, pool); }
+		combined.used = true;
+	}
+
+	file const dest{get_output_name(params, region_name, Analysis::output_suffix), "wb"};
+	analysis.write(dest.get(), params.format);
+}
+
+/**
+ * A region that is being loaded in the background
+*/
+struct pending_region
+{
+	batch_job const* job;
+	size_t byte_size;
+	std::future<loaded_region> result;
+};
+
+int main(int argc, char** argv)
+{
+	auto const args = parse_analyzer_args(argc, argv);
+	configure_run_stats(args.options);
+
+	std::vector<batch_job> jobs;
+	std::ranges::for_each(args.inputs, [&jobs](auto const item){
+		std::ranges::move(load_jobs(item), std::back_inserter(jobs));
+	});
+
+	batch_params const params{
+		get_or(args.options, "output_dir", std::string{"."}),
+		get_or(args.options, "output_format", table_format_option{}).value
+	};
+	auto const mem_budget = get_or(args.options, "mem_budget", value<size_t>{4096}).get()*1024*1024;
+	auto const max_prefetch = std::max(get_or(args.options, "prefetch", value<size_t>{2}).get(), size_t{1});
+	auto const reporter = make_progress_reporter(args.options, std::size(jobs));
+
+	// The chunks of all analyses of a region share one pool, as in the single-analysis tools
+	auto const pin = get_or(args.options, "pin_threads", value<int>{0}).get() != 0;
+	work_stealing_pool pool{get_or(args.options, "threads", value<size_t>{std::thread::hardware_concurrency()}).get(),
+		pin};
+	raster_alloc_params alloc_params{};
+	alloc_params.touch_threads = pool.thread_count();
+	alloc_params.pin = pin;
+
+	auto combined = make_combined_results(args.options);
+
+	// Regions are decoded on background threads, while the current region is analyzed. A new
+	// region is only started when it fits within --mem_budget=<MiB>, 4096 by default, together
+	// with all regions that are in flight, including the one being analyzed. When nothing is in flight, the next
+	// region is always started, so a region that is larger than the budget is still processed.
+	std::deque<pending_region> in_flight;
+	size_t bytes_in_flight = 0;
+	auto next_job = std::begin(jobs);
+	auto const prefetch = [&](){
+		while(next_job != std::end(jobs) && std::size(in_flight) < max_prefetch)
+		{
+			auto const byte_size = get_region_byte_size(next_job->tif_name, next_job->mask_name.has_value());
+			if(bytes_in_flight != 0 && bytes_in_flight + byte_size > mem_budget)
+			{ return; }
+
+			bytes_in_flight += byte_size;
+			in_flight.push_back(pending_region{&*next_job, byte_size,
+				std::async(std::launch::async, [job = &*next_job, &alloc_params](){
+					get_run_stats().begin_region(job->tif_name);
+					return load_region(job->tif_name, job->mask_name, alloc_params);
+				})});
+			++next_job;
+		}
+	};
+
+	prefetch();
+	while(!in_flight.empty())
+	{
+		auto const& job = *in_flight.front().job;
+		auto const byte_size = in_flight.front().byte_size;
+		get_run_stats().begin_region(job.tif_name);
+		auto const progress = get_progress().begin_region(job.tif_name);
+		fprintf(stderr, "Processing %s\n", job.region.c_str());
+
+		auto const region = [&in_flight](){
+			scoped_timer timer{"load_wait"};
+			auto ret = std::make_shared<loaded_region const>(in_flight.front().result.get());
+			in_flight.pop_front();
+			return ret;
+		}();
+		prefetch();
+
+		for(auto const& analysis : job.analyses)
+		{
+			for_each_analysis(combined, [&analysis, &region, &job, &params, &args, &pool](auto& result){
+				using analysis_type = std::remove_cvref_t<decltype(result.analysis)>;
+				if(analysis == analysis_type::name)
+				{ run_job(region, job.region, result, params, args.options, pool); }
+			});
+		}
+
+		bytes_in_flight -= byte_size;
+		prefetch();
+	}
+
+	get_run_stats().begin_region("all");
+	for_each_analysis(combined, [&params](auto& result){
+		using analysis_type = std::remove_cvref_t<decltype(result.analysis)>;
+		if(result.used)
+		{
+			file const dest{get_output_name(params, "all", analysis_type::output_suffix), "wb"};
+			result.analysis.write(dest.get(), params.format);
+		}
+	});
+
+	write_stats_report(args.options);
+	return 0;
+}
@@ -18,27 +18,41 @@ public:
 
 	blob() = default;
 
-	explicit blob(FILE* fptr, size_t N):m_handle{std::make_unique<T[]>(N)}
+	explicit blob(FILE* fptr, size_t N):blob{fptr, N, 0, N}
+	{}
+
+	/**
+	 * Loads elements [first, first + count) of a file that holds N elements
+	*/
+	explicit blob(FILE* fptr, size_t N, size_t first, size_t count):
+		m_handle{std::make_unique_for_overwrite<T[]>(count)}
 	{
 		struct stat statbuf{};
 		fstat(fileno(fptr), &statbuf);
-		if(static_cast<size_t>(statbuf.st_size) != N)
+		if(static_cast<size_t>(statbuf.st_size) != N*sizeof(T))
 		{
 			throw std::runtime_error{std::string{"Failed to load blob: Wrong file size"}
 				.append(" ")
 				.append(std::to_string(statbuf.st_size))
 				.append(" vs ")
-				.append(std::to_string(N))};
+				.append(std::to_string(N*sizeof(T)))
+				.append(" bytes")};
 		}
 
-		auto const res = fread(get(), sizeof(T), N, fptr);
-		if(res != N)
+		if(first > N || count > N - first)
+		{ throw std::runtime_error{"Failed to load blob: Range outside the file"}; }
+
+		if(first != 0 && fseeko(fptr, static_cast<off_t>(first*sizeof(T)), SEEK_SET) != 0)
+		{ throw std::runtime_error{"Failed to load blob: Seek failed"}; }
+
+		auto const res = fread(get(), sizeof(T), count, fptr);
+		if(res != count)
 		{
 			throw std::runtime_error{std::string{"Failed to load blob: Early EOF?"}
 				.append(" ")
 				.append(std::to_string(res))
 				.append(" vs ")
-				.append(std::to_string(N))};
+				.append(std::to_string(count))};
 		}
 	}
 
@@ -0,0 +1,158 @@
+//@{"target":{"name":"block_visitor.test"}}
+
+#include "./geotiff_loader.hpp"
+#include "./region_loader.hpp"
+#include "./analyses.hpp"
+#include "./synthetic_dem.hpp"
+#include "./test_temp_file.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+namespace
+{
+    constexpr uint32_t seed = 7;
+
+    bool close(double a, double b)
+    { return std::abs(a - b) <= 1.0e-9*std::max({std::abs(a), std::abs(b), 1.0}); }
+
+    // Blocks see the pixels and mask at their image coordinates, and elev_hist totals over the
+    // blocks match those of the whole region
+    void test_visit_region_blocks(std::string const& name, std::string const& mask_name, image_size size)
+    {
+        auto const w = static_cast<size_t>(size.sizes[0]);
+        auto const h = static_cast<size_t>(size.sizes[1]);
+        auto const pixels = make_synthetic_heightmap(size, seed);
+        auto const mask = make_synthetic_mask(size);
+        assert(std::count(mask.get(), mask.get() + w*h, 0) != 0 && std::count(mask.get(), mask.get() + w*h, 1) != 0);
+
+        elev_histogram expected;
+        load_region(name, mask_name).visit_view([&expected, h](auto const& view){
+            accumulate_elev_hist(view, 0, h, histogram_bins{}, expected);
+        });
+
+        elev_hist_analysis const analysis{};
+        std::vector<int> visits(w*h);
+        std::mutex mutex;
+        elev_hist_analysis::partial_result totals;
+        visit_region_blocks(name, mask_name, 3, [&](region_block const& block){
+            auto partial = analysis.process_block(block);
+            std::lock_guard lock{mutex};
+            assert(block.index < block.count);
+            for(auto y = block.rows.begin; y != block.rows.end; ++y)
+            {
+                for(auto x = block.columns.begin; x != block.columns.end; ++x)
+                {
+                    assert(block.region.pixels(x, y) == pixels[y*w + x]);
+                    assert(block.region.mask(x, y) == mask[y*w + x]);
+                    ++visits[y*w + x];
+                }
+            }
+            elev_hist_analysis::combine(totals, std::move(partial));
+        });
+        assert(std::ranges::all_of(visits, [](int val){ return val == 1; }));
+        assert(std::ranges::equal(totals, expected, close));
+        assert(std::ranges::equal(visit_region(analysis, name, mask_name, 3), expected, close));
+
+        // A mask of another size is rejected before any block is visited
+        auto const short_mask_name = get_temp_name("block_visitor_test", "_short.mask");
+        {
+            file const dest{short_mask_name, "wb"};
+            assert(fwrite(mask.get(), 1, w*h - 1, dest.get()) == w*h - 1);
+        }
+        try
+        {
+            visit_region_blocks(name, short_mask_name, 2, [](region_block const&){ assert(false); });
+            assert(false);
+        }
+        catch(std::runtime_error const&)
+        {}
+        std::filesystem::remove(short_mask_name);
+    }
+}
+
+int main()
+{
+    image_size const size{vec2u_t{150, 77}};
+    auto const w = static_cast<size_t>(size.sizes[0]);
+    auto const h = static_cast<size_t>(size.sizes[1]);
+    auto const pixels = make_synthetic_heightmap(size, seed);
+    auto const name = get_temp_name("block_visitor_test", ".tif");
+    auto const mask_name = get_temp_name("block_visitor_test", ".mask");
+    for(auto const& layout : {image_layout{tile_info{vec2u_t{64, 32}}}, image_layout{strip_info{5}},
+        image_layout{strip_info{static_cast<uint32_t>(-1)}}})
+    {
+        write_synthetic_dem(name, mask_name, synthetic_dem_params{size, layout, synthetic_compression::lzw, seed});
+        auto const tiff = make_tiff(name.c_str());
+        auto const info = get_image_info(tiff.get());
+
+        for(auto const rows : {row_range{}, row_range{10, 45}})
+        {
+            // Every pixel of rows is visited exactly once, with its value
+            std::vector<int> visits(w*h);
+            std::mutex mutex;
+            size_t block_count = 0;
+            visit_blocks(name.c_str(), info, rows, [&](decoded_block const& block){
+                std::lock_guard lock{mutex};
+                ++block_count;
+                assert(block.index < block.count);
+                for(size_t y = 0; y != block.size[1]; ++y)
+                {
+                    for(size_t x = 0; x != block.size[0]; ++x)
+                    {
+                        vec2u_t const loc = block.origin + vec2u_t{x, y};
+                        assert(block.pixels[y*block.stride + x] == pixels[loc[1]*w + loc[0]]);
+                        ++visits[loc[1]*w + loc[0]];
+                    }
+                }
+            }, 3);
+
+            for(size_t y = 0; y != h; ++y)
+            {
+                for(size_t x = 0; x != w; ++x)
+                { assert(visits[y*w + x] == (y >= rows.begin && y < rows.end ? 1 : 0)); }
+            }
+            assert(block_count != 0);
+        }
+
+        // Errors from the visitor reach the caller
+        try
+        {
+            visit_blocks(name.c_str(), info, row_range{}, [](decoded_block const&){
+                throw std::runtime_error{"Stop"};
+            }, 2);
+            assert(false);
+        }
+        catch(std::runtime_error const& err)
+        { assert(std::string_view{err.what()} == "Stop"); }
+
+        // While the first block is being visited, no thread takes a block too far past it
+        {
+            size_t const thread_count = 3;
+            std::atomic<bool> first_done{false};
+            std::atomic<size_t> visited{0};
+            visit_blocks(name.c_str(), info, row_range{}, [&](decoded_block const& block){
+                ++visited;
+                if(block.index == 0)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+                    first_done = true;
+                    return;
+                }
+                assert(first_done || block.index < 4*thread_count);
+            }, thread_count);
+            assert(visited != 0);
+        }
+
+        test_visit_region_blocks(name, mask_name, size);
+    }
+    std::filesystem::remove(name);
+    std::filesystem::remove(mask_name);
+}
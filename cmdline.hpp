@@ -1,8 +1,14 @@
 #ifndef CMDLINE_HPP
 #define CMDLINE_HPP
 
+#include <charconv>
+#include <concepts>
 #include <map>
 #include <string>
+#include <string_view>
+#include <optional>
+#include <vector>
+#include <span>
 #include <stdexcept>
 #include <algorithm>
 
@@ -14,16 +20,18 @@ public:
 	using value_type = storage_type::value_type;
 	using mapped_type = storage_type::mapped_type;
 
+	command_line() = default;
+
 	explicit command_line(int argc, char** argv)
 	{
 		for(int k = 1; k < argc; ++k)
-		{
-			auto const arg = std::string_view{argv[k]};
-			auto const i = std::ranges::find(arg, '=');
-			if(i == std::end(arg))
-			{ throw std::runtime_error{std::string{arg}.append(" is missing a value")}; }
-			m_storage[std::string{std::begin(arg), i}] = std::string{i + 1, std::end(arg)};
-		}
+		{ add(argv[k]); }
+	}
+
+	explicit command_line(std::span<std::string_view const> args)
+	{
+		for(auto arg : args)
+		{ add(arg); }
 	}
 
 	auto const& operator[](std::string_view key) const
@@ -46,9 +54,68 @@ public:
 	}
 
 private:
+	void add(std::string_view arg)
+	{
+		auto const i = std::ranges::find(arg, '=');
+		if(i == std::end(arg))
+		{ throw std::runtime_error{std::string{arg}.append(" is missing a value")}; }
+		m_storage[std::string{std::begin(arg), i}] = std::string{i + 1, std::end(arg)};
+	}
+
 	storage_type m_storage;
 };
 
+template<class T>
+requires std::integral<T> || std::floating_point<T>
+struct value
+{
+	value():val{0}{}
+
+	explicit value(T v):val{v}{}
+
+	/**
+	 * The whole string must be a number that T can hold, so negative values are rejected for
+	 * unsigned types
+	*/
+	explicit value(std::string const& str)
+	{
+		auto const end = std::data(str) + std::size(str);
+		auto const res = std::from_chars(std::data(str), end, val);
+		if(res.ec != std::errc{} || res.ptr != end)
+		{ throw std::runtime_error{std::string{"Invalid number "}.append(str)}; }
+	}
+
+	T get() const { return val;}
+
+	T val;
+};
+
+struct analyzer_args
+{
+	command_line options;
+	std::vector<char const*> inputs;
+};
+
+/**
+ * Splits the arguments to an analyzer into options, which are given as --key=value, and
+ * inputs, which are anything else.
+*/
+inline analyzer_args parse_analyzer_args(int argc, char** argv)
+{
+	std::vector<std::string_view> options;
+	analyzer_args ret;
+	for(int k = 1; k < argc; ++k)
+	{
+		auto const arg = std::string_view{argv[k]};
+		if(arg.starts_with("--"))
+		{ options.push_back(arg.substr(2)); }
+		else
+		{ ret.inputs.push_back(argv[k]); }
+	}
+	ret.options = command_line{options};
+	return ret;
+}
+
 
 template<class T, class ... Args>
 T get_or(command_line const& cmdline, std::string_view key, T default_val, Args&& ... args)
@@ -0,0 +1,253 @@
+#ifndef CROSS_SECTION_HPP
+#define CROSS_SECTION_HPP
+
+#include "./types.hpp"
+#include "./get_local_extrema.hpp"
+
+#include <cmath>
+#include <array>
+#include <vector>
+#include <span>
+#include <random>
+#include <numbers>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+inline vec4_t get_origin(raster_view<uint8_t const> mask, image_size size, std::mt19937& rng)
+{
+	if(size.sizes[0] < 3 || size.sizes[1] < 3)
+	{ throw std::runtime_error{"Too small domain"};}
+
+	std::uniform_int_distribution ux{static_cast<size_t>(1), size.sizes[0] - 1};
+	std::uniform_int_distribution uy{static_cast<size_t>(1), size.sizes[1] - 1};
+
+	while(true)
+	{
+		auto const x = ux(rng);
+		auto const y = uy(rng);
+
+		if(mask.data() == nullptr || mask(x, y) != 0)
+		{
+			return vec4_t{static_cast<float>(x), static_cast<float>(y), 0.0f, 0.0f};
+		}
+	}
+}
+
+inline vec4_t get_direction(std::mt19937& rng)
+{
+    auto const angle=std::move(std::uniform_real_distribution{0.0f, std::numbers::pi_v<float>})(rng);
+	return vec4_t{std::cos(angle), std::sin(angle), 0.0f, 0.0f};
+}
+
+inline vec4_t get_start_loc(vec4_t origin, vec4_t dir, float w)
+{
+	// find axis intersections from the equation
+	// origin - r*dir = 0
+
+	auto const r1 = origin[0]/dir[0];
+	auto const r2 = origin[1]/dir[1];
+
+	// r1 might be negative
+	if(r1 < 0.0f)
+	{
+		// but it must be positive for the solution to be correct.
+		// Thus r1 is discarded. Use width to compute a new one.
+		auto const r1_alt = (origin[0] - w)/dir[0];
+		return origin - dir*std::min(r2, r1_alt);
+	}
+	else
+	{
+		// If both r1 and r2 are positive, choose the smaller to stay within boundaries
+		return origin - dir*std::min(r1, r2);
+	}
+}
+
+template<class T>
+inline float interp(raster_view<T const> img, vec4_t loc)
+{
+	// Indices are 64-bit, so that rasters with more than 2^32 pixels can be addressed
+	auto const w = static_cast<int64_t>(img.width());
+	auto const h = static_cast<int64_t>(img.height());
+	auto const x_0  = static_cast<size_t>((static_cast<int64_t>(loc[0]) + w) % w);
+	auto const y_0  = static_cast<size_t>((static_cast<int64_t>(loc[1]) + h) % h);
+	auto const x_1  = (x_0 + 1) % static_cast<size_t>(w);
+	auto const y_1  = (y_0 + 1) % static_cast<size_t>(h);
+
+	auto const z_00 = to_float(img(x_0, y_0));
+	auto const z_01 = to_float(img(x_0, y_1));
+	auto const z_10 = to_float(img(x_1, y_0));
+	auto const z_11 = to_float(img(x_1, y_1));
+
+	auto const xi = loc - vec4_t{static_cast<float>(x_0), static_cast<float>(y_0), 0.0f, 0.0f};
+
+	auto const z_x0 = (1.0f - static_cast<float>(xi[0])) * z_00 + static_cast<float>(xi[0]) * z_10;
+	auto const z_x1 = (1.0f - static_cast<float>(xi[0])) * z_01 + static_cast<float>(xi[0]) * z_11;
+	return (1.0f - static_cast<float>(xi[1])) * z_x0 + static_cast<float>(xi[1]) * z_x1;
+}
+
+struct ray
+{
+	vec4_t origin;
+	vec4_t direction;
+};
+
+using curve = std::vector<vec4_t>;
+
+template<class Pixel>
+std::vector<curve> get_cross_section(ray r, basic_heightmap_region<Pixel> const& region)
+{
+	auto const heightmap = region.pixels;
+	auto const mask = region.mask;
+	auto const size = region.size;
+	auto const& domain = region.domain;
+	auto const R_e = region.R_e;
+	auto const R_p = region.R_p;
+
+	std::vector<curve> ret;
+	auto loc_prev = r.origin;
+	auto loc = loc_prev + r.direction;
+	float t = 0.0f;
+
+	curve current;
+
+	while(loc[0]>=0.0f && loc[0] < static_cast<float>(size.sizes[0]) &&
+		loc[1] < static_cast<float>(size.sizes[1]))
+	{
+		auto const mask_val = mask.data() == nullptr ? 1.0f : interp(mask, loc);
+		auto const z = interp(heightmap, loc);
+		if(mask_val < 0.5f || z < 1.0f)
+		{
+			if(std::size(current) != 0)
+			{
+				ret.push_back(std::move(current));
+				t = 0.0f;
+			}
+		}
+		else
+		{
+			assert(z < 9000.0f);
+			current.push_back(vec4_t{t, z, 0.0f, 0.0f});
+			auto const lambda_phi = pixel_to_geo_coords(loc, size, domain);
+			auto const longlat_delta = lambda_phi - pixel_to_geo_coords(loc_prev, size, domain);
+			auto const delta = nabla_factors(R_e, R_p, lambda_phi)*longlat_delta;
+			t += std::sqrt(delta[0]*delta[0] + delta[1]*delta[1]);
+		}
+		loc_prev = loc;
+		loc+=r.direction;
+	}
+
+	if(std::size(current) != 0)
+	{
+		ret.push_back(std::move(current));
+	}
+
+//	assert(std::size(ret) != 0);
+	return ret;
+}
+
+inline curve filter(std::span<vec4_t const> vals)
+{
+	auto const f = 2.0f*std::numbers::pi_v<float>*1.0f/2048.0f;
+	curve ret;
+	std::ranges::transform(vals, std::back_inserter(ret), [z = 0.0f, t = 0.0f, f](auto val) mutable {
+		auto const dt = val[0] - t;
+		z += f*dt*(val[1] - z);
+		t = val[0];
+		return vec4_t{t, z, 0.0f, 0.0f};
+	});
+
+	return ret;
+}
+
+struct peak_data
+{
+	float t;
+	float min;
+	float max;
+};
+
+using peak_samples = std::array<std::vector<peak_data>, 159>;
+
+/**
+ * Finds all peaks along val, and estimates the valley elevation at each peak by linear
+ * interpolation between the surrounding minima. Peaks that are more than 32 m above the
+ * valley are added to histogram.
+*/
+inline void collect_peaks(curve const& val, peak_samples& histogram)
+{
+	auto const filtered_val = filter(val);
+	auto const extrema = get_local_extrema<vec4_t>(filtered_val, [](auto a, auto b){ return a[1] < b[1]; });
+	if(std::size(extrema) < 3)
+	{ return; }
+
+	auto next_peak = [vals_end = std::end(extrema) - 1](auto start) {
+		return std::find_if(start + 1, vals_end, [](auto const& item) {
+			return item.type == extremum_type::max;
+		});
+	};
+
+	auto i_peak = next_peak(std::begin(extrema));
+
+	while(i_peak != std::end(extrema) - 1)
+	{
+		auto const peak = *(i_peak->item);
+		auto const i_valley_a = i_peak - 1;
+		auto const i_valley_b = i_peak + 1;
+
+		auto const valley_a = *(i_valley_a->item);
+		auto const valley_b = *(i_valley_b->item);
+
+		auto const t_peak = peak[0];
+		auto const t_valley_a = valley_a[0];
+		auto const t_valley_b = valley_b[0];
+
+		auto const dt = t_valley_b - t_valley_a;
+		auto const xi = (t_peak - t_valley_a)/dt;
+
+		auto const t = t_peak;
+		auto const min = xi*valley_b[1] + (1.0f - xi)*valley_a[1];
+		auto const max = peak[1];
+		auto const bucket = static_cast<size_t>(max < 1.0f ? 0.0f : 12.0f*std::log2(max));
+		if(max - min > 32.0f)
+		{ histogram[bucket].push_back(peak_data{t, min, max}); }
+		i_peak = next_peak(i_peak);
+	 }
+}
+
+/**
+ * Picks a random ray through a point inside the mask of region
+*/
+template<class Pixel>
+ray make_random_ray(basic_heightmap_region<Pixel> const& region, std::mt19937& rng)
+{
+	auto const origin = get_origin(region.mask, region.size, rng);
+	ray r{};
+	r.direction = get_direction(rng);
+	r.origin = get_start_loc(origin, r.direction, static_cast<float>(region.size.sizes[0] - 1));
+	return r;
+}
+
+/**
+ * Casts one random ray through region, and returns the cross sections along it
+*/
+template<class Pixel>
+std::vector<curve> cast_random_ray(basic_heightmap_region<Pixel> const& region, std::mt19937& rng)
+{
+	return get_cross_section(make_random_ray(region, rng), region);
+}
+
+/**
+ * Traces one random ray through region, and collects the peaks along it
+*/
+template<class Pixel>
+void trace_random_ray(basic_heightmap_region<Pixel> const& region, std::mt19937& rng, peak_samples& histogram)
+{
+	auto const curves = cast_random_ray(region, rng);
+
+	std::ranges::for_each(curves, [&histogram](auto const& val) {
+		collect_peaks(val, histogram);
+	});
+}
+
+#endif
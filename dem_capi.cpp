@@ -0,0 +1,211 @@
+//@	{"target":{"name":"dem_capi.o"}}
+
+#include "./dem_capi.hpp"
+#include "./region_loader.hpp"
+#include "./elev_hist_kernel.hpp"
+#include "./gradient_kernels.hpp"
+#include "./cross_section.hpp"
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#define DEM_CAPI_EXPORT extern "C" __attribute__((visibility("default")))
+
+struct dem_region
+{
+	loaded_region region;
+};
+
+struct dem_samples
+{
+	std::vector<float> values;
+	size_t columns;
+};
+
+namespace
+{
+	std::string& last_error()
+	{
+		thread_local std::string ret;
+		return ret;
+	}
+
+	/**
+	 * Calls f, and turns any exception into an error code, since exceptions must not cross the
+	 * C interface
+	*/
+	template<class Func>
+	int call_and_catch(Func&& f) noexcept
+	{
+		try
+		{
+			f();
+			return 0;
+		}
+		catch(std::exception const& err)
+		{ last_error() = err.what(); }
+		catch(...)
+		{ last_error() = "Unknown error"; }
+		return -1;
+	}
+
+	heightmap_region make_heightmap_region(dem_heightmap const* heightmap)
+	{
+		if(heightmap == nullptr || heightmap->pixels == nullptr)
+		{ throw std::runtime_error{"No pixels given"}; }
+
+		if(heightmap->width < 3 || heightmap->height < 3)
+		{ throw std::runtime_error{"Too small heightmap"}; }
+
+		image_size const size{vec2u_t{heightmap->width, heightmap->height}};
+		return heightmap_region{
+			raster_view<float const>{heightmap->pixels, size},
+			heightmap->mask == nullptr ? raster_view<uint8_t const>{} : raster_view<uint8_t const>{heightmap->mask, size},
+			size,
+			corners_in_geo_coords{
+				vec4_t{static_cast<float>(heightmap->domain_min[0]), static_cast<float>(heightmap->domain_min[1]), 0.0f, 0.0f},
+				vec4_t{static_cast<float>(heightmap->domain_max[0]), static_cast<float>(heightmap->domain_max[1]), 0.0f, 0.0f}
+			},
+			static_cast<float>(heightmap->R_e),
+			static_cast<float>(heightmap->R_p)
+		};
+	}
+
+	template<class Func>
+	int make_samples(dem_samples** samples, size_t columns, Func&& fill)
+	{
+		return call_and_catch([samples, columns, &fill](){
+			if(samples == nullptr)
+			{ throw std::runtime_error{"No output given"}; }
+
+			auto ret = std::make_unique<dem_samples>(dem_samples{{}, columns});
+			fill(ret->values);
+			*samples = ret.release();
+		});
+	}
+}
+
+DEM_CAPI_EXPORT uint32_t dem_capi_version(void)
+{ return DEM_CAPI_VERSION; }
+
+DEM_CAPI_EXPORT char const* dem_last_error(void)
+{ return last_error().c_str(); }
+
+DEM_CAPI_EXPORT int dem_load_region(char const* tif_name, char const* mask_name, dem_region** region)
+{
+	return call_and_catch([tif_name, mask_name, region](){
+		if(tif_name == nullptr || region == nullptr)
+		{ throw std::runtime_error{"No input or output given"}; }
+
+		auto const mask = mask_name == nullptr ? std::optional<std::string>{} : std::optional<std::string>{mask_name};
+		*region = new dem_region{load_region(tif_name, mask)};
+	});
+}
+
+DEM_CAPI_EXPORT void dem_free_region(dem_region* region)
+{ delete region; }
+
+DEM_CAPI_EXPORT void dem_get_heightmap(dem_region const* region, dem_heightmap* heightmap)
+{
+	auto const& src = region->region;
+	heightmap->pixels = std::get<raster<float>>(src.pixels).data();
+	heightmap->mask = src.mask.get();
+	heightmap->width = src.info.size.sizes[0];
+	heightmap->height = src.info.size.sizes[1];
+	heightmap->domain_min[0] = src.domain.min[0];
+	heightmap->domain_min[1] = src.domain.min[1];
+	heightmap->domain_max[0] = src.domain.max[0];
+	heightmap->domain_max[1] = src.domain.max[1];
+	heightmap->R_e = src.R_e;
+	heightmap->R_p = src.R_p;
+}
+
+DEM_CAPI_EXPORT uint64_t dem_elev_hist_bucket_count(void)
+{ return elev_hist_bucket_count; }
+
+DEM_CAPI_EXPORT float dem_elev_hist_bucket_size(void)
+{ return elev_hist_bucket_size; }
+
+DEM_CAPI_EXPORT int dem_elev_hist(dem_heightmap const* heightmap, uint64_t row_begin, uint64_t row_end,
+	double* histogram)
+{
+	return call_and_catch([heightmap, row_begin, row_end, histogram](){
+		auto const region = make_heightmap_region(heightmap);
+		// The default bins, without the underflow and overflow bins
+		histogram_bins const bins{};
+		elev_histogram result{};
+		accumulate_elev_hist(region, row_begin, row_end, bins, result);
+		std::transform(std::begin(result) + 1, std::end(result) - 1, histogram, histogram, std::plus<>{});
+	});
+}
+
+DEM_CAPI_EXPORT uint64_t dem_slope_direction_count(void)
+{ return std::tuple_size_v<slope_direction_sums>; }
+
+DEM_CAPI_EXPORT int dem_slope_directions(dem_heightmap const* heightmap, uint64_t row_begin, uint64_t row_end,
+	double* sums)
+{
+	return call_and_catch([heightmap, row_begin, row_end, sums](){
+		auto const region = make_heightmap_region(heightmap);
+		slope_direction_sums result{};
+		accumulate_slope_directions(region, row_begin, row_end, result);
+		for(size_t k = 0; k != std::size(result); ++k)
+		{
+			sums[2*k] += result[k].first;
+			sums[2*k + 1] += result[k].second;
+		}
+	});
+}
+
+DEM_CAPI_EXPORT int dem_gradients(dem_heightmap const* heightmap, uint64_t row_begin, uint64_t row_end,
+	dem_samples** samples)
+{
+	return make_samples(samples, 2, [heightmap, row_begin, row_end](auto& values){
+		auto const region = make_heightmap_region(heightmap);
+		gradient_samples result;
+		collect_gradients(region, row_begin, row_end, result);
+		for(auto const& bucket : result)
+		{
+			std::ranges::for_each(bucket, [&values](auto const& item){
+				values.push_back(std::get<0>(item));
+				values.push_back(std::get<1>(item));
+			});
+		}
+	});
+}
+
+DEM_CAPI_EXPORT int dem_cross_section(dem_heightmap const* heightmap, double const origin[2], double const direction[2],
+	dem_samples** samples)
+{
+	return make_samples(samples, 3, [heightmap, origin, direction](auto& values){
+		auto const region = make_heightmap_region(heightmap);
+		ray const r{
+			vec4_t{static_cast<float>(origin[0]), static_cast<float>(origin[1]), 0.0f, 0.0f},
+			vec4_t{static_cast<float>(direction[0]), static_cast<float>(direction[1]), 0.0f, 0.0f}
+		};
+		auto const curves = get_cross_section(r, region);
+		for(size_t k = 0; k != std::size(curves); ++k)
+		{
+			std::ranges::for_each(curves[k], [&values, k](auto const& item){
+				values.push_back(static_cast<float>(k));
+				values.push_back(item[0]);
+				values.push_back(item[1]);
+			});
+		}
+	});
+}
+
+DEM_CAPI_EXPORT float const* dem_samples_data(dem_samples const* samples)
+{ return std::data(samples->values); }
+
+DEM_CAPI_EXPORT uint64_t dem_samples_rows(dem_samples const* samples)
+{ return std::size(samples->values)/samples->columns; }
+
+DEM_CAPI_EXPORT uint64_t dem_samples_columns(dem_samples const* samples)
+{ return samples->columns; }
+
+DEM_CAPI_EXPORT void dem_free_samples(dem_samples* samples)
+{ delete samples; }
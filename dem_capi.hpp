@@ -0,0 +1,112 @@
+//@	{"dependencies_extra":[{"ref":"./dem_capi.o", "rel":"implementation"}]}
+
+#ifndef DEM_CAPI_HPP
+#define DEM_CAPI_HPP
+
+/*
+ * C interface of libdem_capi.so, for use from other languages, for example through ctypes.
+ *
+ * Functions that can fail return 0 on success, and -1 on failure, in which case
+ * dem_last_error returns a description of the error. All buffers that the library returns are
+ * owned by the object they are taken from, and stay valid until it is freed.
+ *
+ * The layout of the structs, and the signatures of the functions, only change together with
+ * DEM_CAPI_VERSION.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEM_CAPI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A heightmap given by caller-visible buffers. pixels holds width*height float32 elevations,
+ * row by row. mask holds width*height bytes, where non-zero means inside, or is NULL if all
+ * pixels are inside. The domain is given in radians, as longitude and latitude of the first
+ * and the one past last pixel corner.
+*/
+typedef struct dem_heightmap
+{
+	float const* pixels;
+	uint8_t const* mask;
+	uint64_t width;
+	uint64_t height;
+	double domain_min[2];
+	double domain_max[2];
+	double R_e;
+	double R_p;
+} dem_heightmap;
+
+typedef struct dem_region dem_region;
+
+/*
+ * A table of float32 values, stored row by row
+*/
+typedef struct dem_samples dem_samples;
+
+uint32_t dem_capi_version(void);
+
+char const* dem_last_error(void);
+
+/*
+ * Loads tif_name, which may also be a mosaic, and optionally a mask, as float32
+*/
+int dem_load_region(char const* tif_name, char const* mask_name, dem_region** region);
+
+void dem_free_region(dem_region* region);
+
+/*
+ * Describes the buffers of region, without copying them
+*/
+void dem_get_heightmap(dem_region const* region, dem_heightmap* heightmap);
+
+uint64_t dem_elev_hist_bucket_count(void);
+
+float dem_elev_hist_bucket_size(void);
+
+/*
+ * Adds the area of the pixels in rows [row_begin, row_end) to histogram, which has
+ * dem_elev_hist_bucket_count elements. Pixels at or above
+ * dem_elev_hist_bucket_count*dem_elev_hist_bucket_size are not counted.
+*/
+int dem_elev_hist(dem_heightmap const* heightmap, uint64_t row_begin, uint64_t row_end, double* histogram);
+
+uint64_t dem_slope_direction_count(void);
+
+/*
+ * Adds the projected areas of the pixels in rows [row_begin, row_end) to sums, which holds
+ * dem_slope_direction_count pairs of the area projected along the surface normal and along its
+ * horizontal component
+*/
+int dem_slope_directions(dem_heightmap const* heightmap, uint64_t row_begin, uint64_t row_end, double* sums);
+
+/*
+ * Collects (elevation, gradient) pairs of the pixels in rows [row_begin, row_end), ordered by
+ * elevation bucket, into a two-column table
+*/
+int dem_gradients(dem_heightmap const* heightmap, uint64_t row_begin, uint64_t row_end, dem_samples** samples);
+
+/*
+ * Marches from origin along direction, both in pixels, and stores the cross sections inside the
+ * mask into a three-column table of (cross section index, distance, elevation)
+*/
+int dem_cross_section(dem_heightmap const* heightmap, double const origin[2], double const direction[2],
+	dem_samples** samples);
+
+float const* dem_samples_data(dem_samples const* samples);
+
+uint64_t dem_samples_rows(dem_samples const* samples);
+
+uint64_t dem_samples_columns(dem_samples const* samples);
+
+void dem_free_samples(dem_samples* samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
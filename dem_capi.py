@@ -0,0 +1,124 @@
+#!/usr/bin/python3
+
+# ctypes bindings for libdem_capi.so. Pixels, masks and sample tables are returned as numpy
+# arrays that use the memory of the library directly, so they are only valid as long as the
+# object they are taken from.
+
+import ctypes
+import numpy
+import os.path
+
+class Heightmap(ctypes.Structure):
+	_fields_ = [('pixels', ctypes.POINTER(ctypes.c_float)),
+		('mask', ctypes.POINTER(ctypes.c_uint8)),
+		('width', ctypes.c_uint64),
+		('height', ctypes.c_uint64),
+		('domain_min', ctypes.c_double*2),
+		('domain_max', ctypes.c_double*2),
+		('R_e', ctypes.c_double),
+		('R_p', ctypes.c_double)]
+
+	@staticmethod
+	def from_arrays(pixels, mask, domain_min, domain_max, R_e, R_p):
+		"""Describes numpy arrays without copying them. pixels must be a C-contiguous float32
+		array, and mask a C-contiguous uint8 array of the same shape, or None."""
+		if pixels.dtype != numpy.float32 or not pixels.flags['C_CONTIGUOUS']:
+			raise ValueError('pixels must be a C-contiguous float32 array')
+		if mask is not None and (mask.dtype != numpy.uint8 or mask.shape != pixels.shape or not mask.flags['C_CONTIGUOUS']):
+			raise ValueError('mask must be a C-contiguous uint8 array with the same shape as pixels')
+		ret = Heightmap(pixels.ctypes.data_as(ctypes.POINTER(ctypes.c_float)),
+			None if mask is None else mask.ctypes.data_as(ctypes.POINTER(ctypes.c_uint8)),
+			pixels.shape[1],
+			pixels.shape[0],
+			(ctypes.c_double*2)(*domain_min),
+			(ctypes.c_double*2)(*domain_max),
+			R_e,
+			R_p)
+		# Keep the arrays alive as long as the heightmap
+		ret._arrays = (pixels, mask)
+		return ret
+
+lib = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)), '__targets', 'libdem_capi.so'))
+
+lib.dem_capi_version.restype = ctypes.c_uint32
+lib.dem_last_error.restype = ctypes.c_char_p
+lib.dem_load_region.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.POINTER(ctypes.c_void_p)]
+lib.dem_free_region.argtypes = [ctypes.c_void_p]
+lib.dem_get_heightmap.argtypes = [ctypes.c_void_p, ctypes.POINTER(Heightmap)]
+lib.dem_elev_hist_bucket_count.restype = ctypes.c_uint64
+lib.dem_elev_hist_bucket_size.restype = ctypes.c_float
+lib.dem_elev_hist.argtypes = [ctypes.POINTER(Heightmap), ctypes.c_uint64, ctypes.c_uint64, ctypes.POINTER(ctypes.c_double)]
+lib.dem_slope_direction_count.restype = ctypes.c_uint64
+lib.dem_slope_directions.argtypes = [ctypes.POINTER(Heightmap), ctypes.c_uint64, ctypes.c_uint64, ctypes.POINTER(ctypes.c_double)]
+lib.dem_gradients.argtypes = [ctypes.POINTER(Heightmap), ctypes.c_uint64, ctypes.c_uint64, ctypes.POINTER(ctypes.c_void_p)]
+lib.dem_cross_section.argtypes = [ctypes.POINTER(Heightmap), ctypes.c_double*2, ctypes.c_double*2, ctypes.POINTER(ctypes.c_void_p)]
+lib.dem_samples_data.restype = ctypes.POINTER(ctypes.c_float)
+lib.dem_samples_data.argtypes = [ctypes.c_void_p]
+lib.dem_samples_rows.restype = ctypes.c_uint64
+lib.dem_samples_rows.argtypes = [ctypes.c_void_p]
+lib.dem_samples_columns.restype = ctypes.c_uint64
+lib.dem_samples_columns.argtypes = [ctypes.c_void_p]
+lib.dem_free_samples.argtypes = [ctypes.c_void_p]
+
+if lib.dem_capi_version() != 1:
+	raise RuntimeError('Unsupported version of libdem_capi.so')
+
+def check(status):
+	if status != 0:
+		raise RuntimeError(lib.dem_last_error().decode())
+
+class Samples:
+	"""A table owned by the library. values is a numpy view of it."""
+	def __init__(self, handle):
+		self.handle = handle
+		rows = lib.dem_samples_rows(handle)
+		columns = lib.dem_samples_columns(handle)
+		if rows == 0:
+			self.values = numpy.zeros((0, columns), dtype=numpy.float32)
+		else:
+			self.values = numpy.ctypeslib.as_array(lib.dem_samples_data(handle), shape=(rows, columns))
+
+	def __del__(self):
+		lib.dem_free_samples(self.handle)
+
+class Region:
+	"""A region loaded by the library. pixels and mask are numpy views of its buffers."""
+	def __init__(self, tif_name, mask_name = None):
+		self.handle = ctypes.c_void_p()
+		check(lib.dem_load_region(tif_name.encode(),
+			None if mask_name is None else mask_name.encode(),
+			ctypes.byref(self.handle)))
+		self.heightmap = Heightmap()
+		lib.dem_get_heightmap(self.handle, ctypes.byref(self.heightmap))
+		shape = (self.heightmap.height, self.heightmap.width)
+		self.pixels = numpy.ctypeslib.as_array(self.heightmap.pixels, shape=shape)
+		self.mask = None if not self.heightmap.mask else numpy.ctypeslib.as_array(self.heightmap.mask, shape=shape)
+
+	def __del__(self):
+		lib.dem_free_region(self.handle)
+
+def get_rows(heightmap, rows):
+	return (0, heightmap.height) if rows is None else rows
+
+def elev_hist(heightmap, rows = None):
+	ret = numpy.zeros(lib.dem_elev_hist_bucket_count(), dtype=numpy.float64)
+	check(lib.dem_elev_hist(ctypes.byref(heightmap), *get_rows(heightmap, rows),
+		ret.ctypes.data_as(ctypes.POINTER(ctypes.c_double))))
+	return ret
+
+def slope_directions(heightmap, rows = None):
+	ret = numpy.zeros((lib.dem_slope_direction_count(), 2), dtype=numpy.float64)
+	check(lib.dem_slope_directions(ctypes.byref(heightmap), *get_rows(heightmap, rows),
+		ret.ctypes.data_as(ctypes.POINTER(ctypes.c_double))))
+	return ret
+
+def gradients(heightmap, rows = None):
+	handle = ctypes.c_void_p()
+	check(lib.dem_gradients(ctypes.byref(heightmap), *get_rows(heightmap, rows), ctypes.byref(handle)))
+	return Samples(handle)
+
+def cross_section(heightmap, origin, direction):
+	handle = ctypes.c_void_p()
+	check(lib.dem_cross_section(ctypes.byref(heightmap), (ctypes.c_double*2)(*origin),
+		(ctypes.c_double*2)(*direction), ctypes.byref(handle)))
+	return Samples(handle)
@@ -0,0 +1,139 @@
+//@{"target":{"name":"dem_capi.test"}}
+
+#include "./dem_capi.hpp"
+
+#include <cmath>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+    constexpr uint64_t width = 40;
+    constexpr uint64_t height = 30;
+
+    bool close(double a, double b)
+    { return std::abs(a - b) <= 1.0e-9*std::max({std::abs(a), std::abs(b), 1.0}); }
+
+    dem_heightmap make_heightmap(std::vector<float> const& pixels, std::vector<uint8_t> const* mask)
+    {
+        return dem_heightmap{std::data(pixels), mask == nullptr ? nullptr : std::data(*mask), width, height,
+            {0.17, 0.87}, {0.18, 0.86}, 6378137.0, 6356752.0};
+    }
+
+    bool last_error_is(std::string_view expected)
+    { return std::string_view{dem_last_error()} == expected; }
+}
+
+int main()
+{
+    assert(dem_capi_version() == DEM_CAPI_VERSION);
+
+    // A slope that rises along x, and stays within a few buckets of the histogram
+    std::vector<float> pixels(width*height);
+    for(uint64_t y = 0; y != height; ++y)
+    {
+        for(uint64_t x = 0; x != width; ++x)
+        { pixels[y*width + x] = 500.0f + 4.0f*static_cast<float>(x); }
+    }
+    std::vector<uint8_t> mask(width*height, 0);
+    std::fill(std::begin(mask), std::begin(mask) + width*height/2, 1);
+
+    auto const heightmap = make_heightmap(pixels, nullptr);
+    auto const masked = make_heightmap(pixels, &mask);
+
+    // Results are added to the caller's histogram, so rows can be processed in parts
+    {
+        auto const n = dem_elev_hist_bucket_count();
+        assert(dem_elev_hist_bucket_size() > 0.0f);
+        std::vector<double> whole(n, 1.0);
+        assert(dem_elev_hist(&heightmap, 0, height, std::data(whole)) == 0);
+
+        std::vector<double> parts(n, 1.0);
+        assert(dem_elev_hist(&heightmap, 0, 11, std::data(parts)) == 0);
+        assert(dem_elev_hist(&heightmap, 11, height, std::data(parts)) == 0);
+        assert(std::ranges::equal(whole, parts, close));
+
+        auto const first = static_cast<size_t>(500.0f/dem_elev_hist_bucket_size());
+        auto const last = static_cast<size_t>((500.0f + 4.0f*(width - 1))/dem_elev_hist_bucket_size());
+        for(size_t k = 0; k != n; ++k)
+        { assert((whole[k] > 1.0) == (k >= first && k <= last)); }
+
+        // Half of the rows are inside the mask, and all rows have the same area up to latitude
+        std::vector<double> inside(n, 0.0);
+        assert(dem_elev_hist(&masked, 0, height, std::data(inside)) == 0);
+        auto const total = std::accumulate(std::begin(whole), std::end(whole), 0.0) - static_cast<double>(n);
+        auto const total_inside = std::accumulate(std::begin(inside), std::end(inside), 0.0);
+        assert(total_inside > 0.45*total && total_inside < 0.55*total);
+    }
+
+    {
+        auto const n = dem_slope_direction_count();
+        std::vector<double> whole(2*n, 0.0);
+        assert(dem_slope_directions(&heightmap, 0, height, std::data(whole)) == 0);
+        std::vector<double> parts(2*n, 0.0);
+        assert(dem_slope_directions(&heightmap, 0, 17, std::data(parts)) == 0);
+        assert(dem_slope_directions(&heightmap, 17, height, std::data(parts)) == 0);
+        assert(std::ranges::equal(whole, parts, [](double a, double b){
+            return std::abs(a - b) <= 1.0e-6*std::max({std::abs(a), std::abs(b), 1.0});
+        }));
+        assert(std::ranges::any_of(whole, [](double val){ return val > 0.0; }));
+    }
+
+    // Samples are owned by the returned object
+    {
+        dem_samples* samples = nullptr;
+        assert(dem_gradients(&heightmap, 0, height, &samples) == 0);
+        assert(samples != nullptr);
+        assert(dem_samples_columns(samples) == 2);
+        // Only pixels with four neighbours have a gradient
+        assert(dem_samples_rows(samples) == (width - 2)*(height - 2));
+        auto const data = dem_samples_data(samples);
+        for(uint64_t k = 0; k != dem_samples_rows(samples); ++k)
+        {
+            assert(data[2*k] >= 500.0f && data[2*k] <= 500.0f + 4.0f*width);
+            assert(data[2*k + 1] > 0.0f);
+        }
+        dem_free_samples(samples);
+    }
+
+    {
+        dem_samples* samples = nullptr;
+        double const origin[2]{1.5, 15.5};
+        double const direction[2]{1.0, 0.0};
+        assert(dem_cross_section(&heightmap, origin, direction, &samples) == 0);
+        assert(dem_samples_columns(samples) == 3);
+        assert(dem_samples_rows(samples) != 0);
+        auto const data = dem_samples_data(samples);
+        assert(data[0] == 0.0f);
+        dem_free_samples(samples);
+    }
+
+    // Exceptions are turned into -1, and the message is kept for the calling thread
+    {
+        std::vector<double> histogram(dem_elev_hist_bucket_count(), 0.0);
+        assert(dem_elev_hist(nullptr, 0, height, std::data(histogram)) == -1);
+        assert(last_error_is("No pixels given"));
+
+        auto too_small = heightmap;
+        too_small.width = 2;
+        assert(dem_elev_hist(&too_small, 0, height, std::data(histogram)) == -1);
+        assert(last_error_is("Too small heightmap"));
+        assert(std::ranges::all_of(histogram, [](double val){ return val == 0.0; }));
+
+        assert(dem_gradients(&heightmap, 0, height, nullptr) == -1);
+        assert(last_error_is("No output given"));
+
+        dem_region* region = nullptr;
+        assert(dem_load_region(nullptr, nullptr, &region) == -1);
+        assert(last_error_is("No input or output given"));
+        assert(region == nullptr);
+
+        assert(dem_load_region("/nonexistent/dem_capi_test.tif", nullptr, &region) == -1);
+        assert(std::string_view{dem_last_error()} != "");
+        assert(region == nullptr);
+    }
+}
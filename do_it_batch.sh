@@ -0,0 +1,11 @@
+#!/usr/bin/bash
+set -e
+maike2
+dir=$(mktemp -d)
+items=('ural_north' 'ural_south' 'scandinavian_north' 'scandinavian_south' 'alps' 'karakoram' 'himalaya_west' 'himalaya_central' 'himalaya_east')
+
+for item in "${items[@]}"; do
+	echo "$item ../data/$item.tif ../data/${item}_mask.data elev_hist,grad_at_points,slopedir,peak_valley_elev,prominence" >> $dir/jobs.txt
+done
+
+__targets/batch_analyze --output_dir=../data --progress=stderr $dir/jobs.txt
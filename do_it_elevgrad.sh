@@ -2,6 +2,7 @@
 set -e
 maike2
 dir=$(mktemp -d)
+mkdir -p ../data/result_cache
 : > ../data/elevgrad.log
 items=('ural_north' 'ural_south' 'scandinavian_north' 'scandinavian_south' 'alps' 'karakoram' 'himalaya_west' 'himalaya_central' 'himalaya_east')
 file_pairs=()
@@ -10,7 +11,7 @@ for item in "${items[@]}"; do
 	echo Processing $item >> ../data/elevgrad.log
 	file_pair=../data/$item.tif','../data/${item}_mask.data
 	file_pairs+=($file_pair)
-	__targets/grad_at_points $file_pair > ../data/${item}_elevgrad.txt
+	__targets/grad_at_points --cache_dir=../data/result_cache $file_pair > ../data/${item}_elevgrad.txt
 	./plot_grad_data.py ../data/${item}_elevgrad.txt $dir/slask.pdf >> ../data/elevgrad.log
 	pdf2ps $dir/slask.pdf $dir/slask.ps
 	ps2pdf $dir/slask.ps ../data/${item}_elevgrad.pdf
@@ -18,7 +19,7 @@ for item in "${items[@]}"; do
 done
 
 echo "Processing all" >> ../data/elevgrad.log
-__targets/grad_at_points "${file_pairs[@]}" > ../data/all_elevgrad.txt
+__targets/grad_at_points --cache_dir=../data/result_cache "${file_pairs[@]}" > ../data/all_elevgrad.txt
 ./plot_grad_data.py ../data/all_elevgrad.txt $dir/slask.pdf >> ../data/elevgrad.log
 pdf2ps $dir/slask.pdf $dir/slask.ps
 ps2pdf $dir/slask.ps ../data/all_elevgrad.pdf
@@ -2,6 +2,7 @@
 set -e
 maike2
 dir=$(mktemp -d)
+mkdir -p ../data/result_cache
 : > ../data/elevhist.log
 items=('ural_north' 'ural_south' 'scandinavian_north' 'scandinavian_south' 'alps' 'karakoram' 'himalaya_west' 'himalaya_central' 'himalaya_east')
 outputs=()
@@ -10,7 +11,7 @@ for item in "${items[@]}"; do
 	echo Processing $item >> ../data/elevhist.log
 	file_pair=../data/$item.tif','../data/${item}_mask.data
 	outputs+=(../data/${item}_elevhist.txt)
-	__targets/elev_hist $file_pair > ../data/${item}_elevhist.txt
+	__targets/elev_hist --cache_dir=../data/result_cache $file_pair > ../data/${item}_elevhist.txt
 	echo "" >> ../data/elevhist.log
 done
 
@@ -11,7 +11,7 @@ for item in "${items[@]}"; do
 	echo Processing $item >> ../data/peak_valley_elev.log
 	file_pair=../data/$item.tif','../data/${item}_mask.data
 	file_pairs+=($file_pair)
-	__targets/peak_valley_elev $file_pair > ../data/${item}_peak_valley_elev.txt
+	__targets/peak_valley_elev --progress=stderr $file_pair > ../data/${item}_peak_valley_elev.txt
 	./plot_peak_valley_elev.py ../data/${item}_peak_valley_elev.txt $dir/slask.pdf >> ../data/peak_valley_elev.log
 	pdf2ps $dir/slask.pdf $dir/slask.ps
 	ps2pdf $dir/slask.ps ../data/${item}_peak_valley_elev.pdf
@@ -20,7 +20,7 @@ done
 
 echo "Processing all"
 echo "Processing all" >> ../data/elevgrad.log
-__targets/peak_valley_elev "${file_pairs[@]}" > ../data/all_peak_valley_elev.txt
+__targets/peak_valley_elev --progress=stderr "${file_pairs[@]}" > ../data/all_peak_valley_elev.txt
 ./plot_peak_valley_elev.py ../data/all_peak_valley_elev.txt $dir/slask.pdf >> ../data/peak_valley_elev.log
 pdf2ps $dir/slask.pdf $dir/slask.ps
 ps2pdf $dir/slask.ps ../data/all_peak_valley_elev.pdf
@@ -0,0 +1,27 @@
+#!/usr/bin/bash
+set -e
+maike2
+dir=$(mktemp -d)
+: > ../data/prominence.log
+items=('ural_north' 'ural_south' 'scandinavian_north' 'scandinavian_south' 'alps' 'karakoram' 'himalaya_west' 'himalaya_central' 'himalaya_east')
+file_pairs=()
+
+for item in "${items[@]}"; do
+	echo Processing $item
+	echo Processing $item >> ../data/prominence.log
+	file_pair=../data/$item.tif','../data/${item}_mask.data
+	file_pairs+=($file_pair)
+	__targets/prominence $file_pair > ../data/${item}_prominence.txt
+	./plot_peak_valley_elev.py ../data/${item}_prominence.txt $dir/slask.pdf >> ../data/prominence.log
+	pdf2ps $dir/slask.pdf $dir/slask.ps
+	ps2pdf $dir/slask.ps ../data/${item}_prominence.pdf
+	echo "" >> ../data/prominence.log
+done
+
+echo "Processing all"
+echo "Processing all" >> ../data/prominence.log
+__targets/prominence "${file_pairs[@]}" > ../data/all_prominence.txt
+./plot_peak_valley_elev.py ../data/all_prominence.txt $dir/slask.pdf >> ../data/prominence.log
+pdf2ps $dir/slask.pdf $dir/slask.ps
+ps2pdf $dir/slask.ps ../data/all_prominence.pdf
+echo "" >> ../data/prominence.log
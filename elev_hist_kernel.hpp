@@ -0,0 +1,276 @@
+#ifndef ELEV_HIST_KERNEL_HPP
+#define ELEV_HIST_KERNEL_HPP
+
+#include "./types.hpp"
+#include "./pixel_sampling.hpp"
+#include "./cmdline.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+
+/**
+ * The default bins of elev_hist, which local_relief also uses
+*/
+constexpr auto elev_hist_bucket_size = 32.0f;
+constexpr size_t elev_hist_bucket_count = 8900/elev_hist_bucket_size;
+
+/**
+ * Holds the area of each bin of a histogram_bins, or nothing if no pixel has been visited yet
+*/
+using elev_histogram = std::vector<double>;
+
+enum class bin_scale:int{linear, log2};
+
+template<bin_scale Scale>
+using bin_scale_tag = std::integral_constant<bin_scale, Scale>;
+
+/**
+ * Splits [min, max) into count() bins. With linear scale, bins are step metres wide, and with
+ * log2 scale, there are step bins per octave, like the 12*log2 buckets of peak_valley_elev. The
+ * last bin ends at max. Bin 0 takes all values below min, and bin count() + 1 all values at or
+ * above max, so every value has a bin.
+*/
+class histogram_bins
+{
+public:
+	static constexpr size_t max_count = size_t{1} << 16;
+
+	histogram_bins():
+		histogram_bins{bin_scale::linear, 0.0f, elev_hist_bucket_size*elev_hist_bucket_count, elev_hist_bucket_size}
+	{}
+
+	explicit histogram_bins(bin_scale scale, float min, float max, float step):
+		m_scale{scale},
+		m_min{min},
+		m_max{max},
+		m_step{step}
+	{
+		if(!(step > 0.0f) || !(max > min) || !std::isfinite(max) || !std::isfinite(min)
+			|| (scale == bin_scale::log2 && !(min > 0.0f)))
+		{ throw std::runtime_error{"Histogram bins must have min < max, a positive step, and min > 0 for log2 scale"}; }
+
+		m_origin = transform(min);
+		m_width = scale == bin_scale::log2 ? 1.0f/step : step;
+		m_bins_per_unit = scale == bin_scale::log2 ? step : 1.0f/step;
+		auto const count = std::ceil((static_cast<double>(transform(max)) - m_origin)
+			*(scale == bin_scale::log2 ? static_cast<double>(step) : 1.0/step));
+		if(!(count <= static_cast<double>(max_count)))
+		{ throw std::runtime_error{"Too many histogram bins"}; }
+		m_count = static_cast<size_t>(count);
+	}
+
+	/**
+	 * Parses <scale>:<min>:<max>:<step>, where scale is linear or log2
+	*/
+	explicit histogram_bins(std::string const& str):histogram_bins{parse(str)}
+	{}
+
+	bin_scale scale() const
+	{ return m_scale; }
+
+	float min() const
+	{ return m_min; }
+
+	float max() const
+	{ return m_max; }
+
+	float step() const
+	{ return m_step; }
+
+	/**
+	 * The number of bins between min and max
+	*/
+	size_t count() const
+	{ return m_count; }
+
+	/**
+	 * The number of bins, including the underflow and overflow bins
+	*/
+	size_t size() const
+	{ return m_count + 2; }
+
+	/**
+	 * Returns the lower edge of bin k + 1, for k in [0, count()]. Edge count() is max.
+	*/
+	float edge(size_t k) const
+	{ return k >= m_count ? m_max : inverse_transform(m_origin + static_cast<float>(k)*m_width); }
+
+	/**
+	 * Returns the centre of bin k + 1, which for log2 scale is the geometric mean of its edges
+	*/
+	float centre(size_t k) const
+	{
+		return m_scale == bin_scale::log2 ? std::sqrt(edge(k)*edge(k + 1))
+			: 0.5f*(edge(k) + edge(k + 1));
+	}
+
+	/**
+	 * Returns the bin of z, without branches, so that it can be vectorized. Values that do not
+	 * compare, such as NaN, end up in the underflow bin.
+	*/
+	template<bin_scale Scale>
+	size_t index(float z, bin_scale_tag<Scale>) const
+	{
+		auto const t = Scale == bin_scale::log2 ? std::log2(std::max(std::numeric_limits<float>::min(), z)) : z;
+		auto const pos = std::min(static_cast<float>(m_count), std::max(0.0f, (t - m_origin)*m_bins_per_unit + 1.0f));
+		return static_cast<size_t>(pos) + static_cast<size_t>(z >= m_max);
+	}
+
+	size_t index(float z) const
+	{
+		return m_scale == bin_scale::log2 ? index(z, bin_scale_tag<bin_scale::log2>{})
+			: index(z, bin_scale_tag<bin_scale::linear>{});
+	}
+
+	/**
+	 * Calls f with the bin_scale_tag of the scale, so that loops over pixels can be compiled
+	 * for each scale, without a branch per pixel
+	*/
+	template<class Func>
+	decltype(auto) visit_scale(Func&& f) const
+	{
+		return m_scale == bin_scale::log2 ? f(bin_scale_tag<bin_scale::log2>{})
+			: f(bin_scale_tag<bin_scale::linear>{});
+	}
+
+private:
+	static histogram_bins parse(std::string const& str)
+	{
+		std::array<std::string, 4> fields;
+		size_t field = 0;
+		for(auto ch : str)
+		{
+			if(ch != ':')
+			{ fields[field].push_back(ch); }
+			else if(++field == std::size(fields))
+			{ break; }
+		}
+		if(field != std::size(fields) - 1)
+		{ throw std::runtime_error{std::string{"Histogram bins must be given as <scale>:<min>:<max>:<step>, got "}.append(str)}; }
+
+		if(fields[0] != "linear" && fields[0] != "log2")
+		{ throw std::runtime_error{std::string{"Unsupported bin scale "}.append(fields[0])}; }
+
+		return histogram_bins{fields[0] == "log2" ? bin_scale::log2 : bin_scale::linear,
+			value<float>{fields[1]}.get(), value<float>{fields[2]}.get(), value<float>{fields[3]}.get()};
+	}
+
+	float transform(float z) const
+	{ return m_scale == bin_scale::log2 ? std::log2(z) : z; }
+
+	float inverse_transform(float t) const
+	{ return m_scale == bin_scale::log2 ? std::exp2(t) : t; }
+
+	bin_scale m_scale;
+	float m_min;
+	float m_max;
+	float m_step;
+	float m_origin;
+	float m_width;
+	float m_bins_per_unit;
+	size_t m_count;
+};
+
+/**
+ * Returns the area of a pixel in row y. Since the domain is a rectangle in longitude and
+ * latitude, the area does not depend on the column.
+*/
+template<class Pixel>
+double get_pixel_area(basic_heightmap_region<Pixel> const& region, vec4_t longlat_delta, size_t y)
+{
+	auto const loc_long_lat = pixel_to_geo_coords(vec2u_t{0, y}, region.size, region.domain);
+	auto const scale_factors = nabla_factors(region.R_e, region.R_p, loc_long_lat)*longlat_delta;
+	return static_cast<double>(scale_factors[0]*scale_factors[1]);
+}
+
+/**
+ * The number of private sub-histograms that a row of pixels is spread over. Neighbouring pixels
+ * often fall into the same bin, and giving them different copies of it avoids a chain of
+ * dependent additions.
+*/
+constexpr size_t elev_hist_lane_count = 4;
+
+/**
+ * Adds the area of all pixels in rows [row_begin, row_end), and in columns, to the bin of their
+ * elevation. histogram must be empty, or have bins.size() elements. If sample is not complete,
+ * only the pixels it picks are visited, and their areas are weighted by sample.weight().
+ *
+ * With a complete sample, the bins and weights of each row are first computed without branches,
+ * and then added to elev_hist_lane_count interleaved sub-histograms, which are summed at the end.
+*/
+template<class Pixel>
+void accumulate_elev_hist(basic_heightmap_region<Pixel> const& region,
+	size_t row_begin,
+	size_t row_end,
+	histogram_bins const& bins,
+	elev_histogram& histogram,
+	column_range columns = column_range{},
+	pixel_sample const& sample = pixel_sample{})
+{
+	if(histogram.empty())
+	{ histogram.resize(bins.size()); }
+
+	auto const longlat_delta = pixel_to_geo_coords(vec2u_t{1, 0}, region.size, region.domain)
+		- pixel_to_geo_coords(vec2u_t{0, 1}, region.size, region.domain);
+
+	auto const w = static_cast<size_t>(region.size.sizes[0]);
+	auto const h = static_cast<size_t>(region.size.sizes[1]);
+	row_range const rows{row_begin, std::min(row_end, h)};
+	column_range const cols{std::max(columns.begin, size_t{1}), std::min(columns.end, w)};
+	auto const has_mask = region.mask.data() != nullptr;
+
+	if(!sample.is_complete())
+	{
+		auto const weight = sample.weight();
+		for_each_sampled_pixel(sample, rows, cols, [&region, &bins, &histogram, longlat_delta, weight, has_mask](vec2u_t loc){
+			if(!has_mask || region.mask(loc) != 0)
+			{
+				auto const val = to_float(region.pixels(loc));
+				if(val > 1.0f)
+				{ histogram[bins.index(val)] += weight*get_pixel_area(region, longlat_delta, loc[1]); }
+			}
+		});
+		return;
+	}
+
+	if(rows.begin >= rows.end || cols.begin >= cols.end)
+	{ return; }
+
+	constexpr auto lane_count = elev_hist_lane_count;
+	std::vector<double> lanes(lane_count*bins.size());
+	std::vector<uint32_t> offsets(cols.end - cols.begin);
+	std::vector<float> weights(cols.end - cols.begin);
+	bins.visit_scale([&](auto scale){
+		for(auto y = rows.begin; y != rows.end; ++y)
+		{
+			for(auto x = cols.begin; x != cols.end; ++x)
+			{
+				auto const k = x - cols.begin;
+				auto const val = to_float(region.pixels(x, y));
+				auto const valid = (!has_mask || region.mask(x, y) != 0) & (val > 1.0f);
+				offsets[k] = static_cast<uint32_t>(bins.index(valid ? val : bins.min(), scale)*lane_count + k%lane_count);
+				weights[k] = static_cast<float>(valid);
+			}
+
+			auto const area = get_pixel_area(region, longlat_delta, y);
+			for(size_t k = 0; k != std::size(offsets); ++k)
+			{ lanes[offsets[k]] += area*weights[k]; }
+		}
+	});
+
+	for(size_t bin = 0; bin != bins.size(); ++bin)
+	{
+		auto const lane = std::begin(lanes) + bin*lane_count;
+		histogram[bin] += std::accumulate(lane, lane + lane_count, 0.0);
+	}
+}
+
+#endif
@@ -0,0 +1,123 @@
+//@{"target":{"name":"elev_hist_kernel.test"}}
+
+#include "./elev_hist_kernel.hpp"
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+    bool close(double a, double b)
+    { return std::abs(a - b) <= 1.0e-5*std::max({std::abs(a), std::abs(b), 1.0}); }
+}
+
+int main()
+{
+    {
+        histogram_bins const bins{};
+        assert(bins.count() == elev_hist_bucket_count);
+        assert(bins.size() == elev_hist_bucket_count + 2);
+        assert(bins.index(-5.0f) == 0);
+        assert(bins.index(0.0f) == 1);
+        assert(bins.index(31.9f) == 1);
+        assert(bins.index(32.0f) == 2);
+        assert(bins.index(bins.max() - 1.0f) == bins.count());
+        assert(bins.index(bins.max()) == bins.count() + 1);
+        assert(bins.index(1.0e30f) == bins.count() + 1);
+        assert(bins.index(std::numeric_limits<float>::infinity()) == bins.count() + 1);
+        assert(bins.edge(3) == 96.0f);
+        assert(bins.centre(3) == 112.0f);
+    }
+
+    {
+        // The last bin is cut at max
+        histogram_bins const bins{"linear:100:500:150"};
+        assert(bins.count() == 3);
+        assert(bins.edge(2) == 400.0f && bins.edge(3) == 500.0f);
+        assert(bins.index(99.0f) == 0);
+        assert(bins.index(450.0f) == 3);
+        assert(bins.index(500.0f) == 4);
+    }
+
+    {
+        histogram_bins const bins{"log2:1:8192:12"};
+        assert(bins.scale() == bin_scale::log2);
+        assert(bins.count() == 13*12);
+        assert(bins.index(0.5f) == 0);
+        assert(bins.index(-1.0f) == 0);
+        assert(bins.index(1.0f) == 1);
+        assert(bins.index(2.01f) == 13);
+        assert(bins.index(8192.0f) == bins.count() + 1);
+        assert(close(bins.edge(12), 2.0));
+        assert(close(bins.centre(0), std::exp2(1.0/24.0)));
+    }
+
+    for(auto str : {"linear:0:100", "linear:5:5:1", "linear:0:100:0", "log2:0:100:12", "cubic:0:100:1", "linear:0:1e9:0.001",
+        "linear:0:8896:32m", "linear:x:100:1"})
+    {
+        try
+        {
+            histogram_bins const bins{std::string{str}};
+            assert(false);
+        }
+        catch(std::runtime_error const&)
+        {}
+    }
+
+    {
+        // Compare with binning each pixel directly, over two tiles, with values outside the bins
+        std::mt19937 rng;
+        image_size const size{vec2u_t{67, 29}};
+        auto const w = static_cast<size_t>(size.sizes[0]);
+        auto const h = static_cast<size_t>(size.sizes[1]);
+        std::uniform_real_distribution<float> U{-200.0f, 12000.0f};
+        std::vector<float> pixels(w*h);
+        std::ranges::generate(pixels, [&rng, &U](){ return U(rng); });
+        pixels[3*w + 5] = std::numeric_limits<float>::infinity();
+        std::vector<uint8_t> mask(w*h);
+        std::ranges::generate(mask, [&rng](){ return static_cast<uint8_t>(rng()%4 != 0); });
+
+        heightmap_region const region{
+            raster_view<float const>{std::data(pixels), size},
+            raster_view<uint8_t const>{std::data(mask), size},
+            size,
+            corners_in_geo_coords{vec4_t{0.1f, 0.8f, 0.0f, 0.0f}, vec4_t{0.101f, 0.799f, 0.0f, 0.0f}},
+            6378137.0f,
+            6356752.0f
+        };
+
+        auto const longlat_delta = pixel_to_geo_coords(vec2u_t{1, 0}, region.size, region.domain)
+            - pixel_to_geo_coords(vec2u_t{0, 1}, region.size, region.domain);
+        for(auto const& bins : {histogram_bins{}, histogram_bins{"log2:10:4096:3"}})
+        {
+            elev_histogram result{};
+            accumulate_elev_hist(region, 0, h, bins, result, column_range{0, 40});
+            accumulate_elev_hist(region, 0, h, bins, result, column_range{40, w});
+            assert(std::size(result) == bins.size());
+
+            elev_histogram expected(bins.size());
+            for(size_t y = 0; y != h; ++y)
+            {
+                for(size_t x = 1; x != w; ++x)
+                {
+                    auto const val = pixels[y*w + x];
+                    if(mask[y*w + x] == 0 || !(val > 1.0f))
+                    { continue; }
+
+                    auto const loc_long_lat = pixel_to_geo_coords(vec2u_t{x, y}, region.size, region.domain);
+                    auto const scale_factors = nabla_factors(region.R_e, region.R_p, loc_long_lat)*longlat_delta;
+                    expected[bins.index(val)] += static_cast<double>(scale_factors[0]*scale_factors[1]);
+                }
+            }
+
+            assert(expected.front() != 0.0 || bins.scale() == bin_scale::linear);
+            assert(expected.back() != 0.0);
+            for(size_t k = 0; k != std::size(result); ++k)
+            { assert(close(result[k], expected[k])); }
+        }
+    }
+}
@@ -2,40 +2,145 @@
 
 #include "./geotiff_loader.hpp"
 #include "./file.hpp"
+#include "./cmdline.hpp"
 
 #include <OpenEXR/ImfIO.h>
 #include <OpenEXR/ImfOutputFile.h>
+#include <OpenEXR/ImfTiledOutputFile.h>
 #include <OpenEXR/ImfChannelList.h>
+#include <OpenEXR/ImfThreading.h>
+#include <OpenEXR/ImfVecAttribute.h>
+#include <OpenEXR/ImfFloatAttribute.h>
+
+#include <array>
+#include <numbers>
+#include <thread>
+#include <algorithm>
+
+struct compression_method
+{
+	compression_method() = default;
+
+	explicit compression_method(std::string const& str)
+	{
+		constexpr std::array<std::pair<char const*, Imf::Compression>, 10> methods{{
+			{"none", Imf::NO_COMPRESSION},
+			{"rle", Imf::RLE_COMPRESSION},
+			{"zips", Imf::ZIPS_COMPRESSION},
+			{"zip", Imf::ZIP_COMPRESSION},
+			{"piz", Imf::PIZ_COMPRESSION},
+			{"pxr24", Imf::PXR24_COMPRESSION},
+			{"b44", Imf::B44_COMPRESSION},
+			{"b44a", Imf::B44A_COMPRESSION},
+			{"dwaa", Imf::DWAA_COMPRESSION},
+			{"dwab", Imf::DWAB_COMPRESSION}
+		}};
+
+		auto const i = std::ranges::find_if(methods, [&str](auto const& item){
+			return str == item.first;
+		});
+		if(i == std::end(methods))
+		{ throw std::runtime_error{std::string{"Unsupported compression method "}.append(str)}; }
+		value = i->second;
+	}
+
+	Imf::Compression value{Imf::ZIP_COMPRESSION};
+};
+
+void add_geo_domain(TIFF* tiff, image_size size, Imf::Header& header)
+{
+	auto gtif = make_gtif(tiff);
+	auto defn = get_defn(gtif.get());
+	auto const domain = get_domain(gtif.get(), *defn, size);
+	auto const to_deg = 180.0f/std::numbers::pi_v<float>;
+
+	header.insert("geoDomainMin", Imf::V2fAttribute{Imath::V2f{to_deg*domain.min[0], to_deg*domain.min[1]}});
+	header.insert("geoDomainMax", Imf::V2fAttribute{Imath::V2f{to_deg*domain.max[0], to_deg*domain.max[1]}});
+	header.insert("geoSemiMajor", Imf::FloatAttribute{static_cast<float>(defn->SemiMajor)});
+	header.insert("geoSemiMinor", Imf::FloatAttribute{static_cast<float>(defn->SemiMinor)});
+}
+
+Imf::FrameBuffer make_band_frame_buffer(float* band, size_t first_row, size_t w)
+{
+	// OpenEXR addresses pixels as base + x*xStride + y*yStride. Offset the base pointer so that
+	// first_row maps to the start of the band.
+	Imf::FrameBuffer fb;
+	fb.insert("Y",
+	          Imf::Slice{Imf::FLOAT,
+	                     reinterpret_cast<char*>(band - first_row*w),
+	                     sizeof(float),
+	                     sizeof(float) * w});
+	return fb;
+}
 
 int main(int argc, char** argv)
 {
-	if(argc != 3)
+	auto const args = parse_analyzer_args(argc, argv);
+	if(std::size(args.inputs) != 2)
 	{
-		fprintf(stderr, "Usage: geotiff2exr input output\n");
+		fprintf(stderr, "Usage: geotiff2exr input output [--compression=zip] [--threads=N] [--tiled=0] "
+			"[--band_height=256] [--geo_domain=0]\n");
 		return 1;
 	}
 
-	auto tiff = make_tiff(argv[1]);
+	auto const& opts = args.options;
+	auto const compression = get_or(opts, "compression", compression_method{}).value;
+	auto const threads = get_or(opts, "threads", value<size_t>{}).get();
+	auto const tiled = get_or(opts, "tiled", value<int>{0}).get() != 0;
+	auto const geo_domain = get_or(opts, "geo_domain", value<int>{0}).get() != 0;
+
+	Imf::setGlobalThreadCount(static_cast<int>(threads != 0 ? threads : std::thread::hardware_concurrency()));
+
+	auto tiff = make_tiff(args.inputs[0]);
 	auto const info = get_image_info(tiff.get());
-	auto pixels = load_floats(tiff.get(), info);
-	auto src_ptr = static_cast<float const*>(pixels.get());
 	auto const w = info.size.sizes[0];
 	auto const h = info.size.sizes[1];
 
 	Imf::Header header{static_cast<int>(w), static_cast<int>(h)};
 	header.channels().insert("Y", Imf::Channel{Imf::FLOAT});
+	header.compression() = compression;
+	if(geo_domain)
+	{ add_geo_domain(tiff.get(), info.size, header); }
 
-	Imf::FrameBuffer fb;
-	fb.insert("Y",
-	          Imf::Slice{Imf::FLOAT,
-	                     (char*)(src_ptr),
-	                     sizeof(float),
-	                     sizeof(float) * w});
+	// Round the band height up to a whole number of input tiles, so no tile is decoded twice
+	auto const tiff_band_height = get_band_height(info.layout);
+	auto const requested_band_height = std::max(get_or(opts, "band_height", value<size_t>{256}).get(), size_t{1});
+	auto const band_height = tiled ?
+		 tiff_band_height
+		:(requested_band_height + tiff_band_height - 1)/tiff_band_height*tiff_band_height;
 
-	Imf::OutputFile dest{argv[2], header};
-	dest.setFrameBuffer(fb);
-	dest.writePixels(h);
+	auto band = std::make_unique<float[]>(w*band_height);
+
+	if(tiled)
+	{
+		auto const tile_size = std::get_if<tile_info>(&info.layout);
+		if(tile_size == nullptr)
+		{ throw std::runtime_error{"Tiled output requires tiled input"}; }
+
+		header.setTileDescription(Imf::TileDescription{static_cast<unsigned int>(tile_size->sizes[0]),
+			static_cast<unsigned int>(tile_size->sizes[1]),
+			Imf::ONE_LEVEL});
+
+		Imf::TiledOutputFile dest{args.inputs[1], header};
+		for(size_t first_row = 0; first_row < h; first_row += band_height)
+		{
+			load_rows(tiff.get(), info, band.get(), first_row, band_height);
+			dest.setFrameBuffer(make_band_frame_buffer(band.get(), first_row, w));
+			auto const tile_row = static_cast<int>(first_row/band_height);
+			dest.writeTiles(0, dest.numXTiles() - 1, tile_row, tile_row);
+		}
+	}
+	else
+	{
+		Imf::OutputFile dest{args.inputs[1], header};
+		for(size_t first_row = 0; first_row < h; first_row += band_height)
+		{
+			auto const row_count = std::min(band_height, h - first_row);
+			load_rows(tiff.get(), info, band.get(), first_row, row_count);
+			dest.setFrameBuffer(make_band_frame_buffer(band.get(), first_row, w));
+			dest.writePixels(static_cast<int>(row_count));
+		}
+	}
 
 	return 0;
 }
-
@@ -2,10 +2,17 @@
 
 #include "./geotiff_loader.hpp"
 
+#include <condition_variable>
+#include <exception>
+#include <mutex>
 #include <numbers>
+#include <thread>
+#include <vector>
+#include <algorithm>
 
 std::unique_ptr<TIFF, tiff_releaser> make_tiff(char const* path)
 {
+	scoped_timer timer{"tiff_open"};
 	std::unique_ptr<TIFF, tiff_releaser> ret{XTIFFOpen(path, "r")};
 	if(ret.get() == nullptr)
 	{
@@ -16,8 +23,10 @@ std::unique_ptr<TIFF, tiff_releaser> make_tiff(char const* path)
 
 image_size get_image_size(TIFF* handle)
 {
-	int width{};
-	int height{};
+	// libtiff stores both dimensions as uint32, also in BigTIFF files, so the pixel count may
+	// exceed 32 bits
+	uint32_t width{};
+	uint32_t height{};
 	TIFFGetField(handle, TIFFTAG_IMAGEWIDTH, &width );
 	TIFFGetField(handle, TIFFTAG_IMAGELENGTH, &height );
 
@@ -27,13 +36,33 @@ image_size get_image_size(TIFF* handle)
 }
 
 void read(TIFF* handle, image_size image_size, float* buffer, tile_info tile_info)
+{
+	read_rows(handle, image_size, buffer, 0, image_size.sizes[1], tile_info);
+}
+
+void read(TIFF* handle, image_size image_size, float* buffer, strip_info strip_info)
+{
+	read_rows(handle, image_size, buffer, 0, image_size.sizes[1], strip_info);
+}
+
+void read_rows(TIFF* handle,
+	image_size image_size,
+	float* buffer,
+	size_t first_row,
+	size_t row_count,
+	tile_info tile_info)
 {
 	auto tile_buffer = std::make_unique<float[]>(tile_info.sizes[0]*tile_info.sizes[1]);
 
+	auto const last_row = std::min(first_row + row_count, static_cast<size_t>(image_size.sizes[1]));
+	if(first_row >= last_row)
+	{ return; }
+
 	// Subtract, because true is -1 in gcc vector math
 	auto const tile_count = image_size.sizes/tile_info.sizes - (image_size.sizes%tile_info.sizes != 0);
-	vec2u_t loc{0, 0};
-	for(;loc[1] != tile_count[1]; loc+=vec2u_t{0, 1})
+	vec2u_t loc{0, first_row/tile_info.sizes[1]};
+	auto const tile_row_end = (last_row + tile_info.sizes[1] - 1)/tile_info.sizes[1];
+	for(;loc[1] != tile_row_end; loc+=vec2u_t{0, 1})
 	{
 		for(loc[0] = 0; loc[0] != tile_count[0]; loc+=vec2u_t{1, 0})
 		{
@@ -45,9 +74,13 @@ void read(TIFF* handle, image_size image_size, float* buffer, tile_info tile_inf
 			vec2u_t tile_loc{0, 0};
 			for(;tile_loc[1] != pixels_to_read[1]; tile_loc+=vec2u_t{0, 1})
 			{
+				auto const row = src_loc[1] + tile_loc[1];
+				if(row < first_row || row >= last_row)
+				{ continue; }
+
 				for(tile_loc[0] = 0;tile_loc[0] != pixels_to_read[0]; tile_loc+=vec2u_t{1, 0})
 				{
-					auto const dest_loc = tile_loc + src_loc;
+					auto const dest_loc = tile_loc + src_loc - vec2u_t{0, first_row};
 					pixel(buffer, dest_loc, image_size.sizes[0])
 					  = pixel(tile_buffer.get(), tile_loc, tile_info.sizes[0]);
 				}
@@ -56,18 +89,25 @@ void read(TIFF* handle, image_size image_size, float* buffer, tile_info tile_inf
 	}
 }
 
-void read(TIFF* handle, image_size image_size, float* buffer, strip_info)
+void read_rows(TIFF* handle,
+	image_size image_size,
+	float* buffer,
+	size_t first_row,
+	size_t row_count,
+	strip_info)
 {
-	for(size_t k = 0; k != image_size.sizes[1]; ++k)
+	auto const last_row = std::min(first_row + row_count, static_cast<size_t>(image_size.sizes[1]));
+	for(size_t k = first_row; k < last_row; ++k)
 	{
-		TIFFReadScanline(handle, buffer + k*image_size.sizes[0], k);
+		TIFFReadScanline(handle, buffer + (k - first_row)*image_size.sizes[0], k);
 	}
 }
 
 std::unique_ptr<float[]> load_floats(TIFF* handle, image_info const& img_info)
 {
 	auto const size = (static_cast<size_t>(img_info.size.sizes[0]) * static_cast<size_t>(img_info.size.sizes[1]));
-	auto ret = std::make_unique<float[]>(size);
+	scoped_timer timer{"decode", size};
+	auto ret = std::make_unique_for_overwrite<float[]>(size);
 
 	std::visit([handle, &img_info, output_ptr = ret.get()](auto const& layout){
 		read(handle, img_info.size, output_ptr, layout);
@@ -76,24 +116,134 @@ std::unique_ptr<float[]> load_floats(TIFF* handle, image_info const& img_info)
 	return ret;
 }
 
+void load_rows(TIFF* handle, image_info const& img_info, float* buffer, size_t first_row, size_t row_count)
+{
+	scoped_timer timer{"decode", row_count*img_info.size.sizes[0]};
+	std::visit([handle, &img_info, buffer, first_row, row_count](auto const& layout){
+		read_rows(handle, img_info.size, buffer, first_row, row_count, layout);
+	}, img_info.layout);
+}
+
+void visit_blocks(char const* path, image_info const& info, row_range rows, block_visitor const& f,
+	size_t thread_count)
+{
+	auto const w = static_cast<size_t>(info.size.sizes[0]);
+	auto const h = static_cast<size_t>(info.size.sizes[1]);
+	rows = row_range{std::min(rows.begin, h), std::min(rows.end, h)};
+	if(rows.begin >= rows.end || w == 0)
+	{ return; }
+
+	// A strip is a block as wide as the image. Single-strip images store 2^32 - 1 rows per strip.
+	auto const tile = std::get_if<tile_info>(&info.layout);
+	vec2u_t const block_size = tile != nullptr ? tile->sizes :
+		vec2u_t{w, std::clamp(static_cast<size_t>(std::get<strip_info>(info.layout).rows_per_strip), size_t{1}, h)};
+	auto const blocks_per_row = (w + block_size[0] - 1)/block_size[0];
+	auto const first_block_row = rows.begin/block_size[1];
+	auto const block_rows = (rows.end + block_size[1] - 1)/block_size[1] - first_block_row;
+	auto const block_count = blocks_per_row*block_rows;
+
+	// Blocks are handed out in order, but at most max_ahead past the first block whose visit has
+	// not returned, so that a caller that consumes blocks in order only has to hold a few of them
+	auto const max_ahead = 4*std::max(thread_count, size_t{1});
+	std::mutex mutex;
+	std::condition_variable block_finished;
+	size_t next_block = 0;
+	size_t first_unfinished = 0;
+	std::vector<bool> finished(max_ahead);
+	bool failed = false;
+	std::exception_ptr error;
+
+	auto const take_block = [&](){
+		std::unique_lock lock{mutex};
+		block_finished.wait(lock, [&](){
+			return failed || next_block == block_count || next_block < first_unfinished + max_ahead;
+		});
+		return failed || next_block == block_count ? block_count : next_block++;
+	};
+
+	auto const finish_block = [&](size_t k){
+		std::lock_guard lock{mutex};
+		finished[k%max_ahead] = true;
+		if(k != first_unfinished)
+		{ return; }
+
+		while(first_unfinished != next_block && finished[first_unfinished%max_ahead])
+		{
+			finished[first_unfinished%max_ahead] = false;
+			++first_unfinished;
+		}
+		block_finished.notify_all();
+	};
+
+	auto const worker = [&](){
+		try
+		{
+			get_run_stats().begin_region(path);
+			auto const tiff = make_tiff(path);
+			auto const buffer = std::make_unique_for_overwrite<float[]>(block_size[0]*block_size[1]);
+			for(auto k = take_block(); k < block_count; k = take_block())
+			{
+				vec2u_t const block_origin{(k%blocks_per_row)*block_size[0], (first_block_row + k/blocks_per_row)*block_size[1]};
+				{
+					scoped_timer timer{"decode", block_size[0]*block_size[1]};
+					auto const res = tile != nullptr ?
+						TIFFReadTile(tiff.get(), buffer.get(), static_cast<uint32_t>(block_origin[0]),
+							static_cast<uint32_t>(block_origin[1]), 0, 0) :
+						TIFFReadEncodedStrip(tiff.get(), static_cast<tstrip_t>(block_origin[1]/block_size[1]),
+							buffer.get(), -1);
+					if(res == -1)
+					{ throw std::runtime_error{std::string{"Failed to decode a block of "}.append(path)}; }
+				}
+
+				auto const y_begin = std::max(static_cast<size_t>(block_origin[1]), rows.begin);
+				auto const y_end = std::min(static_cast<size_t>(block_origin[1] + block_size[1]), rows.end);
+				f(decoded_block{buffer.get() + (y_begin - block_origin[1])*block_size[0],
+					block_size[0],
+					vec2u_t{block_origin[0], y_begin},
+					vec2u_t{std::min(block_size[0], w - block_origin[0]), y_end - y_begin},
+					k,
+					block_count});
+				finish_block(k);
+			}
+		}
+		catch(...)
+		{
+			std::lock_guard lock{mutex};
+			failed = true;
+			if(!error)
+			{ error = std::current_exception(); }
+			block_finished.notify_all();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for(size_t k = 1; k < std::min(thread_count, block_count); ++k)
+	{ threads.emplace_back(worker); }
+	worker();
+	std::ranges::for_each(threads, [](auto& item){ item.join(); });
+
+	if(error)
+	{ std::rethrow_exception(error); }
+}
+
 image_layout get_image_layout(TIFF* handle)
 {
 	auto const rows_per_strip = [](auto handle){
-		int val{};
+		uint32_t val{};
 		if(!TIFFGetField(handle, TIFFTAG_ROWSPERSTRIP, &val))
-		{ return std::optional<int>{}; }
+		{ return std::optional<uint32_t>{}; }
 		return std::optional{val};
 	}(handle);
 
 	auto const tile_width = [](auto handle) {
-		int val{};
+		uint32_t val{};
 		if(!TIFFGetField(handle, TIFFTAG_TILEWIDTH, &val))
 		{ return std::optional<size_t>{}; }
 		return std::optional{static_cast<size_t>(val)};
 	}(handle);
 
 	auto const tile_height = [](auto handle){
-				int val{};
+		uint32_t val{};
 		if(!TIFFGetField(handle, TIFFTAG_TILELENGTH, &val))
 		{ return std::optional<size_t>{}; }
 		return std::optional{static_cast<size_t>(val)};
@@ -157,6 +307,7 @@ image_info get_image_info(TIFF* handle)
 
 std::unique_ptr<GTIF, gtif_releaser> make_gtif(TIFF* handle)
 {
+	scoped_timer timer{"geotiff_metadata"};
 	std::unique_ptr<GTIF, gtif_releaser> ret{GTIFNew(handle)};
 	if(ret.get() == nullptr)
 	{
@@ -181,6 +332,7 @@ std::unique_ptr<GTIF, gtif_releaser> make_gtif(TIFF* handle)
 
 corners_in_geo_coords get_domain(GTIF* handle, const GTIFDefn& defn, image_size img_size)
 {
+	scoped_timer timer{"geotiff_metadata"};
 	if(defn.Model != ModelTypeGeographic)
 	{
 		throw std::runtime_error{"Usupported format"};
@@ -6,15 +6,18 @@
 #define GEOTIFF_LOADER_HPP
 
 #include "./types.hpp"
+#include "./stats.hpp"
 
 #include <tiffio.h>
 #include <geotiff/xtiffio.h>
 #include <geotiff/geotiffio.h>
 #include <geotiff/geo_normalize.h>
 
+#include <functional>
 #include <memory>
 #include <variant>
 #include <stdexcept>
+#include <algorithm>
 
 struct tiff_releaser
 {
@@ -25,15 +28,35 @@ struct tiff_releaser
 	}
 };
 
+/**
+ * Opens path for reading. Both classic TIFF and BigTIFF files are accepted.
+*/
 std::unique_ptr<TIFF, tiff_releaser> make_tiff(char const* path);
 
+/**
+ * Returns the mode to pass to XTIFFOpen, when writing an image of the given size. Classic TIFF
+ * uses 32-bit file offsets, so BigTIFF is used unless the pixels fit below 4 GiB together with
+ * the tables and tags that follow them.
+*/
+inline char const* get_tiff_write_mode(image_size size, size_t bytes_per_pixel)
+{
+	auto const w = static_cast<size_t>(size.sizes[0]);
+	auto const h = static_cast<size_t>(size.sizes[1]);
+
+	// Strip or tile offsets and byte counts take 8 bytes per block, where a block is at least
+	// one row or 16x16 pixels, and headers and tags fit within 1 MiB
+	auto const table_bytes = 8*std::max(h, w*h/256 + 1);
+	auto const byte_count = w*h*bytes_per_pixel + table_bytes + (size_t{1} << 20);
+	return byte_count >= (size_t{1} << 32) ? "w8" : "w";
+}
+
 image_size get_image_size(TIFF* handle);
 
 enum class sample_format:int{float_32};
 
 struct strip_info
 {
-	int32_t rows_per_strip;
+	uint32_t rows_per_strip;
 };
 
 struct tile_info
@@ -59,12 +82,68 @@ void read(TIFF*, image_size, T*, U const&)
 	throw std::runtime_error{"Unsupported image format"};
 }
 
+template<class T, class U>
+void read_rows(TIFF*, image_size, T*, size_t, size_t, U const&)
+{
+	throw std::runtime_error{"Unsupported image format"};
+}
+
 void read(TIFF*, image_size, float*, tile_info);
 
 void read(TIFF*, image_size, float*, strip_info);
 
+/**
+ * Reads row_count rows, starting at first_row, into buffer. The first row read is stored at
+ * the beginning of buffer. When reading tiles, first_row and row_count should be multiples of
+ * the tile height, otherwise some tiles will be decoded more than once.
+*/
+void read_rows(TIFF*, image_size, float* buffer, size_t first_row, size_t row_count, tile_info);
+
+void read_rows(TIFF*, image_size, float* buffer, size_t first_row, size_t row_count, strip_info);
+
 std::unique_ptr<float[]> load_floats(TIFF* handle, image_info const& img_info);
 
+void load_rows(TIFF* handle, image_info const& img_info, float* buffer, size_t first_row, size_t row_count);
+
+/**
+ * A decoded tile or strip, clipped to the rows that were asked for. pixels holds size[1] rows of
+ * stride pixels, and its first pixel is at origin in the image. index is the position of the
+ * block in row-major order, among the count blocks that are visited.
+*/
+struct decoded_block
+{
+	float const* pixels;
+	size_t stride;
+	vec2u_t origin;
+	vec2u_t size;
+	size_t index;
+	size_t count;
+};
+
+using block_visitor = std::function<void(decoded_block const&)>;
+
+/**
+ * Decodes the tiles or strips of the image at path that intersect rows, and calls f with each
+ * of them, instead of storing the image. Each of thread_count threads opens its own handle and
+ * takes the next block when it is done with the previous one, so f runs concurrently with the
+ * decoding of other blocks. Blocks are taken in index order, and a thread waits rather than take
+ * a block 4*thread_count or more past the first block whose call to f has not returned. The
+ * pixels of a block are only valid during the call. If decoding or f throws, the remaining
+ * blocks are skipped, and the first exception is rethrown.
+*/
+void visit_blocks(char const* path, image_info const& info, row_range rows, block_visitor const& f,
+	size_t thread_count = 1);
+
+/**
+ * Returns the smallest number of rows that can be decoded without decoding any pixel twice
+*/
+inline size_t get_band_height(image_layout const& layout)
+{
+	if(auto const tile = std::get_if<tile_info>(&layout); tile != nullptr)
+	{ return tile->sizes[1]; }
+	return 1;
+}
+
 image_info get_image_info(TIFF* handle);
 
 struct gtif_releaser
@@ -82,6 +161,7 @@ std::unique_ptr<GTIF, gtif_releaser> make_gtif(TIFF* handle);
 
 inline std::unique_ptr<GTIFDefn> get_defn(GTIF* handle)
 {
+	scoped_timer timer{"geotiff_metadata"};
 	auto ret = std::make_unique<GTIFDefn>();
 	GTIFGetDefn(handle, ret.get());
 	return ret;
@@ -0,0 +1,157 @@
+#ifndef GET_PROMINENCE_HPP
+#define GET_PROMINENCE_HPP
+
+#include "./types.hpp"
+
+#include <array>
+#include <span>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+template<class T>
+struct peak
+{
+	size_t summit;
+	size_t key_col;
+	T summit_value;
+	T key_col_value;
+};
+
+class pixel_forest
+{
+public:
+	static constexpr auto not_visited = std::numeric_limits<size_t>::max();
+
+	explicit pixel_forest(size_t size):m_parents(size, not_visited)
+	{}
+
+	bool visited(size_t node) const
+	{ return m_parents[node] != not_visited; }
+
+	void make_root(size_t node)
+	{ m_parents[node] = node; }
+
+	void attach(size_t node, size_t root)
+	{ m_parents[node] = root; }
+
+	size_t find_root(size_t node)
+	{
+		auto root = node;
+		while(m_parents[root] != root)
+		{ root = m_parents[root]; }
+
+		while(m_parents[node] != root)
+		{
+			auto const next = m_parents[node];
+			m_parents[node] = root;
+			node = next;
+		}
+		return root;
+	}
+
+private:
+	std::vector<size_t> m_parents;
+};
+
+/**
+ * Computes the topographic prominence of all 2D local maxima in heightmap. Pixels are
+ * visited from the highest to the lowest, and are merged with already visited neighbours
+ * (8-connectivity). The root of each component is always its highest pixel. When two
+ * components meet, the pixel where they meet is the key col of the lower summit.
+ *
+ * Summits that never meet a higher component get the lowest pixel of their component as
+ * key col. Pixels for which is_valid returns false are treated as sea level and separate
+ * components.
+*/
+template<class T, class Predicate>
+auto get_prominence(std::span<T const> heightmap, image_size size, Predicate&& is_valid)
+{
+	auto const w = size.sizes[0];
+	auto const h = size.sizes[1];
+
+	std::vector<size_t> order;
+	for(size_t k = 0; k != std::size(heightmap); ++k)
+	{
+		if(is_valid(k))
+		{ order.push_back(k); }
+	}
+
+	std::ranges::sort(order, [heightmap](auto a, auto b){
+		return heightmap[a] != heightmap[b] ? heightmap[b] < heightmap[a] : a < b;
+	});
+
+	std::vector<peak<T>> ret;
+	pixel_forest forest{std::size(heightmap)};
+	std::array<size_t, 8> roots{};
+	for(auto const node : order)
+	{
+		auto const x = node%w;
+		auto const y = node/w;
+		size_t root_count = 0;
+		for(auto dy : {-1, 0, 1})
+		{
+			for(auto dx : {-1, 0, 1})
+			{
+				if((dx == 0 && dy == 0)
+					|| (dx < 0 && x == 0) || (dx > 0 && x + 1 == w)
+					|| (dy < 0 && y == 0) || (dy > 0 && y + 1 == h))
+				{ continue; }
+
+				auto const neighbour = (y + dy)*w + (x + dx);
+				if(!forest.visited(neighbour))
+				{ continue; }
+
+				auto const root = forest.find_root(neighbour);
+				if(std::find(std::begin(roots), std::begin(roots) + root_count, root)
+					== std::begin(roots) + root_count)
+				{
+					roots[root_count] = root;
+					++root_count;
+				}
+			}
+		}
+
+		if(root_count == 0)
+		{
+			forest.make_root(node);
+			continue;
+		}
+
+		// Roots are summits, and summits were visited in order. Thus, the highest summit
+		// is the one that comes first in the sort order.
+		auto const survivor = *std::min_element(std::begin(roots), std::begin(roots) + root_count,
+			[heightmap](auto a, auto b){
+				return heightmap[a] != heightmap[b] ? heightmap[b] < heightmap[a] : a < b;
+			});
+
+		for(size_t k = 0; k != root_count; ++k)
+		{
+			if(roots[k] != survivor)
+			{
+				ret.push_back(peak{roots[k], node, heightmap[roots[k]], heightmap[node]});
+				forest.attach(roots[k], survivor);
+			}
+		}
+		forest.attach(node, survivor);
+	}
+
+	// Remaining summits are the highest point of their component
+	std::unordered_map<size_t, size_t> lowest;
+	std::for_each(std::rbegin(order), std::rend(order), [&forest, &lowest](auto node){
+		lowest.try_emplace(forest.find_root(node), node);
+	});
+
+	for(auto const& item : lowest)
+	{
+		ret.push_back(peak{item.first, item.second, heightmap[item.first], heightmap[item.second]});
+	}
+
+	// Do not let the ordering of lowest leak into the output
+	std::ranges::sort(ret, [](auto const& a, auto const& b){ return a.summit < b.summit; });
+
+	return ret;
+}
+
+#endif
@@ -0,0 +1,59 @@
+//@{"target":{"name":"get_prominence.test"}}
+
+#include "./get_prominence.hpp"
+
+#include <array>
+#include <algorithm>
+#include <cassert>
+
+int main()
+{
+    {
+        // Two peaks separated by a col at 3
+        std::array<float, 7> vals{1.0f, 5.0f, 2.0f, 3.0f, 2.0f, 9.0f, 1.0f};
+        auto const peaks = get_prominence<float>(vals, image_size{vec2u_t{7, 1}}, [](size_t){ return true; });
+
+        assert(std::size(peaks) == 3);
+        auto const i = std::ranges::find_if(peaks, [](auto const& item){ return item.summit == 1; });
+        assert(i != std::end(peaks));
+        assert(i->summit_value == 5.0f);
+        assert(i->key_col_value == 2.0f);
+
+        auto const j = std::ranges::find_if(peaks, [](auto const& item){ return item.summit == 5; });
+        assert(j != std::end(peaks));
+        assert(j->key_col_value == 1.0f);
+    }
+
+    {
+        // A masked pixel splits the domain into two components
+        std::array<float, 9> vals{
+            1.0f, 0.0f, 1.0f,
+            4.0f, 0.0f, 7.0f,
+            1.0f, 0.0f, 2.0f
+        };
+        auto const peaks = get_prominence<float>(vals, image_size{vec2u_t{3, 3}}, [&vals](size_t k){
+            return vals[k] != 0.0f;
+        });
+
+        assert(std::size(peaks) == 2);
+        assert(peaks[0].summit == 3);
+        assert(peaks[0].key_col_value == 1.0f);
+        assert(peaks[1].summit == 5);
+        assert(peaks[1].key_col_value == 1.0f);
+    }
+
+    {
+        // A diagonal connection merges two summits
+        std::array<float, 9> vals{
+            5.0f, 1.0f, 1.0f,
+            1.0f, 2.0f, 1.0f,
+            1.0f, 1.0f, 6.0f
+        };
+        auto const peaks = get_prominence<float>(vals, image_size{vec2u_t{3, 3}}, [](size_t){ return true; });
+        assert(std::size(peaks) == 2);
+        assert(peaks[0].summit == 0);
+        assert(peaks[0].key_col == 4);
+        assert(peaks[1].summit == 8);
+        assert(peaks[1].key_col_value == 1.0f);
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef GRADIENT_KERNELS_HPP
+#define GRADIENT_KERNELS_HPP
+
+#include "./types.hpp"
+#include "./pixel_sampling.hpp"
+
+#include <array>
+#include <vector>
+#include <tuple>
+#include <numbers>
+#include <algorithm>
+
+struct central_differences
+{
+	vec4_t loc;
+	float z;
+	float dz_dλ;
+	float dz_dϕ;
+};
+
+/**
+ * Computes the derivatives of the heightmap at loc, with respect to longitude and latitude.
+ * loc must not be on the border of the image.
+*/
+template<class Pixel>
+central_differences get_central_differences(basic_heightmap_region<Pixel> const& region, vec2u_t loc)
+{
+	auto const val11 = to_float(region.pixels(loc));
+
+	auto const val10 = to_float(region.pixels(loc-vec2u_t{0, 1}));
+	auto const val01 = to_float(region.pixels(loc-vec2u_t{1, 0}));
+	auto const val21 = to_float(region.pixels(loc+vec2u_t{1, 0}));
+	auto const val12 = to_float(region.pixels(loc+vec2u_t{0, 1}));
+
+	auto const loc10 = pixel_to_geo_coords(loc-vec2u_t{0, 1}, region.size, region.domain);
+	auto const loc01 = pixel_to_geo_coords(loc-vec2u_t{1, 0}, region.size, region.domain);
+	auto const loc11 = pixel_to_geo_coords(loc, region.size, region.domain);
+	auto const loc21 = pixel_to_geo_coords(loc+vec2u_t{1, 0}, region.size, region.domain);
+	auto const loc12 = pixel_to_geo_coords(loc+vec2u_t{0, 1}, region.size, region.domain);
+
+	return central_differences{
+		loc11,
+		val11,
+		(val21 - val01)/(loc21[0] - loc01[0]),
+		(val12 - val10)/(loc12[1] - loc10[1])
+	};
+}
+
+/**
+ * Calls f for all pixels in rows [row_begin, row_end), and in columns, that are inside the mask
+ * and have four neighbours. If sample is not complete, only the pixels it picks are visited.
+*/
+template<class Pixel, class Func>
+void for_each_stencil_pixel(basic_heightmap_region<Pixel> const& region, size_t row_begin, size_t row_end,
+	column_range columns, Func&& f, pixel_sample const& sample = pixel_sample{})
+{
+	auto const w = static_cast<size_t>(region.size.sizes[0]);
+	auto const h = static_cast<size_t>(region.size.sizes[1]);
+	if(w < 3 || h < 3)
+	{ return; }
+
+	for_each_sampled_pixel(sample, row_range{std::max(row_begin, size_t{1}), std::min(row_end, h - 1)},
+		column_range{std::max(columns.begin, size_t{1}), std::min(columns.end, w - 1)},
+		[&region, &f](vec2u_t loc){
+			if(region.mask.data() == nullptr || region.mask(loc) != 0)
+			{ f(loc); }
+		});
+}
+
+using gradient_samples = std::array<std::vector<std::tuple<float, float>>, 159>;
+
+constexpr float gradient_min_elevation = 1.0f;
+
+constexpr float gradient_min_value = 1.0f/2048.0f;
+
+/**
+ * Collects (elevation, gradient) pairs for all pixels in rows [row_begin, row_end), and in
+ * columns, that are above gradient_min_elevation and steeper than gradient_min_value. Pairs are
+ * grouped by 12*log2 of the elevation. If sample is not complete, only the pixels it picks are
+ * visited.
+*/
+template<class Pixel>
+void collect_gradients(basic_heightmap_region<Pixel> const& region,
+	size_t row_begin,
+	size_t row_end,
+	gradient_samples& histogram,
+	column_range columns = column_range{},
+	pixel_sample const& sample = pixel_sample{})
+{
+	for_each_stencil_pixel(region, row_begin, row_end, columns, [&region, &histogram](auto loc) {
+		auto const d = get_central_differences(region, loc);
+		auto const scale_factors = 1.0f/nabla_factors(region.R_e, region.R_p, d.loc + vec4_t{0.0f, 0.0f, d.z, 0.0f});
+
+		auto const grad = norm(scale_factors*vec4_t{d.dz_dλ, d.dz_dϕ, 0.0f, 0.0f});
+
+		if(d.z > gradient_min_elevation && grad > gradient_min_value)
+		{
+			auto const bucket = static_cast<size_t>(d.z < 1.0f ? 0.0f : 12.0f*std::log2(d.z));
+			histogram[bucket].push_back(std::tuple{d.z, grad});
+		}
+	}, sample);
+}
+
+constexpr size_t slope_direction_count = 64;
+
+using slope_direction_sums = std::array<std::pair<double, double>, slope_direction_count + 1>;
+
+/**
+ * Adds the area projected onto each of slope_direction_count + 1 horizontal directions, both
+ * for the surface normal and for its horizontal component, for all pixels in rows
+ * [row_begin, row_end), and in columns. Areas are weighted by sample.weight().
+*/
+template<class Pixel>
+void accumulate_slope_directions(basic_heightmap_region<Pixel> const& region,
+	size_t row_begin,
+	size_t row_end,
+	slope_direction_sums& data,
+	column_range columns = column_range{},
+	pixel_sample const& sample = pixel_sample{})
+{
+	auto const longlat_delta = pixel_to_geo_coords(vec2u_t{1, 0}, region.size, region.domain)
+		- pixel_to_geo_coords(vec2u_t{0, 1}, region.size, region.domain);
+
+	auto const weight = static_cast<float>(sample.weight());
+	for_each_stencil_pixel(region, row_begin, row_end, columns, [&region, &data, longlat_delta, weight](auto loc) {
+		auto const d = get_central_differences(region, loc);
+		auto const scale_factors = nabla_factors(region.R_e, region.R_p, d.loc + vec4_t{0.0f, 0.0f, d.z, 0.0f});
+		auto const derivs = vec4_t{d.dz_dλ, d.dz_dϕ, 0.0f, 0.0f}/scale_factors;
+		auto const n = normalized(vec4_t{-derivs[0], -derivs[1], 1.0f, 0.0f});
+		auto const n_horz = std::sqrt(n[0]*n[0] + n[1]*n[1]);
+		if(n_horz > 1.0f/65536.0f)
+		{
+			auto const dA = weight*(scale_factors[0]*longlat_delta[0]*longlat_delta[1]*scale_factors[1]);
+			auto const n_xy = vec4_t{n[0], n[1], 0.0f, 0.0f}/n_horz;
+
+			for(size_t k = 0; k != std::size(data); ++k)
+			{
+				auto const theta = 2.0f*k*std::numbers::pi_v<float>/slope_direction_count;
+				auto const d_xy = vec4_t{-std::sin(theta), std::cos(theta), 0.0f};
+				data[k].first += dA*std::max(dot(n, d_xy), 0.0f);
+				data[k].second += dA*std::max(dot(n_xy, d_xy), 0.0f);
+			}
+		}
+	}, sample);
+}
+
+#endif
@@ -0,0 +1,277 @@
+//@{"target":{"name":"kernels.bench"}}
+
+#include "./synthetic_dem.hpp"
+#include "./geotiff_loader.hpp"
+#include "./elev_hist_kernel.hpp"
+#include "./gradient_kernels.hpp"
+#include "./cross_section.hpp"
+#include "./raster_buffer.hpp"
+#include "./region_loader.hpp"
+#include "./file.hpp"
+#include "./blob.hpp"
+#include "./cmdline.hpp"
+
+#include <chrono>
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+struct size_list
+{
+	size_list() = default;
+
+	explicit size_list(std::string const& str):values{}
+	{
+		std::string_view rem{str};
+		while(!rem.empty())
+		{
+			auto const i = rem.find(',');
+			values.push_back(std::stoul(std::string{rem.substr(0, i)}));
+			rem = i == std::string_view::npos ? std::string_view{} : rem.substr(i + 1);
+		}
+	}
+
+	std::vector<size_t> values{1024, 4096};
+};
+
+struct benchmark_case
+{
+	char const* layout_name;
+	image_layout layout;
+	char const* compression_name;
+	synthetic_compression compression;
+};
+
+/**
+ * Returns the shortest wall-clock time out of repeat runs of f
+*/
+template<class Func>
+double measure(size_t repeat, Func&& f)
+{
+	auto best = std::numeric_limits<double>::infinity();
+	for(size_t k = 0; k != repeat; ++k)
+	{
+		auto const t0 = std::chrono::steady_clock::now();
+		f();
+		auto const t1 = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+	}
+	return best;
+}
+
+struct raster_layout_case
+{
+	char const* name;
+	raster_layout layout;
+	pixel_format format;
+};
+
+heightmap_raster make_raster(raster_layout_case const& item, image_size size, float const* pixels)
+{
+	auto const convert = [&item, size, pixels]<class T>(std::type_identity<T>){
+		raster<T> ret{size, item.layout};
+		write_rows(ret.view(), 0, pixels, size.sizes[1], [](float z){ return encode_elevation<T>(z); });
+		return heightmap_raster{std::move(ret)};
+	};
+
+	switch(item.format)
+	{
+		case pixel_format::uint16:
+			return convert(std::type_identity<quantized_elevation>{});
+		case pixel_format::float16:
+			return convert(std::type_identity<half_elevation>{});
+		default:
+			return convert(std::type_identity<float>{});
+	}
+}
+
+/**
+ * Returns sum |a - b| / sum |b| over all elements
+*/
+template<class Container, class Func>
+double get_relative_error(Container const& a, Container const& b, Func&& get_value)
+{
+	double diff = 0.0;
+	double sum = 0.0;
+	for(size_t k = 0; k != std::min(std::size(a), std::size(b)); ++k)
+	{
+		diff += std::abs(get_value(a[k]) - get_value(b[k]));
+		sum += std::abs(get_value(b[k]));
+	}
+	return sum == 0.0 ? 0.0 : diff/sum;
+}
+
+void report(char const* benchmark, image_size size, benchmark_case const& item,
+	raster_layout_case const& raster_item, double seconds, double items, char const* unit)
+{
+	printf("{\"benchmark\": \"%s\", \"width\": %zu, \"height\": %zu, \"layout\": \"%s\", "
+		"\"compression\": \"%s\", \"raster_layout\": \"%s\", \"seconds\": %.6g, \"%s_per_second\": %.6g}\n",
+		benchmark,
+		static_cast<size_t>(size.sizes[0]),
+		static_cast<size_t>(size.sizes[1]),
+		item.layout_name,
+		item.compression_name,
+		raster_item.name,
+		seconds,
+		unit,
+		items/seconds);
+	fflush(stdout);
+}
+
+void report_error(char const* benchmark, image_size size, raster_layout_case const& raster_item,
+	double relative_error)
+{
+	printf("{\"benchmark\": \"%s\", \"width\": %zu, \"height\": %zu, \"raster_layout\": \"%s\", "
+		"\"relative_error_vs_float32\": %.6g}\n",
+		benchmark,
+		static_cast<size_t>(size.sizes[0]),
+		static_cast<size_t>(size.sizes[1]),
+		raster_item.name,
+		relative_error);
+	fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+	command_line const opts{argc, argv};
+	auto const sizes = get_or(opts, "sizes", size_list{}).values;
+	auto const rays = get_or(opts, "rays", value<size_t>{4096}).get();
+	auto const repeat = std::max(get_or(opts, "repeat", value<size_t>{3}).get(), size_t{1});
+
+	std::string workdir = get_or(opts, "dir", std::string{});
+	if(workdir.empty())
+	{
+		std::string dir_template{"/tmp/kernels_bench_XXXXXX"};
+		if(mkdtemp(std::data(dir_template)) == nullptr)
+		{ throw std::runtime_error{"Failed to create a working directory"}; }
+		workdir = dir_template;
+	}
+	fprintf(stderr, "Writing synthetic data to %s\n", workdir.c_str());
+
+	std::array<benchmark_case, 4> const cases{
+		benchmark_case{"tiled", tile_info{vec2u_t{256, 256}}, "none", synthetic_compression::none},
+		benchmark_case{"tiled", tile_info{vec2u_t{256, 256}}, "deflate", synthetic_compression::deflate},
+		benchmark_case{"strip", strip_info{1}, "none", synthetic_compression::none},
+		benchmark_case{"strip", strip_info{16}, "lzw", synthetic_compression::lzw}
+	};
+
+	// Stencils and rays are measured on each in-memory layout and pixel format. The first case
+	// is the float32 reference that the results of the other formats are compared with.
+	std::array<raster_layout_case, 5> const raster_cases{
+		raster_layout_case{"row_major", raster_layout::row_major(), pixel_format::float32},
+		raster_layout_case{"blocked_64", raster_layout::blocked(64), pixel_format::float32},
+		raster_layout_case{"blocked_256", raster_layout::blocked(256), pixel_format::float32},
+		raster_layout_case{"row_major_uint16", raster_layout::row_major(), pixel_format::uint16},
+		raster_layout_case{"row_major_float16", raster_layout::row_major(), pixel_format::float16}
+	};
+
+	for(auto const size_val : sizes)
+	{
+		image_size const size{vec2u_t{size_val, size_val}};
+		for(auto const& item : cases)
+		{
+			auto const name = std::string{workdir}.append("/dem_")
+				.append(std::to_string(size_val))
+				.append("_").append(item.layout_name)
+				.append("_").append(item.compression_name);
+			auto const tif_name = std::string{name}.append(".tif");
+			auto const mask_name = std::string{name}.append("_mask.data");
+			write_synthetic_dem(tif_name, mask_name, synthetic_dem_params{size, item.layout, item.compression, 0});
+
+			auto tiff = make_tiff(tif_name.c_str());
+			auto const info = get_image_info(tiff.get());
+			auto const pixel_count = static_cast<double>(info.size.sizes[0]*info.size.sizes[1]);
+
+			std::unique_ptr<float[]> pixels;
+			report("load_floats", size, item, raster_cases[0], measure(repeat, [&](){
+				pixels = load_floats(tiff.get(), info);
+			}), pixel_count, "pixels");
+
+			// The kernels do not depend on the file layout
+			if(&item != std::data(cases))
+			{ continue; }
+
+			auto gtif = make_gtif(tiff.get());
+			auto defn = get_defn(gtif.get());
+			auto const domain = get_domain(gtif.get(), *defn, info.size);
+			blob<uint8_t> const mask{file{mask_name, "rb"}.get(), info.size.sizes[0]*info.size.sizes[1]};
+			elev_histogram elev_hist_ref{};
+			slope_direction_sums slopedir_ref{};
+			for(auto const& raster_item : raster_cases)
+			{
+				auto const pixels_in_layout = make_raster(raster_item, info.size, pixels.get());
+				std::vector<curve> curves;
+				std::visit([&](auto const& image){
+					using pixel_type = typename std::remove_cvref_t<decltype(image)>::value_type;
+					basic_heightmap_region<pixel_type> const region{image.view(),
+						raster_view<uint8_t const>{mask.get(), info.size}, info.size, domain,
+						static_cast<float>(defn->SemiMajor),
+						static_cast<float>(defn->SemiMinor)};
+
+					elev_histogram elev_hist_result{};
+					report("elev_hist", size, item, raster_item, measure(repeat, [&region, &elev_hist_result](){
+						elev_hist_result = elev_histogram{};
+						accumulate_elev_hist(region, 0, region.size.sizes[1], histogram_bins{}, elev_hist_result);
+					}), pixel_count, "pixels");
+
+					report("grad_at_points", size, item, raster_item, measure(repeat, [&region](){
+						gradient_samples histogram;
+						collect_gradients(region, 0, region.size.sizes[1], histogram);
+					}), pixel_count, "pixels");
+
+					slope_direction_sums slopedir_result{};
+					report("slopedir", size, item, raster_item, measure(repeat, [&region, &slopedir_result](){
+						slopedir_result = slope_direction_sums{};
+						accumulate_slope_directions(region, 0, region.size.sizes[1], slopedir_result);
+					}), pixel_count, "pixels");
+
+					report("get_cross_section", size, item, raster_item, measure(repeat, [&region, &curves, rays](){
+						std::mt19937 rng;
+						curves.clear();
+						for(size_t k = 0; k != rays; ++k)
+						{
+							auto section = cast_random_ray(region, rng);
+							std::ranges::move(section, std::back_inserter(curves));
+						}
+					}), static_cast<double>(rays), "rays");
+
+					report("peak_valley_elev", size, item, raster_item, measure(repeat, [&region, rays](){
+						std::mt19937 rng;
+						peak_samples histogram;
+						for(size_t k = 0; k != rays; ++k)
+						{ trace_random_ray(region, rng, histogram); }
+					}), static_cast<double>(rays), "rays");
+
+					if(&raster_item == std::data(raster_cases))
+					{
+						elev_hist_ref = elev_hist_result;
+						slopedir_ref = slopedir_result;
+						return;
+					}
+
+					report_error("elev_hist", size, raster_item,
+						get_relative_error(elev_hist_result, elev_hist_ref, [](double val){ return val; }));
+					report_error("slopedir", size, raster_item,
+						get_relative_error(slopedir_result, slopedir_ref, [](auto const& val){ return val.first; }));
+				}, pixels_in_layout);
+
+				// Extrema are found on the curves, which do not depend on the layout
+				if(&raster_item != std::data(raster_cases))
+				{ continue; }
+
+				size_t sample_count = 0;
+				std::ranges::for_each(curves, [&sample_count](auto const& val){ sample_count += std::size(val); });
+				report("get_local_extrema", size, item, raster_item, measure(repeat, [&curves](){
+					size_t extrema_count = 0;
+					std::ranges::for_each(curves, [&extrema_count](auto const& val){
+						extrema_count += std::size(get_local_extrema<vec4_t>(val, [](auto a, auto b){ return a[1] < b[1]; }));
+					});
+					return extrema_count;
+				}), static_cast<double>(sample_count), "samples");
+			}
+		}
+	}
+}
@@ -0,0 +1,135 @@
+//@{"target":{"name":"large_raster.test"}}
+
+#include "./geotiff_loader.hpp"
+#include "./raster_buffer.hpp"
+#include "./cross_section.hpp"
+#include "./blob.hpp"
+#include "./file.hpp"
+#include "./test_temp_file.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    float get_value(size_t x, size_t y)
+    { return static_cast<float>((x*7 + y*13)%4096) + 1.0f; }
+}
+
+int main()
+{
+    // More than 2^32 pixels, of which only a few are touched, so the buffer stays sparse
+    image_size const size{vec2u_t{65536 + 64, 65536}};
+    auto const w = static_cast<size_t>(size.sizes[0]);
+    auto const h = static_cast<size_t>(size.sizes[1]);
+    static_assert(sizeof(size_t) == 8);
+    assert(w*h > (size_t{1} << 32));
+
+    {
+        raster_buffer<uint8_t> buffer{w*h};
+        raster_view<uint8_t> const view{buffer.get(), size};
+        vec2u_t const loc{w - 3, h - 2};
+        view(loc) = 200;
+        view(loc + vec2u_t{1, 0}) = 100;
+        assert(&view(loc) == buffer.get() + (h - 2)*w + w - 3);
+
+        // Rows addressed in image coordinates, past the first 2^32 pixels
+        auto const rows = with_row_offset(raster_view<uint8_t const>{buffer.get() + (h - 4)*w, size}, h - 4, size);
+        assert(rows(loc) == 200);
+
+        // Interpolation halfway between the two pixels
+        auto const z = interp(raster_view<uint8_t const>{view}, vec4_t{static_cast<float>(w - 3) + 0.5f,
+            static_cast<float>(h - 2), 0.0f, 0.0f});
+        assert(z == 150.0f);
+
+        assert(get_storage_size(size, raster_layout::blocked(256)) == (w + 192)*h);
+    }
+
+    {
+        // A sparse mask file larger than 4 GiB
+        auto const name = get_temp_name("large_raster_test", ".data");
+        auto const N = (size_t{1} << 32) + 64;
+        {
+            auto const fd = open(name.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0600);
+            assert(fd != -1);
+            [[maybe_unused]] auto const res = ftruncate(fd, static_cast<off_t>(N));
+            assert(res == 0);
+            std::vector<uint8_t> tail(64);
+            for(size_t k = 0; k != std::size(tail); ++k)
+            { tail[k] = static_cast<uint8_t>(k + 1); }
+            [[maybe_unused]] auto const written = pwrite(fd, std::data(tail), std::size(tail), static_cast<off_t>(N - 64));
+            assert(written == 64);
+            close(fd);
+        }
+
+        file const src{name, "rb"};
+        blob<uint8_t> const mask{src.get(), N, N - 64, 64};
+        for(size_t k = 0; k != 64; ++k)
+        { assert(mask.get()[k] == k + 1); }
+
+        try
+        {
+            blob<uint8_t> const wrong_size{src.get(), N - 1, 0, 1};
+            assert(false);
+        }
+        catch(std::runtime_error const&)
+        {}
+
+        std::filesystem::remove(name);
+    }
+
+    {
+        // A BigTIFF where only a few strips are written
+        auto const name = get_temp_name("large_raster_test", ".tif");
+        assert(std::string_view{get_tiff_write_mode(size, sizeof(float))} == "w8");
+        // Pixels just below 4 GiB leave no room for the strip tables
+        assert(std::string_view{get_tiff_write_mode(image_size{vec2u_t{65536, 16383}}, sizeof(float))} == "w8");
+        assert(std::string_view{get_tiff_write_mode(image_size{vec2u_t{65536, 15000}}, sizeof(float))} == "w");
+        std::array<size_t, 3> const rows{0, h/2, h - 1};
+        {
+            std::unique_ptr<TIFF, tiff_releaser> tiff{XTIFFOpen(name.c_str(), get_tiff_write_mode(size, sizeof(float)))};
+            assert(tiff != nullptr);
+            auto const handle = tiff.get();
+            TIFFSetField(handle, TIFFTAG_IMAGEWIDTH, static_cast<uint32_t>(w));
+            TIFFSetField(handle, TIFFTAG_IMAGELENGTH, static_cast<uint32_t>(h));
+            TIFFSetField(handle, TIFFTAG_BITSPERSAMPLE, 32);
+            TIFFSetField(handle, TIFFTAG_SAMPLESPERPIXEL, 1);
+            TIFFSetField(handle, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
+            TIFFSetField(handle, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+            TIFFSetField(handle, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+            TIFFSetField(handle, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+            TIFFSetField(handle, TIFFTAG_ROWSPERSTRIP, 1);
+
+            std::vector<float> row(w);
+            for(auto y : rows)
+            {
+                for(size_t x = 0; x != w; ++x)
+                { row[x] = get_value(x, y); }
+                [[maybe_unused]] auto const res = TIFFWriteEncodedStrip(handle, static_cast<uint32_t>(y), std::data(row),
+                    static_cast<tmsize_t>(w*sizeof(float)));
+                assert(res != -1);
+            }
+        }
+
+        auto const tiff = make_tiff(name.c_str());
+        auto const info = get_image_info(tiff.get());
+        assert(info.size.sizes[0] == w && info.size.sizes[1] == h);
+        assert(std::get<strip_info>(info.layout).rows_per_strip == 1);
+
+        std::vector<float> row(w);
+        for(auto y : rows)
+        {
+            load_rows(tiff.get(), info, std::data(row), y, 1);
+            for(size_t x = 0; x != w; ++x)
+            { assert(row[x] == get_value(x, y)); }
+        }
+
+        std::filesystem::remove(name);
+    }
+}
@@ -0,0 +1,8 @@
+//@	{"target":{"name":"local_relief.o"}}
+
+#include "./analyses.hpp"
+
+int main(int argc, char** argv)
+{
+	return run_analyzer<local_relief_analysis>(argc, argv);
+}
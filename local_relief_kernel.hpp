@@ -0,0 +1,264 @@
+#ifndef LOCAL_RELIEF_KERNEL_HPP
+#define LOCAL_RELIEF_KERNEL_HPP
+
+#include "./types.hpp"
+#include "./elev_hist_kernel.hpp"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+/**
+ * The side lengths, in metres, of the square windows that local relief is computed over
+*/
+constexpr std::array<float, 3> local_relief_scales{1000.0f, 5000.0f, 20000.0f};
+
+/**
+ * Sums over the window centres of one elevation bucket, weighted by the area of the centre pixel
+*/
+struct relief_sums
+{
+	double area;
+	double relief;
+	double mean;
+	double std_dev;
+};
+
+using relief_histogram = std::array<relief_sums, elev_hist_bucket_count>;
+
+/**
+ * The half size of a window, in pixels along each axis. The window covers 2*x + 1 by 2*y + 1
+ * pixels.
+*/
+struct window_radius
+{
+	size_t x;
+	size_t y;
+};
+
+/**
+ * Computes the extremum, according to op, of every window of window consecutive positions of
+ * src, with the van Herk/Gil-Werman algorithm. src holds count positions of lanes interleaved
+ * values, and dst receives count - window + 1 positions. prefix and suffix are scratch buffers
+ * of the same size as src. Each position is visited three times, regardless of window.
+*/
+template<class Op>
+void running_extremum(float const* src, size_t count, size_t window, size_t lanes,
+	float* dst, float* prefix, float* suffix, Op op)
+{
+	if(window == 0 || count < window)
+	{ return; }
+
+	for(size_t block = 0; block < count; block += window)
+	{
+		auto const block_end = std::min(block + window, count);
+		std::copy_n(src + block*lanes, lanes, prefix + block*lanes);
+		for(auto k = block + 1; k != block_end; ++k)
+		{
+			for(size_t l = 0; l != lanes; ++l)
+			{ prefix[k*lanes + l] = op(prefix[(k - 1)*lanes + l], src[k*lanes + l]); }
+		}
+
+		std::copy_n(src + (block_end - 1)*lanes, lanes, suffix + (block_end - 1)*lanes);
+		for(auto k = block_end - 1; k != block; --k)
+		{
+			for(size_t l = 0; l != lanes; ++l)
+			{ suffix[(k - 1)*lanes + l] = op(suffix[k*lanes + l], src[(k - 1)*lanes + l]); }
+		}
+	}
+
+	for(size_t k = 0; k != count - window + 1; ++k)
+	{
+		for(size_t l = 0; l != lanes; ++l)
+		{ dst[k*lanes + l] = op(suffix[k*lanes + l], prefix[(k + window - 1)*lanes + l]); }
+	}
+}
+
+/**
+ * For every pixel in rows [row_begin, row_end) that is inside the mask and has data, computes
+ * the relief (max - min), mean and standard deviation of the elevations in the window of the
+ * given radius around it, and adds them to the bucket of its elevation. Windows include all
+ * pixels with data in data_rows, also outside the mask.
+ *
+ * Min and max are found with running_extremum, first along columns, in strips of columns, and
+ * then along rows. Mean and variance come from differences of a summed-area table of count, z
+ * and z^2. The table is built one row at a time, from running column sums, so the cost per pixel
+ * does not depend on the radius.
+*/
+template<class Pixel>
+void accumulate_local_relief(basic_heightmap_region<Pixel> const& region,
+	size_t row_begin,
+	size_t row_end,
+	window_radius radius,
+	relief_histogram& histogram,
+	row_range data_rows = row_range{})
+{
+	constexpr size_t strip_width = 64;
+	constexpr auto no_min = std::numeric_limits<float>::max();
+	constexpr auto no_max = std::numeric_limits<float>::lowest();
+	auto const min_op = [](float a, float b){ return std::min(a, b); };
+	auto const max_op = [](float a, float b){ return std::max(a, b); };
+
+	auto const w = static_cast<size_t>(region.size.sizes[0]);
+	auto const h = static_cast<size_t>(region.size.sizes[1]);
+	auto const data_begin = std::min(data_rows.begin, h);
+	auto const data_end = std::min(data_rows.end, h);
+	row_end = std::min(row_end, data_end);
+	row_begin = std::max(row_begin, data_begin);
+	if(row_begin >= row_end || w == 0)
+	{ return; }
+
+	// Returns the elevation at (x, y), or 0 if y is outside data_rows. Elevations below 1 are
+	// missing data.
+	auto const get_value = [&region, data_begin, data_end](size_t x, size_t y){
+		return y >= data_begin && y < data_end ? to_float(region.pixels(x, y)) : 0.0f;
+	};
+
+	// Vertical pass, into a band of column extrema
+	auto const rows = row_end - row_begin;
+	auto const padded_rows = rows + 2*radius.y;
+	std::vector<float> col_min(rows*w);
+	std::vector<float> col_max(rows*w);
+	{
+		std::vector<float> src_min(padded_rows*strip_width);
+		std::vector<float> src_max(padded_rows*strip_width);
+		std::vector<float> prefix(padded_rows*strip_width);
+		std::vector<float> suffix(padded_rows*strip_width);
+		std::vector<float> dst(rows*strip_width);
+		for(size_t x0 = 0; x0 < w; x0 += strip_width)
+		{
+			auto const lanes = std::min(strip_width, w - x0);
+			for(size_t k = 0; k != padded_rows; ++k)
+			{
+				// Rows above the image wrap around to large values, and are outside data_rows
+				auto const y = row_begin + k - radius.y;
+				for(size_t l = 0; l != lanes; ++l)
+				{
+					auto const z = get_value(x0 + l, y);
+					src_min[k*lanes + l] = z > 1.0f ? z : no_min;
+					src_max[k*lanes + l] = z > 1.0f ? z : no_max;
+				}
+			}
+
+			auto const store = [&dst, rows, lanes, x0, w](std::vector<float>& band){
+				for(size_t k = 0; k != rows; ++k)
+				{ std::copy_n(std::data(dst) + k*lanes, lanes, std::data(band) + k*w + x0); }
+			};
+
+			auto const window = 2*radius.y + 1;
+			running_extremum(std::data(src_min), padded_rows, window, lanes,
+				std::data(dst), std::data(prefix), std::data(suffix), min_op);
+			store(col_min);
+			running_extremum(std::data(src_max), padded_rows, window, lanes,
+				std::data(dst), std::data(prefix), std::data(suffix), max_op);
+			store(col_max);
+		}
+	}
+
+	// Running column sums of count, z and z^2 over the rows of the window around the current row
+	std::vector<double> col_n(w);
+	std::vector<double> col_z(w);
+	std::vector<double> col_z2(w);
+	auto const add_row = [&](size_t y, double sign){
+		if(y < data_begin || y >= data_end)
+		{ return; }
+
+		for(size_t x = 0; x != w; ++x)
+		{
+			auto const z = static_cast<double>(get_value(x, y));
+			if(z > 1.0)
+			{
+				col_n[x] += sign;
+				col_z[x] += sign*z;
+				col_z2[x] += sign*z*z;
+			}
+		}
+	};
+	for(auto y = row_begin - std::min(row_begin, radius.y); y != row_begin + radius.y; ++y)
+	{ add_row(y, 1.0); }
+
+	auto const longlat_delta = pixel_to_geo_coords(vec2u_t{1, 0}, region.size, region.domain)
+		- pixel_to_geo_coords(vec2u_t{0, 1}, region.size, region.domain);
+
+	std::vector<double> sat_n(w + 1);
+	std::vector<double> sat_z(w + 1);
+	std::vector<double> sat_z2(w + 1);
+	std::vector<float> row_src(w + 2*radius.x);
+	std::vector<float> row_prefix(w + 2*radius.x);
+	std::vector<float> row_suffix(w + 2*radius.x);
+	std::vector<float> row_min(w);
+	std::vector<float> row_max(w);
+	for(auto y = row_begin; y != row_end; ++y)
+	{
+		add_row(y + radius.y, 1.0);
+
+		for(size_t x = 0; x != w; ++x)
+		{
+			sat_n[x + 1] = sat_n[x] + col_n[x];
+			sat_z[x + 1] = sat_z[x] + col_z[x];
+			sat_z2[x + 1] = sat_z2[x] + col_z2[x];
+		}
+
+		auto const horizontal_pass = [&](std::vector<float> const& band, float padding, std::vector<float>& dst, auto op){
+			std::fill_n(std::begin(row_src), radius.x, padding);
+			std::copy_n(std::data(band) + (y - row_begin)*w, w, std::begin(row_src) + radius.x);
+			std::fill_n(std::begin(row_src) + radius.x + w, radius.x, padding);
+			running_extremum(std::data(row_src), w + 2*radius.x, 2*radius.x + 1, 1,
+				std::data(dst), std::data(row_prefix), std::data(row_suffix), op);
+		};
+		horizontal_pass(col_min, no_min, row_min, min_op);
+		horizontal_pass(col_max, no_max, row_max, max_op);
+
+		for(size_t x = 0; x != w; ++x)
+		{
+			vec2u_t const loc{x, y};
+			if(region.mask.data() != nullptr && region.mask(loc) == 0)
+			{ continue; }
+
+			auto const val = to_float(region.pixels(loc));
+			if(!(val > 1.0f))
+			{ continue; }
+
+			auto const x0 = x - std::min(x, radius.x);
+			auto const x1 = std::min(x + radius.x + 1, w);
+			auto const n = sat_n[x1] - sat_n[x0];
+			auto const mean = (sat_z[x1] - sat_z[x0])/n;
+			auto const variance = std::max((sat_z2[x1] - sat_z2[x0])/n - mean*mean, 0.0);
+
+			auto const loc_long_lat = pixel_to_geo_coords(loc, region.size, region.domain);
+			auto const scale_factors = nabla_factors(region.R_e, region.R_p, loc_long_lat)*longlat_delta;
+			auto const dA = static_cast<double>(scale_factors[0]*scale_factors[1]);
+			auto const bucket = std::min(static_cast<size_t>(val/elev_hist_bucket_size), elev_hist_bucket_count - 1);
+			auto& item = histogram[bucket];
+			item.area += dA;
+			item.relief += dA*static_cast<double>(row_max[x] - row_min[x]);
+			item.mean += dA*mean;
+			item.std_dev += dA*std::sqrt(variance);
+		}
+
+		if(y >= radius.y)
+		{ add_row(y - radius.y, -1.0); }
+	}
+}
+
+/**
+ * Returns the radius of a window with side length scale, in metres, using the pixel size at the
+ * centre of region. The radius is at least one pixel.
+*/
+template<class Pixel>
+window_radius get_window_radius(basic_heightmap_region<Pixel> const& region, float scale)
+{
+	auto const longlat_delta = pixel_to_geo_coords(vec2u_t{1, 0}, region.size, region.domain)
+		- pixel_to_geo_coords(vec2u_t{0, 1}, region.size, region.domain);
+	auto const centre = pixel_to_geo_coords(vec2u_t{region.size.sizes[0]/2, region.size.sizes[1]/2},
+		region.size, region.domain);
+	auto const pixel_size = nabla_factors(region.R_e, region.R_p, centre)*longlat_delta;
+	auto const get_radius = [scale](float size){
+		return std::max(static_cast<size_t>(std::lround(0.5f*scale/std::abs(size))), size_t{1});
+	};
+	return window_radius{get_radius(pixel_size[0]), get_radius(pixel_size[1])};
+}
+
+#endif
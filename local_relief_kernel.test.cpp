@@ -0,0 +1,124 @@
+//@{"target":{"name":"local_relief_kernel.test"}}
+
+#include "./local_relief_kernel.hpp"
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+    bool close(double a, double b)
+    { return std::abs(a - b) <= 1.0e-6*std::max({std::abs(a), std::abs(b), 1.0}); }
+}
+
+int main()
+{
+    std::mt19937 rng;
+
+    {
+        std::uniform_real_distribution<float> U{-10.0f, 10.0f};
+        size_t const count = 23;
+        size_t const lanes = 3;
+        std::vector<float> src(count*lanes);
+        std::ranges::generate(src, [&rng, &U](){ return U(rng); });
+        std::vector<float> prefix(count*lanes);
+        std::vector<float> suffix(count*lanes);
+        for(size_t window = 1; window <= count; ++window)
+        {
+            std::vector<float> dst((count - window + 1)*lanes);
+            running_extremum(std::data(src), count, window, lanes, std::data(dst), std::data(prefix), std::data(suffix),
+                [](float a, float b){ return std::max(a, b); });
+            for(size_t k = 0; k != count - window + 1; ++k)
+            {
+                for(size_t l = 0; l != lanes; ++l)
+                {
+                    auto expected = src[k*lanes + l];
+                    for(size_t i = k; i != k + window; ++i)
+                    { expected = std::max(expected, src[i*lanes + l]); }
+                    assert(dst[k*lanes + l] == expected);
+                }
+            }
+        }
+    }
+
+    {
+        // Compare with the windows computed directly, over two bands of rows
+        image_size const size{vec2u_t{71, 37}};
+        auto const w = static_cast<size_t>(size.sizes[0]);
+        auto const h = static_cast<size_t>(size.sizes[1]);
+        std::uniform_real_distribution<float> U{-200.0f, 3000.0f};
+        std::vector<float> pixels(w*h);
+        std::ranges::generate(pixels, [&rng, &U](){ return U(rng); });
+        std::vector<uint8_t> mask(w*h);
+        std::ranges::generate(mask, [&rng](){ return static_cast<uint8_t>(rng()%4 != 0); });
+
+        heightmap_region const region{
+            raster_view<float const>{std::data(pixels), size},
+            raster_view<uint8_t const>{std::data(mask), size},
+            size,
+            corners_in_geo_coords{vec4_t{0.1f, 0.8f, 0.0f, 0.0f}, vec4_t{0.101f, 0.799f, 0.0f, 0.0f}},
+            6378137.0f,
+            6356752.0f
+        };
+
+        window_radius const radius{5, 3};
+        relief_histogram result{};
+        accumulate_local_relief(region, 0, 16, radius, result);
+        accumulate_local_relief(region, 16, h, radius, result);
+
+        relief_histogram expected{};
+        auto const longlat_delta = pixel_to_geo_coords(vec2u_t{1, 0}, region.size, region.domain)
+            - pixel_to_geo_coords(vec2u_t{0, 1}, region.size, region.domain);
+        for(size_t y = 0; y != h; ++y)
+        {
+            for(size_t x = 0; x != w; ++x)
+            {
+                auto const val = pixels[y*w + x];
+                if(mask[y*w + x] == 0 || !(val > 1.0f))
+                { continue; }
+
+                auto min = val;
+                auto max = val;
+                double n = 0.0;
+                double sum = 0.0;
+                double sum2 = 0.0;
+                for(auto y_w = y - std::min(y, radius.y); y_w != std::min(y + radius.y + 1, h); ++y_w)
+                {
+                    for(auto x_w = x - std::min(x, radius.x); x_w != std::min(x + radius.x + 1, w); ++x_w)
+                    {
+                        auto const z = pixels[y_w*w + x_w];
+                        if(z > 1.0f)
+                        {
+                            min = std::min(min, z);
+                            max = std::max(max, z);
+                            n += 1.0;
+                            sum += z;
+                            sum2 += static_cast<double>(z)*z;
+                        }
+                    }
+                }
+
+                auto const mean = sum/n;
+                auto const loc_long_lat = pixel_to_geo_coords(vec2u_t{x, y}, region.size, region.domain);
+                auto const scale_factors = nabla_factors(region.R_e, region.R_p, loc_long_lat)*longlat_delta;
+                auto const dA = static_cast<double>(scale_factors[0]*scale_factors[1]);
+                auto& item = expected[static_cast<size_t>(val/elev_hist_bucket_size)];
+                item.area += dA;
+                item.relief += dA*(max - min);
+                item.mean += dA*mean;
+                item.std_dev += dA*std::sqrt(std::max(sum2/n - mean*mean, 0.0));
+            }
+        }
+
+        for(size_t k = 0; k != std::size(result); ++k)
+        {
+            assert(close(result[k].area, expected[k].area));
+            assert(close(result[k].relief, expected[k].relief));
+            assert(close(result[k].mean, expected[k].mean));
+            assert(close(result[k].std_dev, expected[k].std_dev));
+        }
+    }
+}
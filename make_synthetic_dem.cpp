@@ -0,0 +1,68 @@
+//@	{"target":{"name":"make_synthetic_dem.o"}}
+
+#include "./synthetic_dem.hpp"
+#include "./cmdline.hpp"
+
+#include <cstdio>
+
+struct layout_name
+{
+	layout_name() = default;
+
+	explicit layout_name(std::string const& str):value{str}
+	{
+		if(str != "strip" && str != "tiled")
+		{ throw std::runtime_error{std::string{"Unsupported layout "}.append(str)}; }
+	}
+
+	std::string value{"tiled"};
+};
+
+struct compression_name
+{
+	compression_name() = default;
+
+	explicit compression_name(std::string const& str)
+	{
+		if(str == "none")
+		{ value = synthetic_compression::none; }
+		else
+		if(str == "lzw")
+		{ value = synthetic_compression::lzw; }
+		else
+		if(str == "deflate")
+		{ value = synthetic_compression::deflate; }
+		else
+		{ throw std::runtime_error{std::string{"Unsupported compression method "}.append(str)}; }
+	}
+
+	synthetic_compression value{synthetic_compression::none};
+};
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		fprintf(stderr, "Usage: make_synthetic_dem tif=output.tif [mask=mask.data] [width=4096] [height=4096] "
+			"[layout=tiled|strip] [tile_size=256] [rows_per_strip=1] [compression=none|lzw|deflate] [seed=0]\n");
+		return 1;
+	}
+
+	command_line const opts{argc, argv};
+
+	auto const width = get_or(opts, "width", value<size_t>{4096}).get();
+	auto const height = get_or(opts, "height", value<size_t>{4096}).get();
+	auto const tile_size = get_or(opts, "tile_size", value<size_t>{256}).get();
+	auto const rows_per_strip = get_or(opts, "rows_per_strip", value<uint32_t>{1}).get();
+
+	synthetic_dem_params params{};
+	params.size = image_size{vec2u_t{width, height}};
+	params.layout = get_or(opts, "layout", layout_name{}).value == "tiled" ?
+		image_layout{tile_info{vec2u_t{tile_size, tile_size}}}:
+		image_layout{strip_info{rows_per_strip}};
+	params.compression = get_or(opts, "compression", compression_name{}).value;
+	params.seed = get_or(opts, "seed", value<uint32_t>{}).get();
+
+	write_synthetic_dem(opts["tif"], get_or(opts, "mask", std::string{}), params);
+	return 0;
+}
@@ -0,0 +1,156 @@
+#ifndef MEMORY_PLAN_HPP
+#define MEMORY_PLAN_HPP
+
+#include "./region_loader.hpp"
+#include "./file.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <algorithm>
+
+/**
+ * How a region is loaded. whole_region loads all rows at once, mask_rows loads only the rows
+ * that are inside the mask, and streamed loads these rows one slab at a time.
+*/
+enum class load_strategy:int{whole_region, mask_rows, streamed};
+
+constexpr char const* to_string(load_strategy strategy)
+{
+	switch(strategy)
+	{
+		case load_strategy::whole_region:
+			return "whole_region";
+		case load_strategy::mask_rows:
+			return "mask_rows";
+		case load_strategy::streamed:
+			return "streamed";
+	}
+	return "unknown";
+}
+
+/**
+ * A load_strategy for a region of the given size. Only rows are processed, and they are loaded
+ * slab_height rows at a time.
+*/
+struct memory_plan
+{
+	image_size size;
+	load_strategy strategy;
+	row_range rows;
+	size_t slab_height;
+	size_t peak_bytes;
+};
+
+struct memory_plan_params
+{
+	/**
+	 * The number of bytes that the pixels and the mask of one region may use
+	*/
+	size_t budget;
+
+	size_t pixel_size;
+
+	/**
+	 * Rows are cropped, and split into slabs, at multiples of alignment, so that no chunk of
+	 * the analysis is split
+	*/
+	size_t alignment;
+
+	/**
+	 * True if the analysis processes rows independently, so that rows can be cropped and
+	 * streamed. Otherwise, the whole region is always loaded.
+	*/
+	bool rows_are_independent;
+
+	/**
+	 * The size of the band that rows are decoded into before they are stored, from
+	 * get_decode_buffer_bytes
+	*/
+	size_t decode_buffer_bytes{0};
+
+	/**
+	 * The number of bytes per pixel that the chunks running at the same time hold besides the
+	 * region, such as samples that are collected before they are reduced. A chunk covers
+	 * alignment rows.
+	*/
+	size_t chunk_bytes_per_pixel{0};
+};
+
+/**
+ * Returns the rows of a width by height mask that contain non-zero values, widened to multiples
+ * of alignment. The range is empty if the mask is empty.
+*/
+inline row_range get_mask_rows(std::string const& mask_name, size_t width, size_t height, size_t alignment)
+{
+	scoped_timer timer{"mask_scan", width*height};
+	file const src{mask_name, "rb"};
+	auto const row = std::make_unique_for_overwrite<uint8_t[]>(width);
+	row_range ret{height, 0};
+	for(size_t y = 0; y != height; ++y)
+	{
+		if(fread(row.get(), 1, width, src.get()) != width)
+		{ throw std::runtime_error{std::string{"Failed to read "}.append(mask_name)}; }
+
+		if(std::any_of(row.get(), row.get() + width, [](auto val){ return val != 0; }))
+		{
+			ret.begin = std::min(ret.begin, y);
+			ret.end = y + 1;
+		}
+	}
+
+	if(ret.end == 0)
+	{ return row_range{0, 0}; }
+	return row_range{ret.begin/alignment*alignment, std::min((ret.end + alignment - 1)/alignment*alignment, height)};
+}
+
+/**
+ * Picks the cheapest way to load a region within params.budget. Only TIFF headers are read,
+ * and the mask is only scanned if the whole region does not fit. If even one slab of
+ * params.alignment rows does not fit, such slabs are used anyway.
+*/
+inline memory_plan plan_memory(std::string const& tif_name, std::optional<std::string> const& mask_name,
+	memory_plan_params const& params)
+{
+	auto const size = get_input_size(tif_name);
+	auto const w = static_cast<size_t>(size.sizes[0]);
+	auto const h = static_cast<size_t>(size.sizes[1]);
+	auto const row_bytes = w*(params.pixel_size + (mask_name.has_value() ? sizeof(uint8_t) : 0));
+
+	// Temporary buffers do not depend on the number of rows that are loaded
+	auto const fixed_bytes = params.decode_buffer_bytes + std::min(params.alignment, h)*w*params.chunk_bytes_per_pixel;
+
+	// One halo row above and below the processed rows is loaded too
+	auto const get_peak_bytes = [row_bytes, h, fixed_bytes](size_t row_count){
+		return row_count == 0 ? 0 : std::min(row_count + 2, h)*row_bytes + fixed_bytes;
+	};
+
+	memory_plan const whole{size, load_strategy::whole_region, row_range{0, h}, h, h*row_bytes + fixed_bytes};
+	if(whole.peak_bytes <= params.budget || !params.rows_are_independent)
+	{ return whole; }
+
+	auto const rows = mask_name.has_value() ? get_mask_rows(*mask_name, w, h, params.alignment) : row_range{0, h};
+	if(get_peak_bytes(rows.size()) <= params.budget)
+	{ return memory_plan{size, load_strategy::mask_rows, rows, rows.size(), get_peak_bytes(rows.size())}; }
+
+	auto const fitting_rows = (params.budget - std::min(params.budget, fixed_bytes))/row_bytes;
+	auto const slab_height = std::max((fitting_rows > 2 ? fitting_rows - 2 : 0)/params.alignment*params.alignment,
+		params.alignment);
+	return memory_plan{size, load_strategy::streamed, rows, slab_height, get_peak_bytes(slab_height)};
+}
+
+inline void log_memory_plan(FILE* dest, std::string const& tif_name, memory_plan const& plan, size_t budget)
+{
+	fprintf(dest, "memory plan for %s: %s, rows [%zu, %zu), slab height %zu, estimated peak %.1f MiB of %.1f MiB%s\n",
+		tif_name.c_str(),
+		to_string(plan.strategy),
+		plan.rows.begin,
+		plan.rows.end,
+		plan.slab_height,
+		static_cast<double>(plan.peak_bytes)/(1024.0*1024.0),
+		static_cast<double>(budget)/(1024.0*1024.0),
+		plan.peak_bytes > budget ? " (over budget)" : "");
+}
+
+#endif
@@ -0,0 +1,142 @@
+//@	{"target":{"name":"merge_shards.o"}}
+
+#include "./analyses.hpp"
+
+#include <cstdio>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+
+using shardable_analyses = std::tuple<elev_hist_analysis,
+	slopedir_analysis,
+	local_relief_analysis,
+	grad_at_points_analysis,
+	peak_valley_elev_analysis>;
+
+struct shard_input
+{
+	std::string filename;
+	file src;
+	shard_header header;
+};
+
+/**
+ * Opens all shard files, and checks that they are the shards of one run, one file per shard.
+ * The result is sorted by shard index.
+*/
+std::vector<shard_input> open_shards(std::vector<char const*> const& filenames)
+{
+	std::vector<shard_input> ret;
+	for(auto item : filenames)
+	{
+		file src{item, "rb"};
+		auto header = read_shard_header(src.get());
+		ret.push_back(shard_input{item, std::move(src), std::move(header)});
+	}
+
+	if(ret.empty())
+	{ throw std::runtime_error{"No shard files given"}; }
+
+	std::ranges::sort(ret, [](auto const& a, auto const& b){ return a.header.index < b.header.index; });
+	auto const& first = ret.front().header;
+	if(std::size(ret) != first.count)
+	{
+		throw std::runtime_error{std::string{"Expected "}.append(std::to_string(first.count))
+			.append(" shards, got ").append(std::to_string(std::size(ret)))};
+	}
+
+	for(size_t k = 0; k != std::size(ret); ++k)
+	{
+		auto const& header = ret[k].header;
+		if(header.analysis != first.analysis || header.params != first.params
+			|| header.count != first.count || header.region_count != first.region_count)
+		{ throw std::runtime_error{ret[k].filename + " does not belong to the same run as " + ret.front().filename}; }
+
+		if(header.index != k)
+		{ throw std::runtime_error{std::string{"Shard "}.append(std::to_string(k)).append(" is missing")}; }
+	}
+	return ret;
+}
+
+/**
+ * Combines the chunks of each region, in chunk order, and merges the regions in input order, in
+ * the same way as a single run
+*/
+template<class Analysis>
+void merge_shards(std::vector<shard_input>& shards, Analysis& analysis)
+{
+	using partial_result = typename Analysis::partial_result;
+	auto const region_count = shards.front().header.region_count;
+	for(size_t r = 0; r != region_count; ++r)
+	{
+		partial_result region_result{};
+		std::string input;
+		uint64_t next_chunk = 0;
+		uint64_t chunk_count = 0;
+		for(auto& shard : shards)
+		{
+			auto region = read_shard_region<partial_result>(shard.src.get());
+			if(shard.header.index == 0)
+			{
+				input = region.input;
+				chunk_count = region.chunk_count;
+			}
+
+			if(region.input != input || region.chunk_count != chunk_count || region.first_chunk != next_chunk)
+			{ throw std::runtime_error{shard.filename + " has different chunks than the other shards"}; }
+
+			std::ranges::for_each(region.partials, [&region_result](auto& item){
+				Analysis::combine(region_result, std::move(item));
+			});
+			next_chunk += std::size(region.partials);
+		}
+
+		if(next_chunk != chunk_count)
+		{ throw std::runtime_error{std::string{"The shards do not cover all chunks of "}.append(input)}; }
+		analysis.merge(std::move(region_result));
+	}
+
+	std::string state;
+	read_binary(shards.front().src.get(), state);
+	restore_shard_state(analysis, state);
+}
+
+/**
+ * Merges the files written by an analyzer run with --shard and --shard_output, and writes the
+ * result to stdout, as the analyzer would have done
+*/
+int main(int argc, char** argv)
+{
+	auto const args = parse_analyzer_args(argc, argv);
+	configure_run_stats(args.options);
+	auto shards = open_shards(args.inputs);
+	auto const& analysis_name = shards.front().header.analysis;
+
+	auto found = false;
+	std::apply([&](auto ... item){
+		(..., [&]<class analysis_type>(analysis_type){
+			if(analysis_name != analysis_type::name)
+			{ return; }
+
+			found = true;
+			auto analysis = make_analysis<analysis_type>(args.options);
+			if constexpr(cacheable_analysis<analysis_type>)
+			{
+				// The partial results are only valid for the parameters they were computed with
+				auto const& params = shards.front().header.params;
+				if(!params.ends_with(std::string{","}.append(analysis.cache_params())))
+				{ throw std::runtime_error{"The shards were written with other analysis parameters: " + params}; }
+			}
+			merge_shards(shards, analysis);
+			analysis.write(stdout, get_or(args.options, "output_format", table_format_option{}).value);
+		}(item));
+	}, shardable_analyses{});
+
+	if(!found)
+	{ throw std::runtime_error{std::string{"Unsupported analysis "}.append(analysis_name)}; }
+
+	write_stats_report(args.options);
+	return 0;
+}
@@ -0,0 +1,238 @@
+#ifndef MOSAIC_HPP
+#define MOSAIC_HPP
+
+#include "./geotiff_loader.hpp"
+#include "./file.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * A mosaic is given as a text file with the extension .mosaic, that lists one GeoTIFF per line.
+ * Empty lines, and lines starting with #, are skipped. Relative paths are relative to the
+ * directory of the list.
+*/
+inline bool is_mosaic(std::string_view name)
+{ return name.ends_with(".mosaic"); }
+
+inline std::vector<std::string> read_mosaic_list(std::string const& list_name)
+{
+	auto const i = list_name.rfind('/');
+	auto const dir = i == std::string::npos ? std::string{} : list_name.substr(0, i + 1);
+
+	file const src{list_name, "rb"};
+	std::vector<std::string> ret;
+	std::string line;
+	auto const add_line = [&ret, &line, &dir](){
+		if(!line.empty() && line.front() != '#')
+		{ ret.push_back(line.front() == '/' ? line : dir + line); }
+		line.clear();
+	};
+
+	while(true)
+	{
+		auto const ch_in = getc(src.get());
+		if(ch_in == EOF)
+		{
+			add_line();
+			break;
+		}
+
+		if(ch_in == '\n')
+		{ add_line(); }
+		else
+		if(ch_in != '\r')
+		{ line.push_back(static_cast<char>(ch_in)); }
+	}
+
+	if(ret.empty())
+	{ throw std::runtime_error{std::string{"No tiles listed in "}.append(list_name)}; }
+	return ret;
+}
+
+/**
+ * A GeoTIFF of a mosaic, and where its first pixel is in the mosaic
+*/
+struct mosaic_tile
+{
+	std::string name;
+	image_info info;
+	size_t x_offset;
+	size_t y_offset;
+};
+
+/**
+ * Places GeoTIFFs that share the same pixel grid and ellipsoid in one raster, by their
+ * geographic extent. Only the headers of the tiles are read. Pixels that are not covered by any
+ * tile are zero, which analyses treat as missing data. Where tiles overlap, the tile listed last
+ * is used.
+*/
+struct mosaic_index
+{
+	image_info info;
+	corners_in_geo_coords domain;
+	float R_e;
+	float R_p;
+	std::vector<mosaic_tile> tiles;
+};
+
+inline mosaic_index make_mosaic_index(std::string const& list_name)
+{
+	scoped_timer timer{"mosaic_index"};
+	struct tile_header
+	{
+		std::string name;
+		image_info info;
+		corners_in_geo_coords domain;
+	};
+
+	mosaic_index ret{};
+	std::vector<tile_header> headers;
+	for(auto& name : read_mosaic_list(list_name))
+	{
+		auto tiff = make_tiff(name.c_str());
+		auto gtif = make_gtif(tiff.get());
+		auto const info = get_image_info(tiff.get());
+		auto const defn = get_defn(gtif.get());
+		auto const R_e = static_cast<float>(defn->SemiMajor);
+		auto const R_p = static_cast<float>(defn->SemiMinor);
+		if(headers.empty())
+		{
+			ret.info = info;
+			ret.R_e = R_e;
+			ret.R_p = R_p;
+		}
+		else
+		if(R_e != ret.R_e || R_p != ret.R_p)
+		{ throw std::runtime_error{name + " does not use the same ellipsoid as " + headers.front().name}; }
+
+		auto const domain = get_domain(gtif.get(), *defn, info.size);
+		headers.push_back(tile_header{std::move(name), info, domain});
+	}
+
+	// The size of a pixel, in radians. It is negative along an axis where the geographic
+	// coordinate decreases with the pixel index, as latitude usually does.
+	auto const& first = headers.front();
+	std::array<double, 2> pixel_size{};
+	std::array<double, 2> origin{};
+	for(size_t k = 0; k != 2; ++k)
+	{
+		pixel_size[k] = (static_cast<double>(first.domain.max[k]) - static_cast<double>(first.domain.min[k]))
+			/static_cast<double>(first.info.size.sizes[k]);
+		origin[k] = static_cast<double>(first.domain.min[k]);
+	}
+
+	for(auto const& item : headers)
+	{
+		for(size_t k = 0; k != 2; ++k)
+		{
+			auto const size = (static_cast<double>(item.domain.max[k]) - static_cast<double>(item.domain.min[k]))
+				/static_cast<double>(item.info.size.sizes[k]);
+			if(std::abs(size - pixel_size[k]) > 1.0e-3*std::abs(pixel_size[k]))
+			{ throw std::runtime_error{item.name + " does not have the same pixel size as " + first.name}; }
+
+			auto const start = static_cast<double>(item.domain.min[k]);
+			origin[k] = pixel_size[k] > 0.0 ? std::min(origin[k], start) : std::max(origin[k], start);
+		}
+	}
+
+	// The corners of the mosaic are taken from the tiles that reach them, so a mosaic of one
+	// tile has the same domain as the tile
+	std::array<size_t, 2> size{};
+	ret.domain = corners_in_geo_coords{first.domain.min, first.domain.max};
+	for(auto& item : headers)
+	{
+		std::array<size_t, 2> offset{};
+		for(size_t k = 0; k != 2; ++k)
+		{
+			auto const pixels = (static_cast<double>(item.domain.min[k]) - origin[k])/pixel_size[k];
+			if(std::abs(pixels - std::round(pixels)) > 0.25)
+			{ throw std::runtime_error{item.name + " is not aligned to the pixels of " + first.name}; }
+
+			offset[k] = static_cast<size_t>(std::round(pixels));
+			if(offset[k] == 0)
+			{ ret.domain.min[k] = item.domain.min[k]; }
+
+			auto const end = offset[k] + static_cast<size_t>(item.info.size.sizes[k]);
+			if(end >= size[k])
+			{
+				size[k] = end;
+				ret.domain.max[k] = item.domain.max[k];
+			}
+		}
+		ret.tiles.push_back(mosaic_tile{std::move(item.name), item.info, offset[0], offset[1]});
+	}
+
+	ret.info.size = image_size{vec2u_t{size[0], size[1]}};
+	return ret;
+}
+
+/**
+ * Reads rows of a mosaic. A tile is opened the first time any of its rows is read, and only the
+ * rows of the tile that are requested are decoded. Since rows are read from the top, a tile is
+ * closed once its last row has been read, so only the tiles of about one row of the mosaic are
+ * open at a time. A tile that is read again is reopened.
+*/
+class mosaic_reader
+{
+public:
+	explicit mosaic_reader(mosaic_index const& index):
+		m_index{index},
+		m_handles(std::size(index.tiles)),
+		m_opened(std::size(index.tiles))
+	{}
+
+	void operator()(float* buffer, size_t first_row, size_t row_count)
+	{
+		auto const w = static_cast<size_t>(m_index.info.size.sizes[0]);
+		std::fill_n(buffer, w*row_count, 0.0f);
+		for(size_t k = 0; k != std::size(m_index.tiles); ++k)
+		{
+			auto const& tile = m_index.tiles[k];
+			auto const tile_w = static_cast<size_t>(tile.info.size.sizes[0]);
+			auto const tile_h = static_cast<size_t>(tile.info.size.sizes[1]);
+			auto const begin = std::max(first_row, tile.y_offset);
+			auto const end = std::min(first_row + row_count, tile.y_offset + tile_h);
+			if(begin >= end)
+			{ continue; }
+
+			if(m_handles[k] == nullptr)
+			{
+				m_handles[k] = make_tiff(tile.name.c_str());
+				m_opened[k] = true;
+			}
+
+			m_band.resize(tile_w*(end - begin));
+			load_rows(m_handles[k].get(), tile.info, std::data(m_band), begin - tile.y_offset, end - begin);
+			for(size_t y = begin; y != end; ++y)
+			{
+				std::copy_n(std::data(m_band) + (y - begin)*tile_w, tile_w,
+					buffer + (y - first_row)*w + tile.x_offset);
+			}
+
+			if(end == tile.y_offset + tile_h)
+			{ m_handles[k].reset(); }
+		}
+	}
+
+	/**
+	 * Returns the number of tiles that have been opened so far
+	*/
+	size_t opened_tile_count() const
+	{ return static_cast<size_t>(std::ranges::count(m_opened, true)); }
+
+private:
+	mosaic_index const& m_index;
+	std::vector<std::unique_ptr<TIFF, tiff_releaser>> m_handles;
+	std::vector<bool> m_opened;
+	std::vector<float> m_band;
+};
+
+#endif
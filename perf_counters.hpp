@@ -0,0 +1,165 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+enum class perf_counter:size_t{cycles, instructions, llc_misses, branch_misses};
+
+constexpr size_t perf_counter_count = 4;
+
+constexpr std::array<char const*, perf_counter_count> perf_counter_names{
+	"cycles",
+	"instructions",
+	"llc_misses",
+	"branch_misses"
+};
+
+struct perf_counter_values
+{
+	std::array<uint64_t, perf_counter_count> values{};
+	std::array<bool, perf_counter_count> available{};
+
+	uint64_t operator[](perf_counter counter) const
+	{ return values[static_cast<size_t>(counter)]; }
+
+	bool has(perf_counter counter) const
+	{ return available[static_cast<size_t>(counter)]; }
+
+	perf_counter_values& operator+=(perf_counter_values const& other)
+	{
+		for(size_t k = 0; k != perf_counter_count; ++k)
+		{
+			values[k] += other.values[k];
+			available[k] = available[k] || other.available[k];
+		}
+		return *this;
+	}
+};
+
+inline perf_counter_values operator-(perf_counter_values const& a, perf_counter_values const& b)
+{
+	perf_counter_values ret{};
+	for(size_t k = 0; k != perf_counter_count; ++k)
+	{
+		ret.values[k] = a.values[k] - b.values[k];
+		ret.available[k] = a.available[k] && b.available[k];
+	}
+	return ret;
+}
+
+/**
+ * A group of hardware counters that counts user-space events in the calling thread. Counters
+ * that cannot be opened, because the PMU does not support them or because of
+ * perf_event_paranoid, are left out. If no counter can be opened, the group is invalid.
+*/
+class perf_counter_group
+{
+public:
+	perf_counter_group():m_fds{-1, -1, -1, -1}, m_order{}, m_open_count{0}
+	{
+		constexpr std::array<uint64_t, perf_counter_count> configs{
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES
+		};
+
+		for(size_t k = 0; k != perf_counter_count; ++k)
+		{
+			perf_event_attr attr{};
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.size = sizeof(attr);
+			attr.config = configs[k];
+			attr.read_format = PERF_FORMAT_GROUP;
+			attr.disabled = m_open_count == 0 ? 1 : 0;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+
+			auto const leader = m_open_count == 0 ? -1 : m_fds[m_order[0]];
+			auto const fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+			if(fd == -1)
+			{
+				m_error = errno;
+				continue;
+			}
+
+			m_fds[k] = fd;
+			m_order[m_open_count] = k;
+			++m_open_count;
+		}
+
+		if(m_open_count != 0)
+		{
+			auto const leader = m_fds[m_order[0]];
+			ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+	}
+
+	perf_counter_group(perf_counter_group const&) = delete;
+	perf_counter_group& operator=(perf_counter_group const&) = delete;
+
+	~perf_counter_group()
+	{
+		for(auto fd : m_fds)
+		{
+			if(fd != -1)
+			{ close(fd); }
+		}
+	}
+
+	bool valid() const
+	{ return m_open_count != 0; }
+
+	/**
+	 * Returns the errno of the last counter that failed to open, or 0 if all counters were opened
+	*/
+	int error() const
+	{ return m_error; }
+
+	std::optional<perf_counter_values> read() const
+	{
+		if(!valid())
+		{ return std::nullopt; }
+
+		std::array<uint64_t, perf_counter_count + 1> buffer{};
+		auto const n = ::read(m_fds[m_order[0]], std::data(buffer), sizeof(buffer));
+		if(n < static_cast<ssize_t>(sizeof(uint64_t)*(m_open_count + 1)))
+		{ return std::nullopt; }
+
+		perf_counter_values ret{};
+		for(size_t k = 0; k != m_open_count; ++k)
+		{
+			ret.values[m_order[k]] = buffer[k + 1];
+			ret.available[m_order[k]] = true;
+		}
+		return ret;
+	}
+
+private:
+	std::array<int, perf_counter_count> m_fds;
+	std::array<size_t, perf_counter_count> m_order;
+	size_t m_open_count;
+	int m_error{0};
+};
+
+/**
+ * Returns the counter group for the calling thread. The group is opened on first use.
+*/
+inline perf_counter_group const& get_thread_perf_counters()
+{
+	thread_local perf_counter_group counters;
+	return counters;
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef PIXEL_SAMPLING_HPP
+#define PIXEL_SAMPLING_HPP
+
+#include "./types.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+
+/**
+ * Selects a fraction of the pixels of each stratum, which is a rectangle of rows and columns.
+ * The stratum is split into cells of 1/fraction consecutive pixels, in row-major order, and one
+ * pixel is picked at random within each cell. Every pixel is thus picked fraction times on
+ * average, and weighting each sample by 1/fraction gives unbiased sums. With a fraction of 1,
+ * all pixels are visited once, and weight is exactly 1.
+*/
+struct pixel_sample
+{
+	double fraction{1.0};
+	uint64_t seed{0};
+
+	bool is_complete() const
+	{ return !(fraction < 1.0); }
+
+	double weight() const
+	{ return is_complete() ? 1.0 : 1.0/fraction; }
+};
+
+/**
+ * The fraction of pixels to sample, given as a number in (0, 1]
+*/
+struct sample_fraction_option
+{
+	sample_fraction_option() = default;
+
+	explicit sample_fraction_option(std::string const& str):
+		value{std::stod(str)}
+	{
+		if(!(value > 0.0 && value <= 1.0))
+		{ throw std::runtime_error{std::string{"Sample fraction must be in (0, 1], got "}.append(str)}; }
+	}
+
+	double value{1.0};
+};
+
+/**
+ * One step of the SplitMix64 generator. Nesting it hashes several values into a seed, so each
+ * stratum gets its own random sequence without any costly seeding.
+*/
+constexpr uint64_t splitmix64(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15;
+	x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9;
+	x = (x ^ (x >> 27))*0x94d049bb133111eb;
+	return x ^ (x >> 31);
+}
+
+/**
+ * Calls f with the location of every pixel of rows and columns that sample picks, in row-major
+ * order. The pixels picked only depend on the sample and on the first row and column of the
+ * stratum, so they do not depend on the order in which strata are visited.
+*/
+template<class Func>
+void for_each_sampled_pixel(pixel_sample const& sample, row_range rows, column_range columns, Func&& f)
+{
+	if(rows.begin >= rows.end || columns.begin >= columns.end)
+	{ return; }
+
+	if(sample.is_complete())
+	{
+		vec2u_t loc{0, rows.begin};
+		for(; loc[1] < rows.end; loc+=vec2u_t{0, 1})
+		{
+			for(loc[0] = columns.begin; loc[0] < columns.end; loc+=vec2u_t{1, 0})
+			{ f(loc); }
+		}
+		return;
+	}
+
+	auto const width = columns.end - columns.begin;
+	auto const pixel_count = rows.size()*width;
+	auto const cell_size = 1.0/sample.fraction;
+	auto const cell_count = static_cast<size_t>(std::ceil(static_cast<double>(pixel_count)*sample.fraction));
+	auto state = splitmix64(splitmix64(splitmix64(sample.seed) ^ rows.begin) ^ columns.begin);
+	for(size_t k = 0; k != cell_count; ++k)
+	{
+		state = splitmix64(state);
+		auto const u = static_cast<double>(state >> 11)*0x1.0p-53;
+		auto const index = static_cast<size_t>((static_cast<double>(k) + u)*cell_size);
+		if(index < pixel_count)
+		{ f(vec2u_t{columns.begin + index%width, rows.begin + index/width}); }
+	}
+}
+
+#endif
@@ -0,0 +1,44 @@
+//@{"target":{"name":"pixel_sampling.test"}}
+
+#include "./pixel_sampling.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+int main()
+{
+    {
+        std::vector<vec2u_t> visited;
+        for_each_sampled_pixel(pixel_sample{}, row_range{3, 5}, column_range{1, 4}, [&visited](vec2u_t loc){
+            visited.push_back(loc);
+        });
+
+        assert(std::size(visited) == 6);
+        assert(visited[0][0] == 1 && visited[0][1] == 3);
+        assert(visited[5][0] == 3 && visited[5][1] == 4);
+    }
+
+    {
+        row_range const rows{64, 128};
+        column_range const columns{256, 512};
+        pixel_sample const sample{0.125, 7};
+        std::vector<vec2u_t> visited;
+        for_each_sampled_pixel(sample, rows, columns, [&visited](vec2u_t loc){
+            assert(loc[0] >= 256 && loc[0] < 512);
+            assert(loc[1] >= 64 && loc[1] < 128);
+            visited.push_back(loc);
+        });
+
+        // One pixel per cell of 8 pixels, in row-major order
+        assert(std::size(visited) == 64*256/8);
+        assert(std::ranges::is_sorted(visited, [](auto a, auto b){
+            return a[1] != b[1] ? a[1] < b[1] : a[0] < b[0];
+        }));
+        assert(sample.weight() == 8.0);
+
+        std::vector<vec2u_t> again;
+        for_each_sampled_pixel(sample, rows, columns, [&again](vec2u_t loc){ again.push_back(loc); });
+        assert(std::ranges::equal(visited, again, [](auto a, auto b){ return a[0] == b[0] && a[1] == b[1]; }));
+    }
+}
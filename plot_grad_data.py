@@ -109,8 +109,13 @@ def plot(val):
 		y = val(x)
 		return plt.plot(x, y,label=val.name)
 
+def load_table(filename):
+	if filename.endswith('.npy'):
+		return numpy.load(filename, mmap_mode='r')
+	return numpy.loadtxt(filename)
+
 def load(filename):
-	data = numpy.loadtxt(filename)
+	data = load_table(filename)
 	peak = numpy.argmax(data, axis = 0)
 	data = numpy.transpose(data);
 	return DataSeries(os.path.basename(filename).split('.')[0], peak[0], data)
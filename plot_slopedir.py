@@ -28,8 +28,13 @@ def plot(val):
 		y = val(x)
 		return plt.plot(x, y,label=val.name)
 
+def load_table(filename):
+	if filename.endswith('.npy'):
+		return numpy.load(filename, mmap_mode='r')
+	return numpy.loadtxt(filename)
+
 def load(filename, name):
-	data = numpy.loadtxt(filename)
+	data = load_table(filename)
 	peak = numpy.argmax(data, axis = 0)
 	data = numpy.transpose(data);
 	return DataSeries(name, peak[0], data)
@@ -0,0 +1,308 @@
+#ifndef PROGRESS_HPP
+#define PROGRESS_HPP
+
+#include "./cmdline.hpp"
+#include "./stats.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct progress_snapshot
+{
+	std::string region;
+	size_t region_index;
+	size_t region_count;
+	size_t active_count;
+	size_t done;
+	size_t total;
+	char const* unit;
+	double region_seconds;
+	double total_seconds;
+};
+
+class progress_counter;
+
+/**
+ * Progress of one region. The hot loops only touch done, through a relaxed atomic add, so they
+ * are never blocked by the reporter.
+*/
+class region_progress
+{
+public:
+	explicit region_progress(std::string name, size_t index):
+		m_name{std::move(name)},
+		m_index{index},
+		m_done{0},
+		m_total{0},
+		m_unit{"pixels"},
+		m_start{std::chrono::steady_clock::now()}
+	{}
+
+	void advance(size_t n)
+	{ m_done.fetch_add(n, std::memory_order_relaxed); }
+
+private:
+	friend class progress_counter;
+
+	std::string m_name;
+	size_t m_index;
+	std::atomic<size_t> m_done;
+	std::atomic<size_t> m_total;
+	char const* m_unit;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+/**
+ * Tracks the progress of each region separately, so regions whose chunks run at the same time
+ * do not mix. A region stays active as long as someone holds the handle returned by
+ * begin_region. Snapshots show the oldest active region, which is the next one to finish.
+*/
+class progress_counter
+{
+public:
+	progress_counter():
+		m_region_index{0},
+		m_region_count{0},
+		m_start{std::chrono::steady_clock::now()}
+	{}
+
+	void set_region_count(size_t n)
+	{ m_region_count.store(n, std::memory_order_relaxed); }
+
+	/**
+	 * Adds total units of work to region name, and returns its handle. The region is started
+	 * if it is not active. Use a total of zero while the amount of work is still unknown, for
+	 * example while the region is being loaded.
+	*/
+	std::shared_ptr<region_progress> begin_region(std::string_view name, size_t total = 0,
+		char const* unit = "pixels")
+	{
+		std::lock_guard lock{m_mutex};
+		std::erase_if(m_regions, [](auto const& item){ return item.expired(); });
+		auto ret = [this, name](){
+			for(auto const& item : m_regions)
+			{
+				if(auto region = item.lock(); region != nullptr && region->m_name == name)
+				{ return region; }
+			}
+			auto region = std::make_shared<region_progress>(std::string{name},
+				m_region_index.fetch_add(1, std::memory_order_relaxed) + 1);
+			m_regions.push_back(region);
+			return region;
+		}();
+
+		if(total != 0)
+		{
+			if(ret->m_total.load(std::memory_order_relaxed) == 0)
+			{ ret->m_start = std::chrono::steady_clock::now(); }
+			ret->m_unit = unit;
+			ret->m_total.fetch_add(total, std::memory_order_relaxed);
+		}
+		m_last = ret;
+		return ret;
+	}
+
+	progress_snapshot get_snapshot() const
+	{
+		auto const now = std::chrono::steady_clock::now();
+		std::lock_guard lock{m_mutex};
+		size_t active_count = 0;
+		std::shared_ptr<region_progress const> oldest;
+		for(auto const& item : m_regions)
+		{
+			// The references held here, and by m_last, do not keep a region active
+			if(auto region = item.lock(); region != nullptr && region.use_count() > (region == m_last ? 2 : 1))
+			{
+				++active_count;
+				if(oldest == nullptr)
+				{ oldest = region; }
+			}
+		}
+		if(oldest == nullptr)
+		{ oldest = m_last; }
+
+		if(oldest == nullptr)
+		{
+			return progress_snapshot{std::string{}, 0, m_region_count.load(std::memory_order_relaxed), 0, 0, 0,
+				"pixels", 0.0, std::chrono::duration<double>(now - m_start).count()};
+		}
+
+		return progress_snapshot{
+			oldest->m_name,
+			oldest->m_index,
+			m_region_count.load(std::memory_order_relaxed),
+			active_count,
+			oldest->m_done.load(std::memory_order_relaxed),
+			oldest->m_total.load(std::memory_order_relaxed),
+			oldest->m_unit,
+			std::chrono::duration<double>(now - oldest->m_start).count(),
+			std::chrono::duration<double>(now - m_start).count()
+		};
+	}
+
+private:
+	std::atomic<size_t> m_region_index;
+	std::atomic<size_t> m_region_count;
+
+	mutable std::mutex m_mutex;
+	std::vector<std::weak_ptr<region_progress>> m_regions;
+	std::shared_ptr<region_progress> m_last;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+inline progress_counter& get_progress()
+{
+	static progress_counter progress;
+	return progress;
+}
+
+inline std::string format_duration(double seconds)
+{
+	auto const s = static_cast<size_t>(std::max(seconds, 0.0));
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%zu:%02zu:%02zu", s/3600, (s/60)%60, s%60);
+	return buffer;
+}
+
+/**
+ * Returns the estimated time left of the oldest active region, or a negative value if there is
+ * not enough data yet
+*/
+inline double get_eta(progress_snapshot const& snapshot)
+{
+	if(snapshot.done == 0 || snapshot.total == 0)
+	{ return -1.0; }
+
+	auto const rate = static_cast<double>(snapshot.done)/snapshot.region_seconds;
+	return static_cast<double>(snapshot.total - std::min(snapshot.done, snapshot.total))/rate;
+}
+
+inline void write_progress_line(FILE* dest, progress_snapshot const& snapshot)
+{
+	fprintf(dest, "progress: region %zu/%zu %s", snapshot.region_index, snapshot.region_count,
+		snapshot.region.c_str());
+	if(snapshot.active_count > 1)
+	{ fprintf(dest, " (%zu more active)", snapshot.active_count - 1); }
+	if(snapshot.total == 0)
+	{
+		fprintf(dest, ": loading, elapsed %s\n", format_duration(snapshot.total_seconds).c_str());
+		return;
+	}
+
+	auto const eta = get_eta(snapshot);
+	fprintf(dest, ": %zu/%zu %s (%.1f%%), elapsed %s, eta %s\n",
+		snapshot.done,
+		snapshot.total,
+		snapshot.unit,
+		100.0*static_cast<double>(std::min(snapshot.done, snapshot.total))/static_cast<double>(snapshot.total),
+		format_duration(snapshot.total_seconds).c_str(),
+		eta < 0.0 ? "unknown" : format_duration(eta).c_str());
+}
+
+inline void write_progress_json(FILE* dest, progress_snapshot const& snapshot)
+{
+	fputs("{\"region\": ", dest);
+	write_json_string(dest, snapshot.region);
+	fprintf(dest, ", \"region_index\": %zu, \"region_count\": %zu, \"active_regions\": %zu, "
+		"\"done\": %zu, \"total\": %zu, "
+		"\"unit\": \"%s\", \"region_seconds\": %.3f, \"total_seconds\": %.3f, \"eta_seconds\": %.3f}\n",
+		snapshot.region_index,
+		snapshot.region_count,
+		snapshot.active_count,
+		snapshot.done,
+		snapshot.total,
+		snapshot.unit,
+		snapshot.region_seconds,
+		snapshot.total_seconds,
+		get_eta(snapshot));
+}
+
+/**
+ * Publishes the global progress every interval from a background thread, until destroyed.
+ * If status_file is empty, a line is written to stderr. Otherwise status_file is replaced
+ * with a JSON object, through a rename so a reader never sees a partial file.
+*/
+class progress_reporter
+{
+public:
+	explicit progress_reporter(std::string status_file, std::chrono::milliseconds interval):
+		m_status_file{std::move(status_file)},
+		m_interval{interval},
+		m_stop{false},
+		m_thread{[this](){ run(); }}
+	{}
+
+	progress_reporter(progress_reporter const&) = delete;
+	progress_reporter& operator=(progress_reporter const&) = delete;
+
+	~progress_reporter()
+	{
+		{
+			std::lock_guard lock{m_mutex};
+			m_stop = true;
+		}
+		m_cv.notify_one();
+		m_thread.join();
+		publish();
+	}
+
+private:
+	void run()
+	{
+		std::unique_lock lock{m_mutex};
+		while(!m_cv.wait_for(lock, m_interval, [this](){ return m_stop; }))
+		{ publish(); }
+	}
+
+	void publish() const
+	{
+		auto const snapshot = get_progress().get_snapshot();
+		if(m_status_file.empty())
+		{
+			write_progress_line(stderr, snapshot);
+			return;
+		}
+
+		auto const tmp_name = std::string{m_status_file}.append(".tmp");
+		auto const dest = fopen(tmp_name.c_str(), "wb");
+		if(dest == nullptr)
+		{ return; }
+		write_progress_json(dest, snapshot);
+		fclose(dest);
+		rename(tmp_name.c_str(), m_status_file.c_str());
+	}
+
+	std::string m_status_file;
+	std::chrono::milliseconds m_interval;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_stop;
+	std::thread m_thread;
+};
+
+/**
+ * Starts a reporter according to --progress=none|stderr|<status file> and
+ * --progress_interval=<seconds>. Returns nullptr if progress reporting is disabled.
+*/
+inline std::unique_ptr<progress_reporter> make_progress_reporter(command_line const& options,
+	size_t region_count)
+{
+	get_progress().set_region_count(region_count);
+	auto const dest = get_or(options, "progress", std::string{"none"});
+	if(dest == "none")
+	{ return nullptr; }
+
+	auto const interval = std::max(get_or(options, "progress_interval", value<size_t>{10}).get(), size_t{1});
+	return std::make_unique<progress_reporter>(dest == "stderr" ? std::string{} : dest,
+		std::chrono::milliseconds{1000*interval});
+}
+
+#endif
@@ -0,0 +1,8 @@
+//@	{"target":{"name":"prominence.o"}}
+
+#include "./analyses.hpp"
+
+int main(int argc, char** argv)
+{
+	return run_analyzer<prominence_analysis>(argc, argv);
+}
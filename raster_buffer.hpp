@@ -0,0 +1,255 @@
+#ifndef RASTER_BUFFER_HPP
+#define RASTER_BUFFER_HPP
+
+#include "./types.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+enum class huge_page_mode:int{none, transparent, explicit_pages};
+
+struct huge_page_mode_option
+{
+	huge_page_mode_option() = default;
+
+	explicit huge_page_mode_option(std::string const& str)
+	{
+		if(str == "none")
+		{ value = huge_page_mode::none; }
+		else
+		if(str == "transparent")
+		{ value = huge_page_mode::transparent; }
+		else
+		if(str == "explicit")
+		{ value = huge_page_mode::explicit_pages; }
+		else
+		{ throw std::runtime_error{std::string{"Unsupported huge page mode "}.append(str)}; }
+	}
+
+	huge_page_mode value{huge_page_mode::transparent};
+};
+
+constexpr size_t huge_page_size = size_t{1} << 21;
+
+struct mapping_deleter
+{
+	size_t size;
+
+	void operator()(void* ptr) const
+	{
+		if(ptr != nullptr)
+		{ munmap(ptr, size); }
+	}
+};
+
+/**
+ * Maps size bytes of anonymous memory, aligned to huge_page_size. The memory is not touched,
+ * so no page is allocated until it is first written. With explicit_pages, pages are taken from
+ * the hugetlbfs pool if possible, and transparent huge pages are used otherwise. The fallback is
+ * reported on stderr the first time it happens.
+*/
+inline std::unique_ptr<void, mapping_deleter> map_raster_memory(size_t size, huge_page_mode mode)
+{
+	auto const mapped_size = (size + huge_page_size - 1)/huge_page_size*huge_page_size;
+	if(mode == huge_page_mode::explicit_pages)
+	{
+		// Without MAP_NORESERVE, mmap fails up front if the pool is too small, instead of
+		// raising SIGBUS on first touch
+		auto const ptr = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(ptr != MAP_FAILED)
+		{ return std::unique_ptr<void, mapping_deleter>{ptr, mapping_deleter{mapped_size}}; }
+
+		static std::atomic<bool> warned{false};
+		if(!warned.exchange(true, std::memory_order_relaxed))
+		{ fputs("Explicit huge pages are unavailable, using transparent huge pages\n", stderr); }
+		mode = huge_page_mode::transparent;
+	}
+
+	// Over-allocate, and trim the ends, so the start is aligned to a huge page
+	auto const padded_size = mapped_size + huge_page_size;
+	auto const ptr = mmap(nullptr, padded_size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(ptr == MAP_FAILED)
+	{ throw std::runtime_error{"Failed to allocate raster memory"}; }
+
+	auto const base = reinterpret_cast<uintptr_t>(ptr);
+	auto const aligned = (base + huge_page_size - 1)/huge_page_size*huge_page_size;
+	if(aligned != base)
+	{ munmap(ptr, aligned - base); }
+	auto const tail = base + padded_size - (aligned + mapped_size);
+	if(tail != 0)
+	{ munmap(reinterpret_cast<void*>(aligned + mapped_size), tail); }
+
+	if(mode == huge_page_mode::transparent)
+	{ madvise(reinterpret_cast<void*>(aligned), mapped_size, MADV_HUGEPAGE); }
+
+	return std::unique_ptr<void, mapping_deleter>{reinterpret_cast<void*>(aligned), mapping_deleter{mapped_size}};
+}
+
+/**
+ * An array of n elements of T, that are left uninitialized. T must be trivially
+ * default-constructible.
+*/
+template<class T>
+class raster_buffer
+{
+public:
+	static_assert(std::is_trivially_default_constructible_v<T> && std::is_trivially_destructible_v<T>);
+
+	raster_buffer() = default;
+
+	explicit raster_buffer(size_t n, huge_page_mode mode = huge_page_mode::transparent):
+		m_size{n},
+		m_memory{n == 0 ? nullptr : map_raster_memory(n*sizeof(T), mode)}
+	{}
+
+	T* get() const
+	{ return static_cast<T*>(m_memory.get()); }
+
+	size_t size() const
+	{ return m_size; }
+
+	T& operator[](size_t k) const
+	{ return get()[k]; }
+
+private:
+	size_t m_size{0};
+	std::unique_ptr<void, mapping_deleter> m_memory{nullptr, mapping_deleter{0}};
+};
+
+/**
+ * A raster that owns its pixels. The pixels are left uninitialized.
+*/
+template<class T>
+class raster
+{
+public:
+	using value_type = T;
+
+	raster() = default;
+
+	explicit raster(image_size size, raster_layout layout = raster_layout::row_major(),
+		huge_page_mode mode = huge_page_mode::transparent):
+		m_size{size},
+		m_layout{layout},
+		m_buffer{get_storage_size(size, layout), mode}
+	{}
+
+	raster_view<T> view()
+	{ return raster_view<T>{m_buffer.get(), m_size, get_row_stride(m_size.sizes[0], m_layout), m_layout}; }
+
+	raster_view<T const> view() const
+	{ return raster_view<T const>{m_buffer.get(), m_size, get_row_stride(m_size.sizes[0], m_layout), m_layout}; }
+
+	/**
+	 * Returns the underlying storage. Pixels are only stored row-major, without padding, if
+	 * layout() is row-major.
+	*/
+	T* data() const
+	{ return m_buffer.get(); }
+
+	size_t storage_size() const
+	{ return m_buffer.size(); }
+
+	image_size size() const
+	{ return m_size; }
+
+	raster_layout layout() const
+	{ return m_layout; }
+
+private:
+	image_size m_size{vec2u_t{0, 0}};
+	raster_layout m_layout{};
+	raster_buffer<T> m_buffer;
+};
+
+/**
+ * Pins the calling thread to the k:th CPU it is allowed to run on, counted modulo the number
+ * of allowed CPUs
+*/
+inline void pin_current_thread(size_t k)
+{
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+	{ return; }
+
+	auto const cpu_count = static_cast<size_t>(CPU_COUNT(&allowed));
+	if(cpu_count == 0)
+	{ return; }
+
+	auto n = k%cpu_count;
+	for(int cpu = 0; cpu != CPU_SETSIZE; ++cpu)
+	{
+		if(!CPU_ISSET(cpu, &allowed))
+		{ continue; }
+
+		if(n == 0)
+		{
+			cpu_set_t selected;
+			CPU_ZERO(&selected);
+			CPU_SET(cpu, &selected);
+			sched_setaffinity(0, sizeof(selected), &selected);
+			return;
+		}
+		--n;
+	}
+}
+
+/**
+ * Touches all pages of rows [0, row_count) of a buffer, with row_size bytes per row, from
+ * thread_count threads. The rows are split into bands of band_height rows, and thread k touches
+ * the same slice of bands that work_stealing_pool::submit gives to worker k of a pinned pool.
+ * If pin is true, thread k runs on the same CPU as that worker, so on a NUMA machine each band
+ * is allocated on the node that will process it. Without pinning, there is no such locality.
+*/
+inline void first_touch(void* buffer, size_t row_size, size_t row_count, size_t band_height,
+	size_t thread_count, bool pin)
+{
+	auto const band_count = (row_count + band_height - 1)/band_height;
+	thread_count = std::max(thread_count, size_t{1});
+	auto const page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	auto const bytes = static_cast<std::byte*>(buffer);
+
+	auto const get_row_range = [=](size_t k){
+		return std::pair{std::min(k*band_count/thread_count*band_height, row_count),
+			std::min((k + 1)*band_count/thread_count*band_height, row_count)};
+	};
+
+	auto const touch = [=](size_t k){
+		if(pin)
+		{ pin_current_thread(k); }
+
+		auto const begin = get_row_range(k).first*row_size;
+		auto const end = get_row_range(k).second*row_size;
+		auto const first_page = (reinterpret_cast<uintptr_t>(bytes + begin) + page_size - 1)/page_size*page_size;
+		for(auto page = first_page; page < reinterpret_cast<uintptr_t>(bytes + end); page += page_size)
+		{ *reinterpret_cast<std::byte volatile*>(page) = std::byte{0}; }
+	};
+
+	std::vector<std::thread> threads;
+	for(size_t k = 0; k != thread_count; ++k)
+	{
+		auto const rows = get_row_range(k);
+		if(rows.first != rows.second)
+		{ threads.emplace_back(touch, k); }
+	}
+	std::ranges::for_each(threads, [](auto& item){ item.join(); });
+}
+
+#endif
@@ -0,0 +1,81 @@
+//@{"target":{"name":"raster_buffer.test"}}
+
+#include "./raster_buffer.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <cassert>
+
+int main()
+{
+    // Empty buffer
+    {
+        raster_buffer<float> buffer{0};
+        assert(buffer.get() == nullptr);
+        assert(buffer.size() == 0);
+    }
+
+    // Buffers are aligned to a huge page in all modes, and can be written after first touch
+    for(auto mode : {huge_page_mode::none, huge_page_mode::transparent, huge_page_mode::explicit_pages})
+    {
+        size_t const w = 1000;
+        size_t const h = 333;
+        raster_buffer<float> buffer{w*h, mode};
+        assert(buffer.size() == w*h);
+        assert(reinterpret_cast<uintptr_t>(buffer.get())%huge_page_size == 0);
+
+        first_touch(buffer.get(), w*sizeof(float), h, 64, 3, false);
+        for(size_t k = 0; k != w*h; ++k)
+        { buffer[k] = static_cast<float>(k); }
+        for(size_t k = 0; k != w*h; ++k)
+        { assert(buffer[k] == static_cast<float>(k)); }
+    }
+
+    // All layouts hold the same image, and subviews address the same pixels as their parent
+    for(auto layout : {raster_layout::row_major(), raster_layout::blocked(16), raster_layout::blocked(20)})
+    {
+        image_size const size{vec2u_t{37, 29}};
+        std::vector<float> src(size.sizes[0]*size.sizes[1]);
+        for(size_t k = 0; k != std::size(src); ++k)
+        { src[k] = static_cast<float>(k); }
+
+        raster<float> image{size, layout};
+        assert(image.storage_size() >= std::size(src));
+        write_rows(image.view(), 0, std::data(src), size.sizes[1]);
+
+        raster_view<float const> const view = image.view();
+        for(size_t y = 0; y != size.sizes[1]; ++y)
+        {
+            for(size_t x = 0; x != size.sizes[0]; ++x)
+            { assert(view(x, y) == src[y*size.sizes[0] + x]); }
+        }
+
+        auto const sub = view.subview(vec2u_t{5, 7}, image_size{vec2u_t{20, 13}});
+        auto const subsub = sub.subview(vec2u_t{3, 2}, image_size{vec2u_t{10, 10}});
+        for(size_t y = 0; y != subsub.height(); ++y)
+        {
+            for(size_t x = 0; x != subsub.width(); ++x)
+            { assert(&subsub(x, y) == &view(x + 8, y + 9)); }
+        }
+    }
+    assert(raster_layout::blocked(20).block_size() == 16);
+    assert(get_storage_size(image_size{vec2u_t{37, 29}}, raster_layout::blocked(16)) == 3*2*256);
+
+    // 16-bit elevations round-trip within half a step, and values outside the range are clamped
+    for(auto z : {0.0f, 1.0f, 123.456f, 4000.0f, 8848.86f})
+    {
+        assert(std::abs(to_float(encode_elevation<quantized_elevation>(z)) - z) <= 0.5f*quantized_elevation_step);
+        assert(std::abs(to_float(encode_elevation<half_elevation>(z)) - z) <= 2.0f);
+    }
+    assert(to_float(encode_elevation<quantized_elevation>(-32768.0f)) == 0.0f);
+    assert(to_float(encode_elevation<quantized_elevation>(10000.0f)) == quantized_elevation_max);
+
+    // More threads than bands, with pinning
+    {
+        raster_buffer<float> buffer{100*10};
+        first_touch(buffer.get(), 100*sizeof(float), 10, 64, 8, true);
+        buffer[999] = 1.0f;
+        assert(buffer[999] == 1.0f);
+    }
+}
@@ -0,0 +1,482 @@
+#ifndef REGION_LOADER_HPP
+#define REGION_LOADER_HPP
+
+#include "./geotiff_loader.hpp"
+#include "./mosaic.hpp"
+#include "./file.hpp"
+#include "./blob.hpp"
+#include "./cmdline.hpp"
+#include "./stats.hpp"
+#include "./raster_buffer.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Splits an input argument on the form tif[,mask]
+*/
+inline auto split_input_pair(std::string_view arg_val)
+{
+	auto const i = std::ranges::find(arg_val, ',');
+	if(i == std::end(arg_val))
+	{
+		return std::pair{std::string{std::begin(arg_val), std::end(arg_val)}, std::optional<std::string>{}};
+	}
+	return std::pair{std::string{std::begin(arg_val), i}, std::optional{std::string{i + 1, std::end(arg_val)}}};
+}
+
+/**
+ * The in-memory format of elevations. float32 keeps the decoded values, while uint16 and
+ * float16 halve the memory footprint at the cost of precision.
+*/
+enum class pixel_format:int{float32, uint16, float16};
+
+struct pixel_format_option
+{
+	pixel_format_option() = default;
+
+	explicit pixel_format_option(std::string const& str)
+	{
+		if(str == "float32")
+		{ value = pixel_format::float32; }
+		else
+		if(str == "uint16")
+		{ value = pixel_format::uint16; }
+		else
+		if(str == "float16")
+		{ value = pixel_format::float16; }
+		else
+		{ throw std::runtime_error{std::string{"Unsupported pixel format "}.append(str)}; }
+	}
+
+	pixel_format value{pixel_format::float32};
+};
+
+constexpr size_t get_pixel_size(pixel_format format)
+{ return format == pixel_format::float32 ? sizeof(float) : sizeof(uint16_t); }
+
+using heightmap_raster = std::variant<raster<float>, raster<quantized_elevation>, raster<half_elevation>>;
+
+/**
+ * A decoded heightmap together with its mask and geographic metadata.
+ *
+ * Only loaded_rows of the image may be stored, in which case pixels and mask hold just these
+ * rows. Views are still addressed in the coordinates of the whole image, so kernels give the
+ * same result for a pixel no matter which rows are loaded. Analyses only process active_rows,
+ * which is loaded_rows without the halo rows that stencils read above and below.
+*/
+struct loaded_region
+{
+	std::string name;
+	image_info info;
+	corners_in_geo_coords domain;
+	float R_e;
+	float R_p;
+	heightmap_raster pixels;
+	blob<uint8_t> mask;
+	row_range loaded_rows;
+	row_range active_rows;
+
+	size_t pixel_count() const
+	{ return info.size.sizes[0]*info.size.sizes[1]; }
+
+	/**
+	 * Calls f with a basic_heightmap_region of the pixel type that is stored
+	*/
+	template<class Func>
+	decltype(auto) visit_view(Func&& f) const
+	{
+		return std::visit([this, &f](auto const& item) -> decltype(auto) {
+			using pixel_type = typename std::remove_cvref_t<decltype(item)>::value_type;
+			auto const first_row = loaded_rows.begin;
+			auto const mask_view = mask.get() == nullptr ?
+				raster_view<uint8_t const>{} :
+				with_row_offset(raster_view<uint8_t const>{mask.get(), info.size}, first_row, info.size);
+			return f(basic_heightmap_region<pixel_type>{with_row_offset(item.view(), first_row, info.size),
+				mask_view, info.size, domain, R_e, R_p});
+		}, pixels);
+	}
+};
+
+/**
+ * Returns the size of the image tif_name, which may also be a mosaic. Only TIFF headers are
+ * read.
+*/
+inline image_size get_input_size(std::string const& tif_name)
+{
+	if(is_mosaic(tif_name))
+	{ return make_mosaic_index(tif_name).info.size; }
+
+	auto tiff = make_tiff(tif_name.c_str());
+	return get_image_size(tiff.get());
+}
+
+/**
+ * Returns the info of the image tif_name, which may also be a mosaic. Only TIFF headers are
+ * read.
+*/
+inline image_info get_input_info(std::string const& tif_name)
+{
+	if(is_mosaic(tif_name))
+	{ return make_mosaic_index(tif_name).info; }
+
+	auto tiff = make_tiff(tif_name.c_str());
+	return get_image_info(tiff.get());
+}
+
+/**
+ * Returns the number of bytes load_region will allocate for the given files. Only the TIFF
+ * header is read.
+*/
+inline size_t get_region_byte_size(std::string const& tif_name, bool has_mask,
+	size_t pixel_size = sizeof(float))
+{
+	auto const size = get_input_size(tif_name);
+	return size.sizes[0]*size.sizes[1]*(pixel_size + (has_mask ? sizeof(uint8_t) : 0));
+}
+
+struct raster_layout_option
+{
+	raster_layout_option() = default;
+
+	explicit raster_layout_option(std::string const& str)
+	{
+		if(str == "row_major")
+		{ blocked = false; }
+		else
+		if(str == "blocked")
+		{ blocked = true; }
+		else
+		{ throw std::runtime_error{std::string{"Unsupported raster layout "}.append(str)}; }
+	}
+
+	bool blocked{false};
+};
+
+/**
+ * Controls how the pixel buffer of a region is allocated. Pages are first touched in bands of
+ * band_height rows, split over touch_threads threads the same way as a work_stealing_pool with
+ * touch_threads workers splits the row bands of the region.
+ *
+ * If blocked is true, pixels are stored in blocks of block_size pixels (rounded down to a power
+ * of two). A block_size of zero means the tile size of the TIFF, or 256 if it uses strips.
+*/
+struct raster_alloc_params
+{
+	huge_page_mode huge_pages{huge_page_mode::transparent};
+	size_t touch_threads{1};
+	size_t band_height{64};
+	bool pin{false};
+	bool blocked{false};
+	size_t block_size{0};
+	pixel_format format{pixel_format::float32};
+};
+
+inline raster_layout get_raster_layout(raster_alloc_params const& params, image_layout const& layout)
+{
+	if(!params.blocked)
+	{ return raster_layout::row_major(); }
+
+	if(params.block_size != 0)
+	{ return raster_layout::blocked(params.block_size); }
+
+	auto const tile = std::get_if<tile_info>(&layout);
+	return raster_layout::blocked(tile != nullptr ? static_cast<size_t>(tile->sizes[0]) : 256);
+}
+
+/**
+ * The difference between decoded float elevations and their stored values. Elevations outside
+ * [0, quantized_elevation_max], such as nodata values, are not counted, since they are clamped
+ * on purpose.
+*/
+struct encoding_error
+{
+	float max{0.0f};
+	double sum_of_squares{0.0};
+	size_t count{0};
+
+	void add(float expected, float actual)
+	{
+		if(!(expected >= 0.0f && expected <= quantized_elevation_max))
+		{ return; }
+
+		auto const diff = std::abs(expected - actual);
+		max = std::max(max, diff);
+		sum_of_squares += static_cast<double>(diff)*static_cast<double>(diff);
+		++count;
+	}
+
+	double rms() const
+	{ return count == 0 ? 0.0 : std::sqrt(sum_of_squares/static_cast<double>(count)); }
+};
+
+/**
+ * Returns the number of rows that load_pixels decodes at a time, into a temporary band, when
+ * rows are not decoded directly into the destination. Bands are whole TIFF tiles, so that no
+ * tile is decoded twice.
+*/
+inline size_t get_decode_band_height(image_layout const& tiff_layout, raster_layout layout)
+{
+	auto const tiff_band_height = get_band_height(tiff_layout);
+	return (std::max(layout.block_size(), size_t{64}) + tiff_band_height - 1)/tiff_band_height*tiff_band_height;
+}
+
+/**
+ * Returns the number of bytes of the temporary band that load_region uses for tif_name, which
+ * is zero if float32 pixels are stored row by row. Only TIFF headers are read.
+*/
+inline size_t get_decode_buffer_bytes(std::string const& tif_name, raster_alloc_params const& alloc_params)
+{
+	auto const info = get_input_info(tif_name);
+	auto const layout = get_raster_layout(alloc_params, info.layout);
+	if(alloc_params.format == pixel_format::float32 && layout == raster_layout::row_major())
+	{ return 0; }
+	return static_cast<size_t>(info.size.sizes[0])*sizeof(float)*get_decode_band_height(info.layout, layout);
+}
+
+/**
+ * Decodes rows of an image into a new raster<T>, which holds only these rows. read_rows(buffer,
+ * first_row, row_count) decodes rows of the image into buffer. Unless T is float and the layout
+ * is row-major, the image is decoded one band at a time, and each band is converted into the
+ * destination. The encoding error is then accumulated into error.
+*/
+template<class T, class RowReader>
+raster<T> load_pixels(RowReader&& read_rows, image_info const& info, row_range rows,
+	raster_alloc_params const& alloc_params, encoding_error& error)
+{
+	auto const w = static_cast<size_t>(info.size.sizes[0]);
+	auto const h = rows.size();
+	auto const layout = get_raster_layout(alloc_params, info.layout);
+	raster<T> ret{image_size{vec2u_t{w, h}}, layout, alloc_params.huge_pages};
+
+	// For a blocked layout, this splits the block rows rather than the pixel rows, which is close
+	// enough, since a worker only reads from a few block rows
+	auto const storage_row_size = get_row_stride(w, layout) << layout.block_shift;
+	timed("first_touch", w*h, [&ret, &alloc_params, storage_row_size](){
+		first_touch(ret.data(), storage_row_size*sizeof(T), ret.storage_size()/storage_row_size,
+			alloc_params.band_height, alloc_params.touch_threads, alloc_params.pin);
+	});
+
+	if constexpr(std::is_same_v<T, float>)
+	{
+		if(layout == raster_layout::row_major())
+		{
+			read_rows(ret.data(), rows.begin, h);
+			return ret;
+		}
+	}
+
+	// Bands are counted from the top of the image, so they stay whole TIFF tiles
+	auto const band_height = get_decode_band_height(info.layout, layout);
+	auto const band = std::make_unique_for_overwrite<float[]>(w*band_height);
+	for(size_t y = 0; y < h;)
+	{
+		auto const first_row = rows.begin + y;
+		auto const row_count = std::min((first_row/band_height + 1)*band_height - first_row, h - y);
+		read_rows(band.get(), first_row, row_count);
+		timed("encode", w*row_count, [&ret, &band, &error, y, row_count](){
+			write_rows(ret.view(), y, static_cast<float const*>(band.get()), row_count, [&error](float z){
+				auto const val = encode_elevation<T>(z);
+				if constexpr(!std::is_same_v<T, float>)
+				{ error.add(z, to_float(val)); }
+				return val;
+			});
+		});
+		y += row_count;
+	}
+	return ret;
+}
+
+/**
+ * Decodes rows of an image, using read_rows, into a raster of the pixel format given by
+ * alloc_params
+*/
+template<class RowReader>
+heightmap_raster load_heightmap(RowReader&& read_rows, image_info const& info, row_range rows,
+	raster_alloc_params const& alloc_params)
+{
+	encoding_error error;
+	heightmap_raster ret;
+	switch(alloc_params.format)
+	{
+		case pixel_format::float32:
+			ret = load_pixels<float>(read_rows, info, rows, alloc_params, error);
+			break;
+
+		case pixel_format::uint16:
+			ret = load_pixels<quantized_elevation>(read_rows, info, rows, alloc_params, error);
+			break;
+
+		case pixel_format::float16:
+			ret = load_pixels<half_elevation>(read_rows, info, rows, alloc_params, error);
+			break;
+	}
+
+	if(alloc_params.format != pixel_format::float32)
+	{
+		fprintf(stderr, "encoding error: max=%.6g m, rms=%.6g m over %zu pixels\n", error.max, error.rms(),
+			error.count);
+	}
+	return ret;
+}
+
+/**
+ * Loads a region. If rows are given, only these rows, and one halo row above and below them,
+ * are loaded. Otherwise the whole region is loaded.
+ *
+ * tif_name may also be a mosaic, in which case the region spans all of its tiles, and a mask
+ * must cover the whole mosaic. Only the tiles that intersect the loaded rows are decoded.
+*/
+inline loaded_region load_region(std::string const& tif_name, std::optional<std::string> const& mask_name,
+	raster_alloc_params const& alloc_params = raster_alloc_params{}, row_range rows = row_range{})
+{
+	loaded_region ret{};
+	ret.name = tif_name;
+
+	auto const set_rows = [&ret, rows](){
+		auto const h = static_cast<size_t>(ret.info.size.sizes[1]);
+		ret.active_rows = row_range{std::min(rows.begin, h), std::min(rows.end, h)};
+		ret.loaded_rows = row_range{std::max(ret.active_rows.begin, size_t{1}) - 1, std::min(ret.active_rows.end + 1, h)};
+	};
+
+	auto const log_domain = [&ret](){
+		fprintf(stderr, "domain: min=(%.7g, %.7g), max=(%.7g, %.7g), R_e=%.8g, R_p=%.8g\n",
+			ret.domain.min[0], ret.domain.min[1], ret.domain.max[0], ret.domain.max[1],
+			ret.R_e, ret.R_p);
+		putc('\n', stderr);
+	};
+
+	if(is_mosaic(tif_name))
+	{
+		auto const index = make_mosaic_index(tif_name);
+		ret.info = index.info;
+		ret.domain = index.domain;
+		ret.R_e = index.R_e;
+		ret.R_p = index.R_p;
+		set_rows();
+		log_domain();
+
+		mosaic_reader reader{index};
+		ret.pixels = load_heightmap(reader, ret.info, ret.loaded_rows, alloc_params);
+		fprintf(stderr, "mosaic: %zu x %zu pixels, decoded %zu of %zu tiles\n",
+			static_cast<size_t>(ret.info.size.sizes[0]), static_cast<size_t>(ret.info.size.sizes[1]),
+			reader.opened_tile_count(), std::size(index.tiles));
+	}
+	else
+	{
+		auto tiff = make_tiff(tif_name.c_str());
+		auto gtif = make_gtif(tiff.get());
+		ret.info = get_image_info(tiff.get());
+		if(ret.info.size.sizes[0] == 0)
+		{ throw std::runtime_error{"Invalid size"};}
+		set_rows();
+
+		auto const defn = get_defn(gtif.get());
+		ret.domain = get_domain(gtif.get(), *defn, ret.info.size);
+		ret.R_e = static_cast<float>(defn->SemiMajor);
+		ret.R_p = static_cast<float>(defn->SemiMinor);
+		log_domain();
+
+		ret.pixels = load_heightmap([handle = tiff.get(), &info = ret.info](float* buffer, size_t first_row, size_t row_count){
+			load_rows(handle, info, buffer, first_row, row_count);
+		}, ret.info, ret.loaded_rows, alloc_params);
+	}
+
+	auto const w = static_cast<size_t>(ret.info.size.sizes[0]);
+	ret.mask = timed("mask_load", ret.loaded_rows.size()*w, [&mask_name, n = ret.pixel_count(),
+		first = ret.loaded_rows.begin*w, count = ret.loaded_rows.size()*w](){
+		return get_or(get_or(mask_name, file{}, "rb"), blob<uint8_t>{}, n, first, count);
+	});
+
+	return ret;
+}
+
+/**
+ * A decoded tile or strip of a region, as a heightmap_region addressed in the coordinates of the
+ * whole image, of which only rows and columns may be read. The mask of these pixels is read
+ * together with them. index and count are those of the decoded_block.
+*/
+struct region_block
+{
+	heightmap_region region;
+	row_range rows;
+	column_range columns;
+	size_t index;
+	size_t count;
+};
+
+/**
+ * Decodes tif_name one tile or strip at a time, with thread_count threads, and calls f with each
+ * region_block, as described in visit_blocks. Only the blocks that are being decoded or consumed,
+ * and their mask windows, are kept in memory. Mosaics are not supported.
+*/
+template<class Func>
+void visit_region_blocks(std::string const& tif_name, std::optional<std::string> const& mask_name,
+	size_t thread_count, Func&& f)
+{
+	if(is_mosaic(tif_name))
+	{ throw std::runtime_error{std::string{"Cannot visit the blocks of the mosaic "}.append(tif_name)}; }
+
+	auto tiff = make_tiff(tif_name.c_str());
+	auto gtif = make_gtif(tiff.get());
+	auto const info = get_image_info(tiff.get());
+	auto const defn = get_defn(gtif.get());
+	auto const domain = get_domain(gtif.get(), *defn, info.size);
+	auto const R_e = static_cast<float>(defn->SemiMajor);
+	auto const R_p = static_cast<float>(defn->SemiMinor);
+	auto const w = static_cast<size_t>(info.size.sizes[0]);
+	auto const h = static_cast<size_t>(info.size.sizes[1]);
+
+	auto const mask = get_or(mask_name, file{}, "rb");
+	if(mask.get() != nullptr)
+	{
+		struct stat statbuf{};
+		if(fstat(fileno(mask.get()), &statbuf) != 0)
+		{ throw std::runtime_error{std::string{"Failed to get the size of "}.append(*mask_name)}; }
+		if(static_cast<size_t>(statbuf.st_size) != w*h)
+		{ throw std::runtime_error{std::string{"Wrong size of mask "}.append(*mask_name)}; }
+	}
+
+	visit_blocks(tif_name.c_str(), info, row_range{}, [&](decoded_block const& block){
+		// Origins wrap around, so that the views are addressed in image coordinates
+		auto const origin = vec2u_t{0, 0} - block.origin;
+		raster_view<float const> const pixels{block.pixels, info.size, block.stride, raster_layout::row_major(), origin};
+
+		std::vector<uint8_t> mask_window;
+		raster_view<uint8_t const> mask_view{};
+		if(mask.get() != nullptr)
+		{
+			auto const width = static_cast<size_t>(block.size[0]);
+			mask_window.resize(width*block.size[1]);
+			timed("mask_load", std::size(mask_window), [&mask, &mask_window, &block, width, w](){
+				for(size_t y = 0; y != block.size[1]; ++y)
+				{
+					auto const offset = (block.origin[1] + y)*w + block.origin[0];
+					if(pread(fileno(mask.get()), std::data(mask_window) + y*width, width, static_cast<off_t>(offset))
+						!= static_cast<ssize_t>(width))
+					{ throw std::runtime_error{"Failed to read mask"}; }
+				}
+			});
+			mask_view = raster_view<uint8_t const>{std::data(mask_window), info.size, width, raster_layout::row_major(), origin};
+		}
+
+		f(region_block{heightmap_region{pixels, mask_view, info.size, domain, R_e, R_p},
+			row_range{block.origin[1], block.origin[1] + block.size[1]},
+			column_range{block.origin[0], block.origin[0] + block.size[0]},
+			block.index,
+			block.count});
+	}, thread_count);
+}
+
+#endif
@@ -0,0 +1,474 @@
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include "./file.hpp"
+#include "./stats.hpp"
+#include "./sample_reservoir.hpp"
+
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+/**
+ * Bump when a kernel, or the order in which the parts of a result are summed, changes in a way
+ * that changes its results, so that old cache entries are no longer found
+*/
+constexpr uint64_t result_cache_version = 3;
+
+/**
+ * A 128-bit non-cryptographic hash, computed over four 64-bit lanes in the same way as xxHash64.
+ * It is used to detect changed inputs, not to protect against deliberate collisions.
+*/
+class content_hasher
+{
+public:
+	content_hasher():
+		m_lanes{seed + prime_1 + prime_2, seed + prime_2, seed, seed - prime_1},
+		m_length{0},
+		m_tail_size{0},
+		m_tail{}
+	{}
+
+	content_hasher& update(void const* data, size_t n)
+	{
+		auto bytes = static_cast<std::byte const*>(data);
+		m_length += n;
+		if(m_tail_size != 0)
+		{
+			auto const count = std::min(n, std::size(m_tail) - m_tail_size);
+			memcpy(std::data(m_tail) + m_tail_size, bytes, count);
+			m_tail_size += count;
+			bytes += count;
+			n -= count;
+			if(m_tail_size != std::size(m_tail))
+			{ return *this; }
+			consume(std::data(m_tail));
+			m_tail_size = 0;
+		}
+
+		while(n >= std::size(m_tail))
+		{
+			consume(bytes);
+			bytes += std::size(m_tail);
+			n -= std::size(m_tail);
+		}
+
+		memcpy(std::data(m_tail), bytes, n);
+		m_tail_size = n;
+		return *this;
+	}
+
+	content_hasher& update(std::string_view str)
+	{
+		// Include the length, so that consecutive strings cannot be shifted into each other
+		auto const length = static_cast<uint64_t>(std::size(str));
+		update(&length, sizeof(length));
+		return update(std::data(str), std::size(str));
+	}
+
+	std::array<uint64_t, 2> value() const
+	{
+		auto lanes = m_lanes;
+		for(size_t k = 0; k != m_tail_size; ++k)
+		{ lanes[k%4] = round(lanes[k%4], static_cast<uint64_t>(m_tail[k]) + k); }
+
+		auto const a = avalanche(std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + m_length);
+		auto const b = avalanche(std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18) + (m_length ^ prime_3));
+		return std::array{a, avalanche(a ^ b)};
+	}
+
+private:
+	static constexpr uint64_t prime_1 = 0x9e3779b185ebca87ull;
+	static constexpr uint64_t prime_2 = 0xc2b2ae3d27d4eb4full;
+	static constexpr uint64_t prime_3 = 0x165667b19e3779f9ull;
+	static constexpr uint64_t seed = 0;
+
+	static uint64_t round(uint64_t acc, uint64_t input)
+	{ return std::rotl(acc + input*prime_2, 31)*prime_1; }
+
+	static uint64_t avalanche(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= prime_2;
+		h ^= h >> 29;
+		h *= prime_3;
+		h ^= h >> 32;
+		return h;
+	}
+
+	void consume(std::byte const* block)
+	{
+		for(size_t k = 0; k != std::size(m_lanes); ++k)
+		{
+			uint64_t word{};
+			memcpy(&word, block + k*sizeof(uint64_t), sizeof(uint64_t));
+			m_lanes[k] = round(m_lanes[k], word);
+		}
+	}
+
+	std::array<uint64_t, 4> m_lanes;
+	uint64_t m_length;
+	size_t m_tail_size;
+	std::array<std::byte, 32> m_tail;
+};
+
+/**
+ * Feeds the contents of the file filename into hasher
+*/
+inline void hash_file(content_hasher& hasher, std::string const& filename)
+{
+	file const src{filename, "rb"};
+	auto const buffer = std::make_unique_for_overwrite<std::byte[]>(1 << 22);
+	while(true)
+	{
+		auto const n = fread(buffer.get(), 1, 1 << 22, src.get());
+		if(ferror(src.get()))
+		{ throw std::runtime_error{std::string{"Failed to read "}.append(filename)}; }
+		hasher.update(buffer.get(), n);
+		if(n != 1 << 22)
+		{ return; }
+	}
+}
+
+/**
+ * Formats val so that it can be parsed back to the same value, for use in cache keys
+*/
+inline std::string to_exact_string(double val)
+{
+	std::array<char, 32> buffer{};
+	auto const res = std::to_chars(std::data(buffer), std::data(buffer) + std::size(buffer), val);
+	return std::string{std::data(buffer), res.ptr};
+}
+
+/**
+ * The arithmetic type that T is made of, and the number of such values, if T is arithmetic, or a
+ * tuple-like type, such as std::pair<double, double> or std::array<std::tuple<float, float>, 4>,
+ * whose elements are all made of the same arithmetic type. Such types are rarely trivially
+ * copyable, but can still be written as flat arrays of scalars.
+*/
+template<class T>
+struct flat_value
+{};
+
+template<class T, class Indices>
+struct flat_tuple_value
+{};
+
+template<class T>
+requires std::is_arithmetic_v<T>
+struct flat_value<T>
+{
+	using scalar = T;
+	static constexpr size_t size = 1;
+};
+
+template<class T>
+requires(!std::is_arithmetic_v<T>) && requires{ std::tuple_size<T>::value; }
+struct flat_value<T>:flat_tuple_value<T, std::make_index_sequence<std::tuple_size_v<T>>>
+{};
+
+template<class T>
+concept flat_serializable = requires{ typename flat_value<T>::scalar; };
+
+template<class T, size_t ... I>
+requires(sizeof...(I) != 0) && (flat_serializable<std::tuple_element_t<I, T>> && ...)
+	&& (std::is_same_v<typename flat_value<std::tuple_element_t<I, T>>::scalar,
+		typename flat_value<std::tuple_element_t<0, T>>::scalar> && ...)
+struct flat_tuple_value<T, std::index_sequence<I...>>
+{
+	using scalar = typename flat_value<std::tuple_element_t<0, T>>::scalar;
+	static constexpr size_t size = (flat_value<std::tuple_element_t<I, T>>::size + ...);
+};
+
+template<flat_serializable T>
+auto flatten(T const& val, typename flat_value<T>::scalar* out)
+{
+	if constexpr(std::is_arithmetic_v<T>)
+	{ *out++ = val; }
+	else
+	{ std::apply([&out](auto const& ... item){ (..., (out = flatten(item, out))); }, val); }
+	return out;
+}
+
+template<flat_serializable T>
+auto unflatten(T& val, typename flat_value<T>::scalar const* in)
+{
+	if constexpr(std::is_arithmetic_v<T>)
+	{ val = *in++; }
+	else
+	{ std::apply([&in](auto& ... item){ (..., (in = unflatten(item, in))); }, val); }
+	return in;
+}
+
+/**
+ * Writes and reads partial results in a native binary format. Vectors and strings are prefixed
+ * with their size. Trivially copyable and flat_serializable values, and vectors of them, are
+ * written as blocks of bytes, and other values member by member.
+*/
+template<class T>
+void write_binary(FILE* dest, T const& val);
+
+template<class T>
+void read_binary(FILE* src, T& val);
+
+inline void write_binary(FILE* dest, std::string const& val);
+
+inline void read_binary(FILE* src, std::string& val);
+
+template<class T>
+void write_binary(FILE* dest, sample_reservoir<T> const& val);
+
+template<class T>
+void read_binary(FILE* src, sample_reservoir<T>& val);
+
+/**
+ * The number of elements that are converted at a time, when writing a vector of flat values
+*/
+constexpr size_t flat_block_size = 4096;
+
+template<class T>
+void write_binary(FILE* dest, std::vector<T> const& val)
+{
+	auto const n = static_cast<uint64_t>(std::size(val));
+	write_binary(dest, n);
+	if constexpr(std::is_trivially_copyable_v<T>)
+	{
+		if(fwrite(std::data(val), sizeof(T), n, dest) != n)
+		{ throw std::runtime_error{"Failed to write data"}; }
+	}
+	else
+	if constexpr(flat_serializable<T>)
+	{
+		constexpr auto elem_size = flat_value<T>::size;
+		std::vector<typename flat_value<T>::scalar> buffer(elem_size*std::min(std::size(val), flat_block_size));
+		for(size_t k = 0; k < std::size(val); k += flat_block_size)
+		{
+			auto const count = std::min(std::size(val) - k, flat_block_size);
+			auto out = std::data(buffer);
+			std::for_each(std::begin(val) + k, std::begin(val) + k + count, [&out](auto const& item){
+				out = flatten(item, out);
+			});
+			if(fwrite(std::data(buffer), sizeof(buffer[0]), count*elem_size, dest) != count*elem_size)
+			{ throw std::runtime_error{"Failed to write data"}; }
+		}
+	}
+	else
+	{
+		for(auto const& item : val)
+		{ write_binary(dest, item); }
+	}
+}
+
+template<class T>
+void read_binary(FILE* src, std::vector<T>& val)
+{
+	uint64_t n{};
+	read_binary(src, n);
+	if constexpr(std::is_trivially_copyable_v<T>)
+	{
+		val.resize(n);
+		if(fread(std::data(val), sizeof(T), n, src) != n)
+		{ throw std::runtime_error{"Truncated data"}; }
+	}
+	else
+	if constexpr(flat_serializable<T>)
+	{
+		// Grow with the data read, so a corrupt size does not allocate a huge vector up front
+		constexpr auto elem_size = flat_value<T>::size;
+		val.clear();
+		std::vector<typename flat_value<T>::scalar> buffer(elem_size*std::min(static_cast<size_t>(n), flat_block_size));
+		for(size_t k = 0; k < n; k += flat_block_size)
+		{
+			auto const count = std::min(static_cast<size_t>(n) - k, flat_block_size);
+			if(fread(std::data(buffer), sizeof(buffer[0]), count*elem_size, src) != count*elem_size)
+			{ throw std::runtime_error{"Truncated data"}; }
+			auto in = static_cast<typename flat_value<T>::scalar const*>(std::data(buffer));
+			for(size_t i = 0; i != count; ++i)
+			{
+				T item{};
+				in = unflatten(item, in);
+				val.push_back(item);
+			}
+		}
+	}
+	else
+	{
+		val.resize(n);
+		for(auto& item : val)
+		{ read_binary(src, item); }
+	}
+}
+
+template<class T>
+void write_binary(FILE* dest, T const& val)
+{
+	if constexpr(std::is_trivially_copyable_v<T>)
+	{
+		if(fwrite(&val, sizeof(T), 1, dest) != 1)
+		{ throw std::runtime_error{"Failed to write data"}; }
+	}
+	else
+	if constexpr(flat_serializable<T>)
+	{
+		std::array<typename flat_value<T>::scalar, flat_value<T>::size> buffer;
+		flatten(val, std::data(buffer));
+		if(fwrite(std::data(buffer), sizeof(buffer[0]), std::size(buffer), dest) != std::size(buffer))
+		{ throw std::runtime_error{"Failed to write data"}; }
+	}
+	else
+	{ std::apply([dest](auto const& ... item){ (..., write_binary(dest, item)); }, val); }
+}
+
+template<class T>
+void read_binary(FILE* src, T& val)
+{
+	if constexpr(std::is_trivially_copyable_v<T>)
+	{
+		if(fread(&val, sizeof(T), 1, src) != 1)
+		{ throw std::runtime_error{"Truncated data"}; }
+	}
+	else
+	if constexpr(flat_serializable<T>)
+	{
+		std::array<typename flat_value<T>::scalar, flat_value<T>::size> buffer;
+		if(fread(std::data(buffer), sizeof(buffer[0]), std::size(buffer), src) != std::size(buffer))
+		{ throw std::runtime_error{"Truncated data"}; }
+		unflatten(val, static_cast<typename flat_value<T>::scalar const*>(std::data(buffer)));
+	}
+	else
+	{ std::apply([src](auto& ... item){ (..., read_binary(src, item)); }, val); }
+}
+
+template<class T>
+void write_binary(FILE* dest, sample_reservoir<T> const& val)
+{
+	write_binary(dest, val.samples);
+	write_binary(dest, val.count);
+	write_binary(dest, val.state);
+}
+
+template<class T>
+void read_binary(FILE* src, sample_reservoir<T>& val)
+{
+	read_binary(src, val.samples);
+	read_binary(src, val.count);
+	read_binary(src, val.state);
+	if(std::size(val.samples) != std::min(val.count, uint64_t{sample_reservoir_capacity}))
+	{ throw std::runtime_error{"Inconsistent sample reservoir"}; }
+}
+
+inline void write_binary(FILE* dest, std::string const& val)
+{
+	write_binary(dest, static_cast<uint64_t>(std::size(val)));
+	if(fwrite(std::data(val), 1, std::size(val), dest) != std::size(val))
+	{ throw std::runtime_error{"Failed to write data"}; }
+}
+
+inline void read_binary(FILE* src, std::string& val)
+{
+	uint64_t n{};
+	read_binary(src, n);
+	val.resize(n);
+	if(fread(std::data(val), 1, n, src) != n)
+	{ throw std::runtime_error{"Truncated data"}; }
+}
+
+/**
+ * Per-region partial results stored in a directory, under a hash of everything they depend on.
+ * Entries are written to a temporary file that is renamed into place, so a reader never sees a
+ * partial entry, and concurrent runs may share a directory.
+*/
+class result_cache
+{
+public:
+	using key_type = std::array<uint64_t, 2>;
+
+	/**
+	 * If refresh is true, existing entries are ignored and replaced
+	*/
+	explicit result_cache(std::string dir, bool refresh):m_dir{std::move(dir)}, m_refresh{refresh}
+	{}
+
+	template<class T>
+	std::optional<T> load(std::string_view analysis, key_type key) const
+	{
+		if(m_refresh)
+		{ return std::nullopt; }
+
+		auto const src = fopen(get_entry_name(analysis, key).c_str(), "rb");
+		if(src == nullptr)
+		{ return std::nullopt; }
+		file::handle const owner{src};
+
+		try
+		{
+			scoped_timer timer{"cache_read"};
+			header stored{};
+			read_binary(src, stored);
+			if(stored != header{key, result_cache_version})
+			{ return std::nullopt; }
+
+			T ret{};
+			read_binary(src, ret);
+			return ret;
+		}
+		catch(std::exception const& err)
+		{
+			fprintf(stderr, "Ignoring cache entry for %s: %s\n", std::string{analysis}.c_str(), err.what());
+			return std::nullopt;
+		}
+	}
+
+	template<class T>
+	void store(std::string_view analysis, key_type key, T const& value) const
+	{
+		scoped_timer timer{"cache_write"};
+		auto const name = get_entry_name(analysis, key);
+		auto const tmp_name = std::string{name}.append(".").append(std::to_string(getpid())).append(".tmp");
+		{
+			file const dest{tmp_name, "wb"};
+			write_binary(dest.get(), header{key, result_cache_version});
+			write_binary(dest.get(), value);
+			if(fflush(dest.get()) != 0)
+			{ throw std::runtime_error{std::string{"Failed to write "}.append(tmp_name)}; }
+		}
+		if(rename(tmp_name.c_str(), name.c_str()) != 0)
+		{ throw std::runtime_error{std::string{"Failed to store "}.append(name)}; }
+	}
+
+private:
+	struct header
+	{
+		key_type key;
+		uint64_t version;
+
+		bool operator==(header const&) const = default;
+	};
+
+	std::string get_entry_name(std::string_view analysis, key_type key) const
+	{
+		std::array<char, 40> hex{};
+		snprintf(std::data(hex), std::size(hex), "%016lx%016lx",
+			static_cast<unsigned long>(key[0]),
+			static_cast<unsigned long>(key[1]));
+		return std::string{m_dir}.append("/").append(analysis).append("_").append(std::data(hex)).append(".bin");
+	}
+
+	std::string m_dir;
+	bool m_refresh;
+};
+
+#endif
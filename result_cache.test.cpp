@@ -0,0 +1,115 @@
+//@{"target":{"name":"result_cache.test"}}
+
+#include "./result_cache.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <cassert>
+
+int main()
+{
+    // The hash does not depend on how the input is split
+    {
+        std::vector<char> data(1000);
+        for(size_t k = 0; k != std::size(data); ++k)
+        { data[k] = static_cast<char>(k*7 + 3); }
+
+        content_hasher whole;
+        whole.update(std::data(data), std::size(data));
+
+        content_hasher pieces;
+        pieces.update(std::data(data), 1)
+            .update(std::data(data) + 1, 40)
+            .update(std::data(data) + 41, 959);
+        assert(whole.value() == pieces.value());
+
+        data[500] ^= 1;
+        content_hasher changed;
+        changed.update(std::data(data), std::size(data));
+        assert(changed.value() != whole.value());
+
+        assert(content_hasher{}.update("ab").update("c").value() != content_hasher{}.update("a").update("bc").value());
+    }
+
+    std::string dir_template{"/tmp/result_cache_test_XXXXXX"};
+    auto const dir = mkdtemp(std::data(dir_template));
+    assert(dir != nullptr);
+
+    using samples = std::array<std::vector<std::tuple<float, float>>, 3>;
+    samples const value{
+        std::vector{std::tuple{1.0f, 2.0f}},
+        std::vector<std::tuple<float, float>>{},
+        std::vector{std::tuple{3.0f, 4.0f}, std::tuple{5.0f, 6.0f}}
+    };
+    result_cache::key_type const key{1, 2};
+
+    // Entries are found under the same analysis and key only
+    {
+        result_cache const cache{dir_template, false};
+        assert(!cache.load<samples>("test", key).has_value());
+        cache.store("test", key, value);
+
+        auto const loaded = cache.load<samples>("test", key);
+        assert(loaded.has_value());
+        assert(*loaded == value);
+        assert(!cache.load<samples>("test", result_cache::key_type{1, 3}).has_value());
+        assert(!cache.load<samples>("other", key).has_value());
+
+        std::array<double, 4> const sums{1.0, 2.0, 3.0, 4.0};
+        cache.store("sums", key, sums);
+        using sums_type = std::array<double, 4>;
+        assert(cache.load<sums_type>("sums", key) == sums);
+    }
+
+    // A refreshing cache ignores existing entries
+    {
+        result_cache const cache{dir_template, true};
+        assert(!cache.load<samples>("test", key).has_value());
+    }
+
+    // A truncated entry is treated as missing
+    {
+        result_cache const cache{dir_template, false};
+        cache.store("test", key, value);
+        for(auto const& item : std::filesystem::directory_iterator{dir_template})
+        {
+            if(item.path().filename().string().starts_with("test_"))
+            { std::filesystem::resize_file(item.path(), 40); }
+        }
+        assert(!cache.load<samples>("test", key).has_value());
+    }
+
+    // Pairs, tuples and reservoirs of them are written as flat arrays, and read back
+    {
+        result_cache const cache{dir_template, false};
+        static_assert(flat_serializable<std::pair<double, double>>);
+        static_assert(flat_serializable<std::array<std::tuple<float, float>, 3>>);
+        static_assert(!flat_serializable<std::pair<float, double>>);
+        static_assert(flat_value<std::array<std::pair<double, double>, 4>>::size == 8);
+
+        std::vector<std::pair<double, double>> pairs(10000);
+        for(size_t k = 0; k != std::size(pairs); ++k)
+        { pairs[k] = std::pair{static_cast<double>(k), 0.5*static_cast<double>(k)}; }
+        using pairs_type = std::vector<std::pair<double, double>>;
+        cache.store("pairs", key, pairs);
+        assert(cache.load<pairs_type>("pairs", key) == pairs);
+        auto const entry = std::filesystem::path{dir_template}/"pairs_00000000000000010000000000000002.bin";
+        assert(std::filesystem::file_size(entry) == 4*sizeof(uint64_t) + std::size(pairs)*2*sizeof(double));
+
+        std::vector<std::tuple<float, float>> values(3000);
+        for(size_t k = 0; k != std::size(values); ++k)
+        { values[k] = std::tuple{static_cast<float>(k), -static_cast<float>(k)}; }
+        using reservoirs = std::array<sample_reservoir<std::tuple<float, float>>, 2>;
+        reservoirs const sampled{make_sample_reservoir(std::vector{values}, 1), make_sample_reservoir(
+            std::vector<std::tuple<float, float>>{}, 2)};
+        cache.store("reservoirs", key, sampled);
+        assert(cache.load<reservoirs>("reservoirs", key) == sampled);
+    }
+
+    std::filesystem::remove_all(dir_template);
+}
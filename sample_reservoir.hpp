@@ -0,0 +1,127 @@
+#ifndef SAMPLE_RESERVOIR_HPP
+#define SAMPLE_RESERVOIR_HPP
+
+#include "./pixel_sampling.hpp"
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+/**
+ * The number of samples of each bucket that are written, and thus the number of samples that
+ * a sample_reservoir keeps
+*/
+constexpr size_t sample_reservoir_capacity = 1024;
+
+/**
+ * A uniformly random subset of at most sample_reservoir_capacity of the count samples seen, in
+ * random order. Any prefix of samples is thus also a uniformly random subset. The random
+ * sequence is carried in state, so that the subset only depends on the samples and on the seeds
+ * they were added with, and not on when or where the reservoir was stored.
+*/
+template<class T>
+struct sample_reservoir
+{
+	std::vector<T> samples;
+	uint64_t count{0};
+	uint64_t state{0};
+
+	bool operator==(sample_reservoir const&) const = default;
+};
+
+/**
+ * Returns a number in [0, n), and advances state
+*/
+inline uint64_t next_random_index(uint64_t& state, uint64_t n)
+{
+	state = splitmix64(state);
+	return std::min(static_cast<uint64_t>(static_cast<double>(state >> 11)*0x1.0p-53*static_cast<double>(n)), n - 1);
+}
+
+/**
+ * Keeps a random subset of samples, picked by seed
+*/
+template<class T>
+sample_reservoir<T> make_sample_reservoir(std::vector<T>&& samples, uint64_t seed)
+{
+	sample_reservoir<T> ret{std::move(samples), 0, splitmix64(seed)};
+	auto& items = ret.samples;
+	ret.count = std::size(items);
+	auto const n = std::min(std::size(items), sample_reservoir_capacity);
+	for(size_t k = 0; k != n; ++k)
+	{ std::swap(items[k], items[k + next_random_index(ret.state, std::size(items) - k)]); }
+	items.resize(n);
+	items.shrink_to_fit();
+	return ret;
+}
+
+/**
+ * Merges other into into, so that the result is a random subset of the samples of both. Each
+ * sample is drawn from either reservoir with a probability proportional to the number of samples
+ * of that reservoir that have not been drawn yet.
+*/
+template<class T>
+void combine_samples(sample_reservoir<T>& into, sample_reservoir<T>&& other)
+{
+	if(other.count == 0)
+	{ return; }
+
+	if(into.count == 0)
+	{
+		into = std::move(other);
+		return;
+	}
+
+	auto state = splitmix64(into.state ^ std::rotl(other.state, 17));
+	auto const n = std::min(into.count + other.count, uint64_t{sample_reservoir_capacity});
+	std::vector<T> merged;
+	merged.reserve(n);
+	std::array<uint64_t, 2> remaining{into.count, other.count};
+	std::array<size_t, 2> taken{0, 0};
+	std::array<std::vector<T>*, 2> const sources{&into.samples, &other.samples};
+	for(uint64_t k = 0; k != n; ++k)
+	{
+		auto const src = next_random_index(state, remaining[0] + remaining[1]) < remaining[0] ? 0 : 1;
+		if(taken[src] == std::size(*sources[src]))
+		{ throw std::runtime_error{"Sample reservoir has fewer samples than its count"}; }
+		merged.push_back(std::move((*sources[src])[taken[src]]));
+		++taken[src];
+		--remaining[src];
+	}
+
+	into.samples = std::move(merged);
+	into.count += other.count;
+	into.state = state;
+}
+
+/**
+ * A reservoir for each bucket of a histogram of samples
+*/
+template<class T, size_t N>
+using bucket_reservoirs = std::array<sample_reservoir<T>, N>;
+
+/**
+ * Makes a reservoir of each bucket of histogram. Each bucket gets its own random sequence, that
+ * depends on seed.
+*/
+template<class T, size_t N>
+bucket_reservoirs<T, N> make_bucket_reservoirs(std::array<std::vector<T>, N>&& histogram, uint64_t seed)
+{
+	bucket_reservoirs<T, N> ret;
+	for(size_t k = 0; k != N; ++k)
+	{ ret[k] = make_sample_reservoir(std::move(histogram[k]), splitmix64(seed) ^ k); }
+	return ret;
+}
+
+template<class T, size_t N>
+void combine_samples(bucket_reservoirs<T, N>& into, bucket_reservoirs<T, N>&& other)
+{
+	for(size_t k = 0; k != N; ++k)
+	{ combine_samples(into[k], std::move(other[k])); }
+}
+
+#endif
@@ -0,0 +1,85 @@
+//@{"target":{"name":"sample_reservoir.test"}}
+
+#include "./sample_reservoir.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <set>
+#include <vector>
+#include <cassert>
+
+namespace
+{
+    std::vector<int> make_values(int first, int count)
+    {
+        std::vector<int> ret(count);
+        std::iota(std::begin(ret), std::end(ret), first);
+        return ret;
+    }
+}
+
+int main()
+{
+    // Small inputs are kept whole, large ones are cut to the capacity, without duplicates
+    {
+        auto const small = make_sample_reservoir(make_values(0, 10), 1);
+        assert(small.count == 10 && std::size(small.samples) == 10);
+        assert(std::set(std::begin(small.samples), std::end(small.samples)).size() == 10);
+
+        auto const large = make_sample_reservoir(make_values(0, 5000), 1);
+        assert(large.count == 5000 && std::size(large.samples) == sample_reservoir_capacity);
+        std::set const unique(std::begin(large.samples), std::end(large.samples));
+        assert(std::size(unique) == sample_reservoir_capacity);
+        assert(*unique.rbegin() < 5000);
+        assert(make_sample_reservoir(make_values(0, 5000), 1) == large);
+        assert(make_sample_reservoir(make_values(0, 5000), 2) != large);
+    }
+
+    // Combining keeps the counts, and takes samples in proportion to them
+    {
+        size_t from_first = 0;
+        size_t total = 0;
+        for(uint64_t seed = 0; seed != 64; ++seed)
+        {
+            auto into = make_sample_reservoir(make_values(0, 3000), 2*seed);
+            combine_samples(into, make_sample_reservoir(make_values(100000, 1000), 2*seed + 1));
+            assert(into.count == 4000 && std::size(into.samples) == sample_reservoir_capacity);
+            from_first += static_cast<size_t>(std::ranges::count_if(into.samples, [](int val){ return val < 100000; }));
+            total += std::size(into.samples);
+        }
+        auto const ratio = static_cast<double>(from_first)/static_cast<double>(total);
+        assert(ratio > 0.73 && ratio < 0.77);
+    }
+
+    // Small reservoirs are merged whole, and empty ones change nothing
+    {
+        auto into = make_sample_reservoir(make_values(0, 10), 3);
+        auto const before = into;
+        combine_samples(into, sample_reservoir<int>{});
+        assert(into == before);
+
+        combine_samples(into, make_sample_reservoir(make_values(10, 20), 4));
+        assert(into.count == 30);
+        auto samples = into.samples;
+        std::ranges::sort(samples);
+        assert(samples == make_values(0, 30));
+
+        sample_reservoir<int> empty{};
+        combine_samples(empty, std::move(into));
+        assert(empty.count == 30);
+    }
+
+    // A reservoir that claims more samples than it has is rejected when drawn from
+    {
+        auto into = make_sample_reservoir(make_values(0, 10), 5);
+        into.count = 100000;
+        auto other = make_sample_reservoir(make_values(10, 10), 6);
+        try
+        {
+            combine_samples(into, std::move(other));
+            assert(false);
+        }
+        catch(std::runtime_error const&)
+        {}
+    }
+}
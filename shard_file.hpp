@@ -0,0 +1,157 @@
+#ifndef SHARD_FILE_HPP
+#define SHARD_FILE_HPP
+
+#include "./result_cache.hpp"
+#include "./file.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Bump when the layout of shard files changes
+*/
+constexpr uint64_t shard_file_version = 2;
+
+/**
+ * Selects shard index of count, given as <index>/<count>. Shard k processes the k:th contiguous
+ * range of the chunks of every region, so all shards together process each chunk once.
+*/
+struct shard_option
+{
+	shard_option() = default;
+
+	explicit shard_option(std::string const& str)
+	{
+		auto const i = str.find('/');
+		if(i == std::string::npos)
+		{ throw std::runtime_error{std::string{"Shard must be given as <index>/<count>, got "}.append(str)}; }
+
+		index = std::stoull(str.substr(0, i));
+		count = std::stoull(str.substr(i + 1));
+		if(count == 0 || index >= count)
+		{ throw std::runtime_error{std::string{"Shard index out of range: "}.append(str)}; }
+	}
+
+	size_t index{0};
+	size_t count{1};
+
+	size_t chunk_begin(size_t chunk_count) const
+	{ return index*chunk_count/count; }
+
+	size_t chunk_end(size_t chunk_count) const
+	{ return (index + 1)*chunk_count/count; }
+};
+
+/**
+ * Written first in a shard file. params holds everything besides the inputs that the result
+ * depends on, and must be the same in all shards that are merged.
+*/
+struct shard_header
+{
+	uint64_t version{shard_file_version};
+	std::string analysis;
+	std::string params;
+	uint64_t index{0};
+	uint64_t count{1};
+	uint64_t region_count{0};
+};
+
+/**
+ * The part of a region that a shard has processed. partials holds the results of chunks
+ * [first_chunk, first_chunk + size(partials)), out of chunk_count.
+*/
+template<class Partial>
+struct shard_region
+{
+	std::string input;
+	uint64_t chunk_count{0};
+	uint64_t first_chunk{0};
+	std::vector<Partial> partials;
+};
+
+inline void write_shard_header(FILE* dest, shard_header const& header)
+{
+	write_binary(dest, header.version);
+	write_binary(dest, header.analysis);
+	write_binary(dest, header.params);
+	write_binary(dest, header.index);
+	write_binary(dest, header.count);
+	write_binary(dest, header.region_count);
+}
+
+inline shard_header read_shard_header(FILE* src)
+{
+	shard_header ret{};
+	read_binary(src, ret.version);
+	if(ret.version != shard_file_version)
+	{ throw std::runtime_error{"Unsupported shard file version"}; }
+
+	read_binary(src, ret.analysis);
+	read_binary(src, ret.params);
+	read_binary(src, ret.index);
+	read_binary(src, ret.count);
+	read_binary(src, ret.region_count);
+	return ret;
+}
+
+template<class Partial>
+void write_shard_region(FILE* dest, shard_region<Partial> const& region)
+{
+	write_binary(dest, region.input);
+	write_binary(dest, region.chunk_count);
+	write_binary(dest, region.first_chunk);
+	write_binary(dest, region.partials);
+}
+
+template<class Partial>
+shard_region<Partial> read_shard_region(FILE* src)
+{
+	shard_region<Partial> ret;
+	read_binary(src, ret.input);
+	read_binary(src, ret.chunk_count);
+	read_binary(src, ret.first_chunk);
+	read_binary(src, ret.partials);
+	return ret;
+}
+
+/**
+ * Writes a shard file to a temporary file, which is renamed to filename by finish, so an
+ * interrupted shard never leaves a file that looks complete
+*/
+class shard_writer
+{
+public:
+	explicit shard_writer(std::string filename, shard_header const& header):
+		m_filename{std::move(filename)},
+		m_tmp_name{std::string{m_filename}.append(".tmp")},
+		m_dest{m_tmp_name, "wb"}
+	{ write_shard_header(m_dest.get(), header); }
+
+	template<class Partial>
+	void write_region(shard_region<Partial> const& region)
+	{ write_shard_region(m_dest.get(), region); }
+
+	/**
+	 * Writes state, which holds whatever the output depends on besides the merged partial
+	 * results, and renames the file into place
+	*/
+	void finish(std::string const& state)
+	{
+		write_binary(m_dest.get(), state);
+		if(fflush(m_dest.get()) != 0)
+		{ throw std::runtime_error{std::string{"Failed to write "}.append(m_tmp_name)}; }
+		m_dest = file{};
+		if(rename(m_tmp_name.c_str(), m_filename.c_str()) != 0)
+		{ throw std::runtime_error{std::string{"Failed to store "}.append(m_filename)}; }
+	}
+
+private:
+	std::string m_filename;
+	std::string m_tmp_name;
+	file m_dest;
+};
+
+#endif
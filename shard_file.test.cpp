@@ -0,0 +1,64 @@
+//@{"target":{"name":"shard_file.test"}}
+
+#include "./shard_file.hpp"
+
+#include <array>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <cassert>
+
+int main()
+{
+    // The shards cover each chunk exactly once, also when there are more shards than chunks
+    for(size_t shard_count : {1, 3, 7, 20})
+    {
+        for(size_t chunk_count : {0, 1, 5, 11, 64})
+        {
+            size_t next = 0;
+            for(size_t k = 0; k != shard_count; ++k)
+            {
+                auto const shard = shard_option{std::to_string(k) + "/" + std::to_string(shard_count)};
+                assert(shard.chunk_begin(chunk_count) == next);
+                assert(shard.chunk_end(chunk_count) >= next);
+                next = shard.chunk_end(chunk_count);
+            }
+            assert(next == chunk_count);
+        }
+    }
+
+    // Headers and regions round-trip
+    {
+        using partial = std::array<double, 4>;
+        auto const tmp = tmpfile();
+        assert(tmp != nullptr);
+        file::handle const owner{tmp};
+
+        shard_header const header{shard_file_version, "elev_hist", "pixel_format=0", 2, 5, 1};
+        shard_region<partial> const region{"a.tif,a_mask.data", 11, 4, {partial{1.0, 2.0, 3.0, 4.0}, partial{}}};
+        write_shard_header(tmp, header);
+        write_shard_region(tmp, region);
+        rewind(tmp);
+
+        auto const header_read = read_shard_header(tmp);
+        assert(header_read.analysis == header.analysis);
+        assert(header_read.params == header.params);
+        assert(header_read.index == 2 && header_read.count == 5 && header_read.region_count == 1);
+
+        auto const region_read = read_shard_region<partial>(tmp);
+        assert(region_read.input == region.input);
+        assert(region_read.chunk_count == 11 && region_read.first_chunk == 4);
+        assert(region_read.partials == region.partials);
+    }
+
+    // Malformed shard options are rejected
+    for(auto str : {"1", "3/3", "0/0"})
+    {
+        auto rejected = false;
+        try
+        { shard_option{str}; }
+        catch(std::runtime_error const&)
+        { rejected = true; }
+        assert(rejected);
+    }
+}
@@ -1,49 +1,146 @@
 //@	{"target":{"name":"skip_bytes.o"}}
 
 #include "./cmdline.hpp"
+#include "./strided_copy.hpp"
 
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
 
-template<std::integral Int>
-struct value
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct extract_params
 {
-	value():val{0}{}
+	size_t elem_size;
+	size_t stride;
+	size_t phase;
+};
 
-	explicit value(std::string const& str)
+struct mapping_releaser
+{
+	size_t size;
+
+	void operator()(void* ptr) const
 	{
-		val = atoll(str.c_str());
+		if(ptr != nullptr)
+		{ munmap(ptr, size); }
 	}
+};
 
-	Int get() const { return val;}
+void write_all(std::byte const* buffer, size_t size)
+{
+	if(fwrite(buffer, 1, size, stdout) != size)
+	{ throw std::runtime_error{"Failed to write output"}; }
+}
 
-	Int val;
-};
+size_t get_output_count(size_t n_in, extract_params const& params)
+{
+	return n_in > params.phase ? (n_in - params.phase - 1)/params.stride + 1 : 0;
+}
 
-int main(int argc, char** argv)
+size_t extract_mapped(std::byte const* src, size_t size, extract_params const& params, size_t thread_count)
 {
-	command_line const opts{argc, argv};
+	auto const n_out = get_output_count(size/params.elem_size, params);
+	auto const src_begin = src + params.phase*params.elem_size;
 
-	auto const offset = get_or(opts, "offset", value<size_t>{}).get();
-	auto const stride = get_or(opts, "stride", value<size_t>{}).get();
+	// Process the file in rounds, so the output buffer stays bounded
+	constexpr size_t bytes_per_thread = 1 << 22;
+	auto const elems_per_thread = std::max(bytes_per_thread/params.elem_size, size_t{1});
+	auto const elems_per_round = elems_per_thread*thread_count;
+	auto buffer = std::make_unique<std::byte[]>(elems_per_round*params.elem_size);
+
+	std::vector<std::thread> workers;
+	for(size_t round_begin = 0; round_begin < n_out; round_begin += elems_per_round)
+	{
+		auto const round_end = std::min(round_begin + elems_per_round, n_out);
+		for(size_t k = 0; k != thread_count; ++k)
+		{
+			auto const begin = std::min(round_begin + k*elems_per_thread, round_end);
+			auto const end = std::min(begin + elems_per_thread, round_end);
+			if(begin == end)
+			{ break; }
+
+			workers.emplace_back([src = src_begin + begin*params.stride*params.elem_size,
+				dest = buffer.get() + (begin - round_begin)*params.elem_size,
+				n = end - begin,
+				params](){
+				strided_copy_any(src, n, dest, params.elem_size, params.stride);
+			});
+		}
+
+		std::ranges::for_each(workers, [](auto& item){ item.join(); });
+		workers.clear();
+		write_all(buffer.get(), (round_end - round_begin)*params.elem_size);
+	}
+
+	return n_out*params.elem_size;
+}
+
+std::pair<size_t, size_t> extract_stream(FILE* src, extract_params const& params)
+{
+	// Each block starts at an element index that is a multiple of stride, so the phase is the
+	// same for all blocks
+	auto const block_elems = std::max((size_t{1} << 22)/(params.elem_size*params.stride), size_t{1})*params.stride;
+	auto const block_size = block_elems*params.elem_size;
+	auto input = std::make_unique<std::byte[]>(block_size);
+	auto output = std::make_unique<std::byte[]>(block_size/params.stride);
 
 	size_t bytes_read = 0;
 	size_t bytes_written = 0;
 	while(true)
 	{
-		auto ch_in = getchar();
+		auto const n = fread(input.get(), 1, block_size, src);
+		bytes_read += n;
 
-		if(ch_in == EOF)
+		auto const n_out = get_output_count(n/params.elem_size, params);
+		strided_copy_any(input.get() + params.phase*params.elem_size, n_out, output.get(),
+			params.elem_size, params.stride);
+		write_all(output.get(), n_out*params.elem_size);
+		bytes_written += n_out*params.elem_size;
+
+		if(n != block_size)
 		{ break; }
+	}
 
-		if((bytes_read + offset)%stride == 0)
-		{
-			putchar(ch_in);
-			++bytes_written;
-		}
-		++bytes_read;
+	return std::pair{bytes_read, bytes_written};
+}
+
+int main(int argc, char** argv)
+{
+	command_line const opts{argc, argv};
+
+	auto const offset = get_or(opts, "offset", value<size_t>{}).get();
+	auto const stride = std::max(get_or(opts, "stride", value<size_t>{1}).get(), size_t{1});
+	auto const elem_size = std::max(get_or(opts, "element_size", value<size_t>{1}).get(), size_t{1});
+	auto const thread_count = std::max(get_or(opts, "threads",
+		value<size_t>{std::thread::hardware_concurrency()}).get(), size_t{1});
+
+	// An element with index k is selected when (k + offset)%stride == 0
+	extract_params const params{elem_size, stride, (stride - offset%stride)%stride};
+
+	struct stat statbuf{};
+	fstat(fileno(stdin), &statbuf);
+	if(S_ISREG(statbuf.st_mode) && statbuf.st_size != 0)
+	{
+		auto const size = static_cast<size_t>(statbuf.st_size);
+		auto const ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileno(stdin), 0);
+		if(ptr == MAP_FAILED)
+		{ throw std::runtime_error{"Failed to map input"}; }
+
+		std::unique_ptr<void, mapping_releaser> mapping{ptr, mapping_releaser{size}};
+		madvise(ptr, size, MADV_SEQUENTIAL);
+
+		auto const bytes_written = extract_mapped(static_cast<std::byte const*>(ptr), size, params, thread_count);
+		fprintf(stderr, "%zu bytes in, %zu bytes out\n", size, bytes_written);
+		return 0;
 	}
 
+	auto const [bytes_read, bytes_written] = extract_stream(stdin, params);
 	fprintf(stderr, "%zu bytes in, %zu bytes out\n", bytes_read, bytes_written);
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,302 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include "./file.hpp"
+#include "./cmdline.hpp"
+#include "./perf_counters.hpp"
+
+#include <cstdio>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <sys/resource.h>
+
+inline void write_json_string(FILE* dest, std::string_view str)
+{
+	putc('"', dest);
+	std::ranges::for_each(str, [dest](auto ch){
+		if(ch == '"' || ch == '\\')
+		{ putc('\\', dest); }
+		putc(ch, dest);
+	});
+	putc('"', dest);
+}
+
+struct phase_stats
+{
+	std::string name;
+	char const* unit;
+	double seconds;
+	size_t calls;
+	size_t count;
+	perf_counter_values counters;
+};
+
+struct region_stats
+{
+	std::string name;
+	std::vector<phase_stats> phases;
+};
+
+/**
+ * Collects wall-clock time and item counts per phase and region, for the entire run. Phases
+ * are reported in the order they were first entered. When hardware counters are enabled, each
+ * phase also gets counter totals for the threads that entered it. Nothing is collected until
+ * enable is called, so timers cost next to nothing in runs without a report.
+*/
+class run_stats
+{
+public:
+	run_stats():m_start{std::chrono::steady_clock::now()}, m_regions{region_stats{"", {}}}
+	{}
+
+	/**
+	 * Makes name the current region of the calling thread. Phases of a thread are added to
+	 * its current region, which is created the first time it is entered.
+	*/
+	void begin_region(std::string_view name)
+	{
+		std::lock_guard lock{m_mutex};
+		auto const i = std::ranges::find_if(m_regions, [name](auto const& item){ return item.name == name; });
+		current_region() = static_cast<size_t>(i - std::begin(m_regions));
+		if(i == std::end(m_regions))
+		{ m_regions.push_back(region_stats{std::string{name}, {}}); }
+	}
+
+	void enable()
+	{ m_enabled.store(true, std::memory_order_relaxed); }
+
+	bool enabled() const
+	{ return m_enabled.load(std::memory_order_relaxed); }
+
+	/**
+	 * Enables hardware counters for phases entered after this call. Returns false, and keeps
+	 * counters disabled, if no counter could be opened for the calling thread.
+	*/
+	bool enable_counters()
+	{
+		auto const& counters = get_thread_perf_counters();
+		if(!counters.valid())
+		{
+			std::lock_guard lock{m_mutex};
+			m_counter_error = counters.error();
+			return false;
+		}
+		m_counters_enabled.store(true, std::memory_order_relaxed);
+		enable();
+		return true;
+	}
+
+	bool counters_enabled() const
+	{ return m_counters_enabled.load(std::memory_order_relaxed); }
+
+	void add(char const* phase, char const* unit, double seconds, size_t count,
+		perf_counter_values const& counters = perf_counter_values{})
+	{
+		std::lock_guard lock{m_mutex};
+		auto& phases = m_regions[current_region()].phases;
+		auto i = std::ranges::find_if(phases, [phase](auto const& item){ return item.name == phase; });
+		if(i == std::end(phases))
+		{
+			phases.push_back(phase_stats{phase, unit, 0.0, 0, 0, perf_counter_values{}});
+			i = std::end(phases) - 1;
+		}
+		i->seconds += seconds;
+		++i->calls;
+		i->count += count;
+		i->counters += counters;
+	}
+
+	void write_report(FILE* dest) const
+	{
+		std::lock_guard lock{m_mutex};
+		rusage usage{};
+		getrusage(RUSAGE_SELF, &usage);
+		auto const total = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+
+		fprintf(dest, "{\"seconds\": %.6g, \"peak_rss_kib\": %ld, ", total, usage.ru_maxrss);
+		if(m_counter_error != 0)
+		{
+			fputs("\"perf_counters\": ", dest);
+			write_json_string(dest, strerror(m_counter_error));
+			fputs(", ", dest);
+		}
+		fputs("\"regions\": [", dest);
+		auto first_region = true;
+		for(auto const& region : m_regions)
+		{
+			if(region.name.empty() && region.phases.empty())
+			{ continue; }
+
+			fprintf(dest, "%s\n  {\"name\": ", first_region ? "" : ",");
+			write_json_string(dest, region.name);
+			fputs(", \"phases\": {", dest);
+			first_region = false;
+			for(auto const& phase : region.phases)
+			{
+				fprintf(dest, "%s\n    \"%s\": {\"seconds\": %.6g, \"calls\": %zu",
+					&phase == std::data(region.phases) ? "" : ",",
+					phase.name.c_str(),
+					phase.seconds,
+					phase.calls);
+				if(phase.count != 0)
+				{
+					fprintf(dest, ", \"%s\": %zu, \"%s_per_second\": %.6g",
+						phase.unit, phase.count, phase.unit, static_cast<double>(phase.count)/phase.seconds);
+				}
+				write_counters(dest, phase);
+				fputs("}", dest);
+			}
+			fputs("\n  }}", dest);
+		}
+		fputs("\n]}\n", dest);
+	}
+
+private:
+	static size_t& current_region()
+	{
+		thread_local size_t index = 0;
+		return index;
+	}
+
+	static void write_counters(FILE* dest, phase_stats const& phase)
+	{
+		auto const& counters = phase.counters;
+		for(size_t k = 0; k != perf_counter_count; ++k)
+		{
+			if(!counters.available[k])
+			{ continue; }
+
+			fprintf(dest, ", \"%s\": %lu", perf_counter_names[k], counters.values[k]);
+			if(phase.count != 0 && k != static_cast<size_t>(perf_counter::instructions))
+			{
+				fprintf(dest, ", \"%s_per_%s\": %.6g", perf_counter_names[k], phase.unit,
+					static_cast<double>(counters.values[k])/static_cast<double>(phase.count));
+			}
+		}
+
+		if(counters.has(perf_counter::cycles) && counters.has(perf_counter::instructions)
+			&& counters[perf_counter::cycles] != 0)
+		{
+			fprintf(dest, ", \"ipc\": %.4g", static_cast<double>(counters[perf_counter::instructions])
+				/static_cast<double>(counters[perf_counter::cycles]));
+		}
+	}
+
+	mutable std::mutex m_mutex;
+	std::atomic<bool> m_enabled{false};
+	std::atomic<bool> m_counters_enabled{false};
+	int m_counter_error{0};
+	std::chrono::steady_clock::time_point m_start;
+	std::vector<region_stats> m_regions;
+};
+
+inline run_stats& get_run_stats()
+{
+	static run_stats stats;
+	return stats;
+}
+
+/**
+ * Measures the time, and hardware counters if enabled, from construction to destruction, and
+ * adds it to phase
+*/
+class scoped_timer
+{
+public:
+	explicit scoped_timer(char const* phase, size_t count = 0, char const* unit = "pixels"):
+		m_phase{phase},
+		m_unit{unit},
+		m_count{count},
+		m_enabled{get_run_stats().enabled()},
+		m_start_counters{get_run_stats().counters_enabled() ? get_thread_perf_counters().read() : std::nullopt},
+		m_start{m_enabled ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{}}
+	{}
+
+	scoped_timer(scoped_timer const&) = delete;
+	scoped_timer& operator=(scoped_timer const&) = delete;
+
+	~scoped_timer()
+	{
+		if(!m_enabled)
+		{ return; }
+
+		auto const t = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+		auto const end_counters = m_start_counters.has_value() ? get_thread_perf_counters().read() : std::nullopt;
+		get_run_stats().add(m_phase, m_unit, t, m_count,
+			end_counters.has_value() ? *end_counters - *m_start_counters : perf_counter_values{});
+	}
+
+	void set_count(size_t count)
+	{ m_count = count; }
+
+private:
+	char const* m_phase;
+	char const* m_unit;
+	size_t m_count;
+	bool m_enabled;
+	std::optional<perf_counter_values> m_start_counters;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+template<class Func>
+decltype(auto) timed(char const* phase, size_t count, Func&& f)
+{
+	scoped_timer timer{phase, count};
+	return f();
+}
+
+/**
+ * Enables the report if --stats= is given. --profile=counters adds hardware counters to all
+ * phases, and writes the report to stderr unless --stats= says otherwise. Without counter
+ * support, a warning is printed and only wall-clock time is reported.
+*/
+inline void configure_run_stats(command_line const& options)
+{
+	auto const dest = get_or(options, "stats", std::string{"none"});
+	if(dest != "none")
+	{ get_run_stats().enable(); }
+
+	auto const profile = get_or(options, "profile", std::string{"time"});
+	if(profile == "time")
+	{ return; }
+
+	if(profile != "counters")
+	{ throw std::runtime_error{std::string{"Unsupported profile mode "}.append(profile)}; }
+
+	if(!get_run_stats().enable_counters())
+	{
+		fputs("Hardware counters are unavailable, reporting wall-clock time only\n", stderr);
+		get_run_stats().enable();
+	}
+}
+
+/**
+ * Writes the report to the file given by --stats=, or to stderr with --stats=-. There is no
+ * report unless configure_run_stats has enabled it.
+*/
+inline void write_stats_report(command_line const& options)
+{
+	if(!get_run_stats().enabled())
+	{ return; }
+
+	auto const dest = get_or(options, "stats", std::string{"-"});
+	if(dest == "none")
+	{ return; }
+
+	if(dest == "-")
+	{
+		get_run_stats().write_report(stderr);
+		return;
+	}
+
+	file const output{dest, "wb"};
+	get_run_stats().write_report(output.get());
+}
+
+#endif
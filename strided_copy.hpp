@@ -0,0 +1,108 @@
+#ifndef STRIDED_COPY_HPP
+#define STRIDED_COPY_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <array>
+#include <bit>
+#include <utility>
+
+template<class T>
+struct simd_vector
+{
+	typedef T type __attribute__((vector_size(16)));
+};
+
+template<class T>
+using simd_vector_t = typename simd_vector<T>::type;
+
+template<size_t ElemSize>
+struct uint_of_size;
+
+template<> struct uint_of_size<1>{ using type = uint8_t; };
+template<> struct uint_of_size<2>{ using type = uint16_t; };
+template<> struct uint_of_size<4>{ using type = uint32_t; };
+template<> struct uint_of_size<8>{ using type = uint64_t; };
+
+template<class T, size_t ... Lanes>
+constexpr auto even_lanes(std::index_sequence<Lanes...>)
+{
+	return simd_vector_t<T>{static_cast<T>(2*Lanes)...};
+}
+
+/**
+ * Copies every Stride:th element of src to dest, starting with the first element. Each group
+ * of Stride input vectors is reduced to one output vector by repeatedly keeping the even lanes
+ * of pairs of vectors. Elements that do not fill a complete group are copied one by one.
+*/
+template<size_t ElemSize, size_t Stride>
+requires(std::has_single_bit(Stride) && Stride >= 2)
+void strided_copy(std::byte const* src, size_t n_out, std::byte* dest)
+{
+	using elem_type = typename uint_of_size<ElemSize>::type;
+	using vec_type = simd_vector_t<elem_type>;
+	constexpr auto lanes = sizeof(vec_type)/ElemSize;
+	constexpr auto mask = even_lanes<elem_type>(std::make_index_sequence<lanes>{});
+
+	// Stop before the last group, so nothing beyond the last selected element is read
+	size_t k = 0;
+	for(; k + lanes < n_out; k += lanes)
+	{
+		std::array<vec_type, Stride> vecs;
+		memcpy(std::data(vecs), src + k*Stride*ElemSize, sizeof(vecs));
+		for(size_t n = Stride; n != 1; n /= 2)
+		{
+			for(size_t l = 0; l != n/2; ++l)
+			{ vecs[l] = __builtin_shuffle(vecs[2*l], vecs[2*l + 1], mask); }
+		}
+		memcpy(dest + k*ElemSize, &vecs[0], sizeof(vec_type));
+	}
+
+	for(; k != n_out; ++k)
+	{ memcpy(dest + k*ElemSize, src + k*Stride*ElemSize, ElemSize); }
+}
+
+inline void strided_copy(std::byte const* src, size_t n_out, std::byte* dest, size_t elem_size, size_t stride)
+{
+	for(size_t k = 0; k != n_out; ++k)
+	{ memcpy(dest + k*elem_size, src + k*stride*elem_size, elem_size); }
+}
+
+namespace strided_copy_detail
+{
+	template<size_t ElemSize, size_t ... Strides>
+	bool dispatch(std::byte const* src, size_t n_out, std::byte* dest, size_t stride,
+		std::index_sequence<Strides...>)
+	{
+		return ((stride == (size_t{2} << Strides) ?
+			(strided_copy<ElemSize, (size_t{2} << Strides)>(src, n_out, dest), true) : false) || ...);
+	}
+
+	template<size_t ... ElemSizeLog2>
+	bool dispatch(std::byte const* src, size_t n_out, std::byte* dest, size_t elem_size, size_t stride,
+		std::index_sequence<ElemSizeLog2...>)
+	{
+		return ((elem_size == (size_t{1} << ElemSizeLog2) ?
+			dispatch<(size_t{1} << ElemSizeLog2)>(src, n_out, dest, stride, std::make_index_sequence<4>{})
+				: false) || ...);
+	}
+}
+
+/**
+ * Copies n_out elements of elem_size bytes, taking every stride:th element of src. Element sizes
+ * of 1, 2, 4, and 8 bytes combined with strides of 2, 4, 8, and 16 use a vectorized kernel.
+*/
+inline void strided_copy_any(std::byte const* src, size_t n_out, std::byte* dest, size_t elem_size, size_t stride)
+{
+	if(stride == 1)
+	{
+		memcpy(dest, src, n_out*elem_size);
+		return;
+	}
+
+	if(!strided_copy_detail::dispatch(src, n_out, dest, elem_size, stride, std::make_index_sequence<4>{}))
+	{ strided_copy(src, n_out, dest, elem_size, stride); }
+}
+
+#endif
@@ -0,0 +1,40 @@
+//@{"target":{"name":"strided_copy.test"}}
+
+#include "./strided_copy.hpp"
+
+#include <vector>
+#include <cassert>
+
+int main()
+{
+    std::vector<std::byte> input(4096 + 7);
+    for(size_t k = 0; k != std::size(input); ++k)
+    { input[k] = static_cast<std::byte>(k*31 + k/256); }
+
+    for(size_t elem_size : {1, 2, 3, 4, 8})
+    {
+        for(size_t stride : {1, 2, 3, 4, 8, 16})
+        {
+            auto const n_out = std::size(input)/(elem_size*stride);
+            std::vector<std::byte> expected(n_out*elem_size);
+            std::vector<std::byte> output(n_out*elem_size);
+            strided_copy(std::data(input), n_out, std::data(expected), elem_size, stride);
+            strided_copy_any(std::data(input), n_out, std::data(output), elem_size, stride);
+            assert(output == expected);
+
+            // The last selected element may be the last element of the input
+            std::vector<std::byte> tight(std::begin(input),
+                std::begin(input) + ((n_out - 1)*stride + 1)*elem_size);
+            strided_copy_any(std::data(tight), n_out, std::data(output), elem_size, stride);
+            assert(output == expected);
+        }
+    }
+
+    {
+        std::array<float, 6> vals{1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f};
+        std::array<float, 3> output{};
+        strided_copy_any(reinterpret_cast<std::byte const*>(std::data(vals) + 1), 3,
+            reinterpret_cast<std::byte*>(std::data(output)), sizeof(float), 2);
+        assert((output == std::array<float, 3>{2.0f, 4.0f, 6.0f}));
+    }
+}
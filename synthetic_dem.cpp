@@ -0,0 +1,192 @@
+//@	{"target":{"name":"synthetic_dem.o"}}
+
+#include "./synthetic_dem.hpp"
+#include "./file.hpp"
+
+#include <array>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+	float smoothstep(float x)
+	{ return x*x*(3.0f - 2.0f*x); }
+
+	void add_octave(float* output, image_size size, size_t cell_size, float amplitude, std::mt19937& rng)
+	{
+		auto const grid_w = size.sizes[0]/cell_size + 2;
+		auto const grid_h = size.sizes[1]/cell_size + 2;
+		std::vector<float> grid(grid_w*grid_h);
+		std::uniform_real_distribution u{0.0f, 1.0f};
+		std::ranges::generate(grid, [&rng, &u](){ return u(rng); });
+
+		for(size_t y = 0; y != size.sizes[1]; ++y)
+		{
+			auto const gy = y/cell_size;
+			auto const ty = smoothstep(static_cast<float>(y%cell_size)/static_cast<float>(cell_size));
+			for(size_t x = 0; x != size.sizes[0]; ++x)
+			{
+				auto const gx = x/cell_size;
+				auto const tx = smoothstep(static_cast<float>(x%cell_size)/static_cast<float>(cell_size));
+				auto const z_00 = grid[gy*grid_w + gx];
+				auto const z_10 = grid[gy*grid_w + gx + 1];
+				auto const z_01 = grid[(gy + 1)*grid_w + gx];
+				auto const z_11 = grid[(gy + 1)*grid_w + gx + 1];
+				auto const z_x0 = (1.0f - tx)*z_00 + tx*z_10;
+				auto const z_x1 = (1.0f - tx)*z_01 + tx*z_11;
+				output[y*size.sizes[0] + x] += amplitude*((1.0f - ty)*z_x0 + ty*z_x1);
+			}
+		}
+	}
+
+	uint16_t to_tiff_compression(synthetic_compression compression)
+	{
+		switch(compression)
+		{
+			case synthetic_compression::none:
+				return COMPRESSION_NONE;
+			case synthetic_compression::lzw:
+				return COMPRESSION_LZW;
+			case synthetic_compression::deflate:
+				return COMPRESSION_ADOBE_DEFLATE;
+		}
+		throw std::runtime_error{"Unsupported compression method"};
+	}
+
+	void write_pixels(TIFF* handle, float const* pixels, image_size size, strip_info strip)
+	{
+		TIFFSetField(handle, TIFFTAG_ROWSPERSTRIP, static_cast<uint32_t>(strip.rows_per_strip));
+		for(size_t k = 0; k != size.sizes[1]; ++k)
+		{
+			if(TIFFWriteScanline(handle, const_cast<float*>(pixels + k*size.sizes[0]), static_cast<uint32_t>(k), 0) < 0)
+			{ throw std::runtime_error{"Failed to write scanline"}; }
+		}
+	}
+
+	void write_pixels(TIFF* handle, float const* pixels, image_size size, tile_info tile)
+	{
+		TIFFSetField(handle, TIFFTAG_TILEWIDTH, static_cast<uint32_t>(tile.sizes[0]));
+		TIFFSetField(handle, TIFFTAG_TILELENGTH, static_cast<uint32_t>(tile.sizes[1]));
+
+		auto tile_buffer = std::make_unique<float[]>(tile.sizes[0]*tile.sizes[1]);
+		for(size_t y = 0; y < size.sizes[1]; y += tile.sizes[1])
+		{
+			for(size_t x = 0; x < size.sizes[0]; x += tile.sizes[0])
+			{
+				// Partial tiles at the right and bottom edges are padded with zeros
+				std::fill_n(tile_buffer.get(), tile.sizes[0]*tile.sizes[1], 0.0f);
+				auto const rows = std::min(static_cast<size_t>(tile.sizes[1]), static_cast<size_t>(size.sizes[1] - y));
+				auto const cols = std::min(static_cast<size_t>(tile.sizes[0]), static_cast<size_t>(size.sizes[0] - x));
+				for(size_t k = 0; k != rows; ++k)
+				{
+					std::copy_n(pixels + (y + k)*size.sizes[0] + x, cols, tile_buffer.get() + k*tile.sizes[0]);
+				}
+
+				if(TIFFWriteTile(handle, tile_buffer.get(), static_cast<uint32_t>(x), static_cast<uint32_t>(y), 0, 0) < 0)
+				{ throw std::runtime_error{"Failed to write tile"}; }
+			}
+		}
+	}
+}
+
+std::unique_ptr<float[]> make_synthetic_heightmap(image_size size, uint32_t seed)
+{
+	auto const pixel_count = size.sizes[0]*size.sizes[1];
+	auto ret = std::make_unique<float[]>(pixel_count);
+	std::mt19937 rng{seed};
+
+	auto cell_size = std::max(static_cast<size_t>(std::max(size.sizes[0], size.sizes[1])/4), size_t{2});
+	auto amplitude = 0.5f;
+	auto amplitude_sum = 0.0f;
+	while(cell_size >= 2)
+	{
+		add_octave(ret.get(), size, cell_size, amplitude, rng);
+		amplitude_sum += amplitude;
+		amplitude *= 0.5f;
+		cell_size /= 2;
+	}
+
+	std::for_each(ret.get(), ret.get() + pixel_count, [amplitude_sum](auto& val){
+		val = std::max(6600.0f*val/amplitude_sum - 600.0f, 0.0f);
+	});
+
+	return ret;
+}
+
+std::unique_ptr<uint8_t[]> make_synthetic_mask(image_size size)
+{
+	auto ret = std::make_unique<uint8_t[]>(size.sizes[0]*size.sizes[1]);
+	auto const r_x = 0.4f*static_cast<float>(size.sizes[0]);
+	auto const r_y = 0.4f*static_cast<float>(size.sizes[1]);
+	auto const c_x = 0.5f*static_cast<float>(size.sizes[0]);
+	auto const c_y = 0.5f*static_cast<float>(size.sizes[1]);
+	for(size_t y = 0; y != size.sizes[1]; ++y)
+	{
+		for(size_t x = 0; x != size.sizes[0]; ++x)
+		{
+			auto const dx = (static_cast<float>(x) - c_x)/r_x;
+			auto const dy = (static_cast<float>(y) - c_y)/r_y;
+			ret[y*size.sizes[0] + x] = dx*dx + dy*dy < 1.0f ? 1 : 0;
+		}
+	}
+	return ret;
+}
+
+void write_synthetic_dem(std::string const& tif_path,
+	std::string const& mask_path,
+	synthetic_dem_params const& params)
+{
+	auto const pixels = make_synthetic_heightmap(params.size, params.seed);
+
+	{
+		std::unique_ptr<TIFF, tiff_releaser> tiff{XTIFFOpen(tif_path.c_str(),
+			get_tiff_write_mode(params.size, sizeof(float)))};
+		if(tiff == nullptr)
+		{ throw std::runtime_error{std::string{"Failed to open "}.append(tif_path)}; }
+
+		auto const handle = tiff.get();
+		TIFFSetField(handle, TIFFTAG_IMAGEWIDTH, static_cast<uint32_t>(params.size.sizes[0]));
+		TIFFSetField(handle, TIFFTAG_IMAGELENGTH, static_cast<uint32_t>(params.size.sizes[1]));
+		TIFFSetField(handle, TIFFTAG_BITSPERSAMPLE, 32);
+		TIFFSetField(handle, TIFFTAG_SAMPLESPERPIXEL, 1);
+		TIFFSetField(handle, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
+		TIFFSetField(handle, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+		TIFFSetField(handle, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+		TIFFSetField(handle, TIFFTAG_COMPRESSION, to_tiff_compression(params.compression));
+		if(params.compression != synthetic_compression::none)
+		{
+			// Floating point predictor
+			TIFFSetField(handle, TIFFTAG_PREDICTOR, 3);
+		}
+
+		// One arc-second pixels, with the upper left corner at 10°E, 47°N
+		std::array<double, 3> const pixel_scale{1.0/3600.0, 1.0/3600.0, 0.0};
+		std::array<double, 6> const tie_points{0.0, 0.0, 0.0, 10.0, 47.0, 0.0};
+		TIFFSetField(handle, TIFFTAG_GEOPIXELSCALE, 3, std::data(pixel_scale));
+		TIFFSetField(handle, TIFFTAG_GEOTIEPOINTS, 6, std::data(tie_points));
+
+		{
+			std::unique_ptr<GTIF, gtif_releaser> gtif{GTIFNew(handle)};
+			if(gtif == nullptr)
+			{ throw std::runtime_error{"Failed to create GeoTIFF keys"}; }
+			GTIFKeySet(gtif.get(), GTModelTypeGeoKey, TYPE_SHORT, 1, ModelTypeGeographic);
+			GTIFKeySet(gtif.get(), GTRasterTypeGeoKey, TYPE_SHORT, 1, RasterPixelIsArea);
+			GTIFKeySet(gtif.get(), GeographicTypeGeoKey, TYPE_SHORT, 1, GCS_WGS_84);
+			GTIFWriteKeys(gtif.get());
+		}
+
+		std::visit([handle, &pixels, size = params.size](auto const& layout){
+			write_pixels(handle, pixels.get(), size, layout);
+		}, params.layout);
+	}
+
+	if(!mask_path.empty())
+	{
+		auto const mask = make_synthetic_mask(params.size);
+		file const dest{mask_path, "wb"};
+		auto const n = params.size.sizes[0]*params.size.sizes[1];
+		if(fwrite(mask.get(), 1, n, dest.get()) != n)
+		{ throw std::runtime_error{std::string{"Failed to write "}.append(mask_path)}; }
+	}
+}
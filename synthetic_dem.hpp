@@ -0,0 +1,43 @@
+//@	{"dependencies_extra":[{"ref":"./synthetic_dem.o", "rel":"implementation"},
+//@	{"ref":"libtiff-4","origin":"pkg-config"},
+//@	{"ref":"geotiff","origin":"system", "rel":"external"}]}
+
+#ifndef SYNTHETIC_DEM_HPP
+#define SYNTHETIC_DEM_HPP
+
+#include "./geotiff_loader.hpp"
+
+#include <cstdint>
+#include <string>
+#include <memory>
+
+enum class synthetic_compression:int{none, lzw, deflate};
+
+struct synthetic_dem_params
+{
+	image_size size;
+	image_layout layout;
+	synthetic_compression compression;
+	uint32_t seed;
+};
+
+/**
+ * Generates a fractal heightmap of the given size. Elevations are between 0 and about 6000 m,
+ * and roughly a tenth of the pixels are below 1 m, which the analyzers treat as sea level.
+*/
+std::unique_ptr<float[]> make_synthetic_heightmap(image_size size, uint32_t seed);
+
+/**
+ * Generates a mask that selects an ellipse centered in the image
+*/
+std::unique_ptr<uint8_t[]> make_synthetic_mask(image_size size);
+
+/**
+ * Writes a synthetic heightmap as a float32 GeoTIFF in geographic WGS 84 coordinates, with one
+ * arc-second pixels. If mask_path is non-empty, a matching mask is written there.
+*/
+void write_synthetic_dem(std::string const& tif_path,
+	std::string const& mask_path,
+	synthetic_dem_params const& params);
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef TABLE_WRITER_HPP
+#define TABLE_WRITER_HPP
+
+#include <cstdio>
+#include <cstdint>
+#include <array>
+#include <charconv>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <initializer_list>
+#include <span>
+
+enum class table_format:int{text, npy};
+
+struct table_format_option
+{
+	table_format_option() = default;
+
+	explicit table_format_option(std::string const& str)
+	{
+		if(str == "text")
+		{ value = table_format::text; }
+		else
+		if(str == "npy")
+		{ value = table_format::npy; }
+		else
+		{ throw std::runtime_error{std::string{"Unsupported output format "}.append(str)}; }
+	}
+
+	table_format value{table_format::text};
+};
+
+struct column_format
+{
+	std::chars_format format;
+	int precision;
+};
+
+/**
+ * Writes rows of numbers either as text, or as a float64 .npy array with one row per table row.
+ * The .npy array is stored in Fortran order, so each column is contiguous in the file and can
+ * be used directly from numpy.load(filename, mmap_mode='r').
+*/
+class table_writer
+{
+public:
+	explicit table_writer(FILE* dest, table_format format, std::vector<column_format> columns):
+		m_dest{dest},
+		m_format{format},
+		m_columns{std::move(columns)},
+		m_values(std::size(m_columns)),
+		m_text_end{std::data(m_text_buffer)}
+	{}
+
+	table_writer(table_writer const&) = delete;
+	table_writer& operator=(table_writer const&) = delete;
+
+	~table_writer()
+	{
+		// Best effort only, since a destructor must not throw. Call finish to detect errors.
+		if(m_format == table_format::text)
+		{ fwrite(std::data(m_text_buffer), 1, m_text_end - std::data(m_text_buffer), m_dest); }
+	}
+
+	void write_row(std::initializer_list<double> vals)
+	{ write_row(std::span{std::data(vals), std::size(vals)}); }
+
+	void write_row(std::span<double const> vals)
+	{
+		if(std::size(vals) != std::size(m_columns))
+		{ throw std::runtime_error{"Wrong number of columns"}; }
+
+		if(m_format == table_format::npy)
+		{
+			auto col = std::begin(m_values);
+			for(auto val : vals)
+			{
+				col->push_back(val);
+				++col;
+			}
+			return;
+		}
+
+		if(static_cast<size_t>(std::end(m_text_buffer) - m_text_end) < max_row_length*std::size(vals))
+		{ flush_text(); }
+
+		auto col = std::begin(m_columns);
+		for(auto val : vals)
+		{
+			if(col != std::begin(m_columns))
+			{ *m_text_end++ = ' '; }
+			m_text_end = std::to_chars(m_text_end, std::end(m_text_buffer), val, col->format, col->precision).ptr;
+			++col;
+		}
+		*m_text_end++ = '\n';
+	}
+
+	void finish()
+	{
+		if(m_format == table_format::text)
+		{
+			flush_text();
+			return;
+		}
+
+		auto const rows = std::size(m_values[0]);
+		auto header = std::string{"{'descr': '<f8', 'fortran_order': True, 'shape': ("}
+			.append(std::to_string(rows))
+			.append(", ")
+			.append(std::to_string(std::size(m_columns)))
+			.append("), }");
+
+		// Magic (6 bytes), version (2 bytes), and header length (2 bytes) precede the header.
+		// The total must be a multiple of 64, and the header must end with a newline.
+		constexpr size_t preamble_size = 10;
+		auto const padded_size = (preamble_size + std::size(header) + 1 + 63)/64*64;
+		header.append(padded_size - preamble_size - std::size(header) - 1, ' ').append(1, '\n');
+
+		auto const header_size = static_cast<uint16_t>(std::size(header));
+		std::array<char, preamble_size> const preamble{'\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0,
+			static_cast<char>(header_size & 0xff), static_cast<char>(header_size >> 8)};
+		write(std::data(preamble), std::size(preamble));
+		write(std::data(header), std::size(header));
+		std::ranges::for_each(m_values, [this](auto const& item){
+			write(std::data(item), std::size(item)*sizeof(double));
+		});
+		fflush(m_dest);
+	}
+
+private:
+	static constexpr size_t max_row_length = 32;
+
+	void write(void const* buffer, size_t size)
+	{
+		if(fwrite(buffer, 1, size, m_dest) != size)
+		{ throw std::runtime_error{"Failed to write output"}; }
+	}
+
+	void flush_text()
+	{
+		write(std::data(m_text_buffer), m_text_end - std::data(m_text_buffer));
+		m_text_end = std::data(m_text_buffer);
+	}
+
+	FILE* m_dest;
+	table_format m_format;
+	std::vector<column_format> m_columns;
+	std::vector<std::vector<double>> m_values;
+	std::array<char, 65536> m_text_buffer;
+	char* m_text_end;
+};
+
+#endif
@@ -0,0 +1,63 @@
+//@{"target":{"name":"table_writer.test"}}
+
+#include "./table_writer.hpp"
+
+#include <cstring>
+#include <cassert>
+
+namespace
+{
+    std::string read_all(FILE* f)
+    {
+        rewind(f);
+        std::string ret;
+        std::array<char, 4096> buffer;
+        while(auto n = fread(std::data(buffer), 1, std::size(buffer), f))
+        { ret.append(std::data(buffer), n); }
+        return ret;
+    }
+}
+
+int main()
+{
+    {
+        auto f = tmpfile();
+        {
+            table_writer writer{f, table_format::text, {{std::chars_format::scientific, 8}, {std::chars_format::general, 16}}};
+            writer.write_row({16.0, 1.0/3.0});
+            writer.write_row({-4096.5, 1.0e-20});
+            writer.finish();
+        }
+
+        std::array<char, 256> expected{};
+        snprintf(std::data(expected), std::size(expected), "%.8e %.16g\n%.8e %.16g\n", 16.0, 1.0/3.0, -4096.5, 1.0e-20);
+        assert(read_all(f) == std::data(expected));
+        fclose(f);
+    }
+
+    {
+        auto f = tmpfile();
+        {
+            table_writer writer{f, table_format::npy, {{std::chars_format::general, 8}, {std::chars_format::general, 8}}};
+            writer.write_row({1.0, 2.0});
+            writer.write_row({3.0, 4.0});
+            writer.write_row({5.0, 6.0});
+            writer.finish();
+        }
+
+        auto const data = read_all(f);
+        assert(data.starts_with("\x93NUMPY"));
+        auto const header_size = static_cast<size_t>(static_cast<uint8_t>(data[8]))
+            + 256*static_cast<size_t>(static_cast<uint8_t>(data[9]));
+        assert((10 + header_size)%64 == 0);
+        assert(data[10 + header_size - 1] == '\n');
+        assert(data.find("'shape': (3, 2)") != std::string::npos);
+        assert(std::size(data) == 10 + header_size + 6*sizeof(double));
+
+        // Columns are stored one after another
+        std::array<double, 6> vals{};
+        memcpy(std::data(vals), std::data(data) + 10 + header_size, sizeof(vals));
+        assert((vals == std::array<double, 6>{1.0, 3.0, 5.0, 2.0, 4.0, 6.0}));
+        fclose(f);
+    }
+}
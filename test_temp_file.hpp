@@ -0,0 +1,20 @@
+#ifndef TEST_TEMP_FILE_HPP
+#define TEST_TEMP_FILE_HPP
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include <unistd.h>
+
+/**
+ * Returns the name of a file in the temporary directory, which is unique to the calling process,
+ * for tests that write files
+*/
+inline std::string get_temp_name(std::string_view prefix, std::string_view suffix)
+{
+	return (std::filesystem::temp_directory_path()
+		/ std::string{prefix}.append("_").append(std::to_string(getpid())).append(suffix)).string();
+}
+
+#endif
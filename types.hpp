@@ -4,6 +4,9 @@
 #include <cstdint>
 #include <cstddef>
 #include <cmath>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
 #include <xmmintrin.h>
 
 using vec4_t [[gnu::vector_size(16)]] = float;
@@ -22,6 +25,281 @@ struct image_size
 	vec2u_t sizes;
 };
 
+/**
+ * Describes how the pixels of a raster are stored. With a block_shift of zero, rows are stored
+ * one after another. Otherwise, the raster is split into square blocks of 2^block_shift pixels,
+ * which are stored one after another in row-major order, with row-major pixels inside each
+ * block. Then, vertical neighbours are at most a block width apart, instead of an image width.
+*/
+struct raster_layout
+{
+	uint32_t block_shift{0};
+
+	static constexpr raster_layout row_major()
+	{ return raster_layout{0}; }
+
+	/**
+	 * Returns a blocked layout with the largest power of two block size that is not larger than
+	 * block_size
+	*/
+	static constexpr raster_layout blocked(size_t block_size)
+	{
+		uint32_t shift = 0;
+		while((size_t{2} << shift) <= block_size)
+		{ ++shift; }
+		return raster_layout{shift};
+	}
+
+	constexpr size_t block_size() const
+	{ return size_t{1} << block_shift; }
+
+	constexpr bool operator==(raster_layout const&) const = default;
+};
+
+/**
+ * Returns the distance between two block rows in a raster of the given width, counted in
+ * blocks, or the distance between two rows, counted in pixels, if layout is row-major
+*/
+constexpr size_t get_row_stride(size_t width, raster_layout layout)
+{ return (width + layout.block_size() - 1) >> layout.block_shift; }
+
+/**
+ * Returns the number of elements needed to store a raster of the given size. With a blocked
+ * layout, partial blocks at the right and bottom edges are padded to full blocks.
+*/
+constexpr size_t get_storage_size(image_size size, raster_layout layout)
+{
+	auto const block_rows = (size.sizes[1] + layout.block_size() - 1) >> layout.block_shift;
+	return (get_row_stride(size.sizes[0], layout)*block_rows) << (2*layout.block_shift);
+}
+
+/**
+ * A non-owning view of a raster, or a rectangular part of one. The same addressing is used for
+ * both layouts: with a block_shift of zero, it reduces to y*row_stride + x.
+*/
+template<class T>
+class raster_view
+{
+public:
+	raster_view() = default;
+
+	/**
+	 * Views a contiguous row-major buffer
+	*/
+	explicit raster_view(T* data, image_size size):
+		raster_view{data, size, size.sizes[0], raster_layout::row_major()}
+	{}
+
+	explicit raster_view(T* data, image_size size, size_t row_stride, raster_layout layout,
+		vec2u_t origin = vec2u_t{0, 0}):
+		m_data{data},
+		m_size{size},
+		m_row_stride{row_stride},
+		m_layout{layout},
+		m_origin{origin}
+	{}
+
+	template<class U>
+	requires(std::is_convertible_v<U(*)[], T(*)[]>)
+	raster_view(raster_view<U> other):
+		raster_view{other.data(), other.size(), other.row_stride(), other.layout(), other.origin()}
+	{}
+
+	T& operator()(size_t x, size_t y) const
+	{ return m_data[get_offset(x + m_origin[0], y + m_origin[1])]; }
+
+	T& operator()(vec2u_t loc) const
+	{ return (*this)(loc[0], loc[1]); }
+
+	/**
+	 * Returns a view of the size pixels starting at origin, relative to this view
+	*/
+	raster_view subview(vec2u_t origin, image_size size) const
+	{
+		if(m_layout.block_shift == 0)
+		{ return raster_view{&(*this)(origin), size, m_row_stride, m_layout}; }
+		return raster_view{m_data, size, m_row_stride, m_layout, m_origin + origin};
+	}
+
+	/**
+	 * Returns the number of pixels that are stored contiguously, starting at (x, y), without
+	 * leaving the view
+	*/
+	size_t get_contiguous_run(size_t x, size_t) const
+	{
+		if(m_layout.block_shift == 0)
+		{ return m_size.sizes[0] - x; }
+		auto const block_size = m_layout.block_size();
+		auto const x_in_block = (x + m_origin[0]) & (block_size - 1);
+		return std::min(block_size - x_in_block, static_cast<size_t>(m_size.sizes[0] - x));
+	}
+
+	T* data() const
+	{ return m_data; }
+
+	image_size size() const
+	{ return m_size; }
+
+	size_t width() const
+	{ return m_size.sizes[0]; }
+
+	size_t height() const
+	{ return m_size.sizes[1]; }
+
+	size_t row_stride() const
+	{ return m_row_stride; }
+
+	raster_layout layout() const
+	{ return m_layout; }
+
+	vec2u_t origin() const
+	{ return m_origin; }
+
+private:
+	size_t get_offset(size_t x, size_t y) const
+	{
+		auto const shift = m_layout.block_shift;
+		auto const mask = (size_t{1} << shift) - 1;
+		return (((y >> shift)*m_row_stride + (x >> shift)) << (2*shift)) + ((y & mask) << shift) + (x & mask);
+	}
+
+	T* m_data{nullptr};
+	image_size m_size{vec2u_t{0, 0}};
+	size_t m_row_stride{0};
+	raster_layout m_layout{};
+	vec2u_t m_origin{0, 0};
+};
+
+/**
+ * Returns a view of an image of the given size, of which view holds only the rows starting at
+ * first_row. Rows are addressed in the coordinates of the image, and only the stored rows may be
+ * accessed.
+*/
+template<class T>
+raster_view<T> with_row_offset(raster_view<T> view, size_t first_row, image_size size)
+{
+	// The origin wraps around, so that y + origin is y - first_row for all stored rows
+	return raster_view<T>{view.data(), size, view.row_stride(), view.layout(),
+		view.origin() - vec2u_t{0, first_row}};
+}
+
+/**
+ * Copies row_count row-major rows from src into dest, starting at first_row, converting each
+ * pixel with convert
+*/
+template<class T, class U, class Func>
+void write_rows(raster_view<T> dest, size_t first_row, U const* src, size_t row_count, Func&& convert)
+{
+	auto const w = dest.width();
+	auto const last_row = std::min(first_row + row_count, dest.height());
+	for(size_t y = first_row; y < last_row; ++y)
+	{
+		auto const src_row = src + (y - first_row)*w;
+		size_t x = 0;
+		while(x != w)
+		{
+			auto const n = dest.get_contiguous_run(x, y);
+			std::transform(src_row + x, src_row + x + n, &dest(x, y), convert);
+			x += n;
+		}
+	}
+}
+
+template<class T>
+void write_rows(raster_view<T> dest, size_t first_row, T const* src, size_t row_count)
+{ write_rows(dest, first_row, src, row_count, std::identity{}); }
+
+/**
+ * An elevation in [0, quantized_elevation_max] stored as an unsigned 16-bit integer, with a
+ * resolution of about 0.14 m
+*/
+struct quantized_elevation
+{
+	uint16_t bits;
+};
+
+constexpr float quantized_elevation_max = 9000.0f;
+
+constexpr float quantized_elevation_step = quantized_elevation_max/65535.0f;
+
+/**
+ * An elevation stored as an IEEE 754 half-precision float. The resolution is 4 m above 4096 m.
+*/
+struct half_elevation
+{
+	_Float16 value;
+};
+
+/**
+ * Converts a float elevation to T. Elevations outside the range of quantized_elevation are
+ * clamped, so nodata values below zero end up below sea level.
+*/
+template<class T>
+T encode_elevation(float z)
+{
+	if constexpr(std::is_same_v<T, quantized_elevation>)
+	{
+		auto const clamped = std::clamp(z, 0.0f, quantized_elevation_max);
+		return quantized_elevation{static_cast<uint16_t>(clamped/quantized_elevation_step + 0.5f)};
+	}
+	else
+	if constexpr(std::is_same_v<T, half_elevation>)
+	{ return half_elevation{static_cast<_Float16>(z)}; }
+	else
+	{ return static_cast<T>(z); }
+}
+
+template<class T>
+requires(std::is_arithmetic_v<T>)
+inline float to_float(T val)
+{ return static_cast<float>(val); }
+
+inline float to_float(quantized_elevation val)
+{ return static_cast<float>(val.bits)*quantized_elevation_step; }
+
+inline float to_float(half_elevation val)
+{ return static_cast<float>(val.value); }
+
+/**
+ * A loaded heightmap, with an optional mask, together with the geometry needed to convert
+ * pixel coordinates to lengths. The mask is always row-major, and has a null data pointer if
+ * there is no mask. Pixels are read through to_float, so kernels work on float,
+ * quantized_elevation and half_elevation heightmaps.
+*/
+template<class Pixel>
+struct basic_heightmap_region
+{
+	raster_view<Pixel const> pixels;
+	raster_view<uint8_t const> mask;
+	image_size size;
+	corners_in_geo_coords domain;
+	float R_e;
+	float R_p;
+};
+
+using heightmap_region = basic_heightmap_region<float>;
+
+/**
+ * A half-open range of columns. The default range covers all columns.
+*/
+struct column_range
+{
+	size_t begin{0};
+	size_t end{static_cast<size_t>(-1)};
+};
+
+/**
+ * A half-open range of rows. The default range covers all rows.
+*/
+struct row_range
+{
+	size_t begin{0};
+	size_t end{static_cast<size_t>(-1)};
+
+	size_t size() const
+	{ return end - begin; }
+};
+
 template<class T>
 T& pixel(T* buffer, vec2u_t loc, size_t width)
 {
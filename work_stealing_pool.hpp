@@ -0,0 +1,151 @@
+#ifndef WORK_STEALING_POOL_HPP
+#define WORK_STEALING_POOL_HPP
+
+#include "./raster_buffer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A thread pool where each worker has its own task queue. Submitted tasks are split into
+ * contiguous slices, one per worker. A worker takes tasks from the front of its own queue, and
+ * when it runs out, it steals from the back of the other queues.
+ *
+ * If pin is true, worker k is pinned to the k:th allowed CPU, and slice k always goes to worker
+ * k, so data that has been first-touched with the same split (see first_touch) is local to the
+ * worker that processes it. Otherwise, workers may move between CPUs anyway, so the first slice
+ * rotates between workers, and short submissions do not all end up on the same worker.
+*/
+class work_stealing_pool
+{
+public:
+	using task = std::function<void()>;
+
+	explicit work_stealing_pool(size_t thread_count, bool pin = false):
+		m_pending{0},
+		m_stop{false},
+		m_pinned{pin},
+		m_next_queue{0}
+	{
+		thread_count = std::max(thread_count, size_t{1});
+		for(size_t k = 0; k != thread_count; ++k)
+		{ m_queues.push_back(std::make_unique<task_queue>()); }
+
+		for(size_t k = 0; k != thread_count; ++k)
+		{
+			m_threads.emplace_back([this, k, pin](){
+				if(pin)
+				{ pin_current_thread(k); }
+				run(k);
+			});
+		}
+	}
+
+	work_stealing_pool(work_stealing_pool const&) = delete;
+	work_stealing_pool& operator=(work_stealing_pool const&) = delete;
+
+	~work_stealing_pool()
+	{
+		{
+			std::lock_guard lock{m_mutex};
+			m_stop = true;
+		}
+		m_cv.notify_all();
+		std::ranges::for_each(m_threads, [](auto& item){ item.join(); });
+	}
+
+	size_t thread_count() const
+	{ return std::size(m_threads); }
+
+	void submit(std::vector<task>&& tasks)
+	{
+		auto const n = std::size(tasks);
+		auto const queue_count = std::size(m_queues);
+		{
+			// Count the tasks before they become visible, so m_pending never drops below zero
+			std::lock_guard lock{m_mutex};
+			m_pending += n;
+		}
+
+		auto const first_queue = m_pinned ? size_t{0} : m_next_queue.fetch_add(1, std::memory_order_relaxed);
+		for(size_t k = 0; k != queue_count; ++k)
+		{
+			auto& queue = *m_queues[(first_queue + k)%queue_count];
+			auto const begin = std::begin(tasks) + k*n/queue_count;
+			auto const end = std::begin(tasks) + (k + 1)*n/queue_count;
+			std::lock_guard lock{queue.mutex};
+			std::move(begin, end, std::back_inserter(queue.tasks));
+		}
+		m_cv.notify_all();
+	}
+
+private:
+	struct task_queue
+	{
+		std::mutex mutex;
+		std::deque<task> tasks;
+	};
+
+	bool try_take(size_t self, task& ret)
+	{
+		auto const queue_count = std::size(m_queues);
+		for(size_t k = 0; k != queue_count; ++k)
+		{
+			auto const own = k == 0;
+			auto& queue = *m_queues[(self + k)%queue_count];
+			std::lock_guard lock{queue.mutex};
+			if(queue.tasks.empty())
+			{ continue; }
+
+			if(own)
+			{
+				ret = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+			}
+			else
+			{
+				ret = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			m_pending.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	void run(size_t self)
+	{
+		while(true)
+		{
+			task current;
+			if(try_take(self, current))
+			{
+				current();
+				continue;
+			}
+
+			std::unique_lock lock{m_mutex};
+			m_cv.wait(lock, [this](){ return m_stop || m_pending.load(std::memory_order_relaxed) != 0; });
+			if(m_stop && m_pending.load(std::memory_order_relaxed) == 0)
+			{ return; }
+		}
+	}
+
+	std::vector<std::unique_ptr<task_queue>> m_queues;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::atomic<size_t> m_pending;
+	bool m_stop;
+	bool m_pinned;
+	std::atomic<size_t> m_next_queue;
+	std::vector<std::thread> m_threads;
+};
+
+#endif
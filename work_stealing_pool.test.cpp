@@ -0,0 +1,71 @@
+//@{"target":{"name":"work_stealing_pool.test"}}
+
+#include "./work_stealing_pool.hpp"
+
+#include <atomic>
+#include <latch>
+#include <vector>
+#include <thread>
+#include <cassert>
+
+int main()
+{
+    // Every task runs exactly once, also when one worker gets all the slow tasks
+    {
+        std::vector<std::atomic<int>> run_count(1000);
+        std::latch done{static_cast<ptrdiff_t>(std::size(run_count))};
+        work_stealing_pool pool{4};
+        std::vector<work_stealing_pool::task> tasks;
+        for(size_t k = 0; k != std::size(run_count); ++k)
+        {
+            tasks.push_back([&run_count, &done, k](){
+                if(k < std::size(run_count)/4)
+                { std::this_thread::sleep_for(std::chrono::microseconds{200}); }
+                ++run_count[k];
+                done.count_down();
+            });
+        }
+        pool.submit(std::move(tasks));
+        done.wait();
+        for(auto const& item : run_count)
+        { assert(item == 1); }
+    }
+
+    // The first worker gets tasks 0 and 1. Task 0 waits for task 1, so task 1 must be stolen by
+    // the second worker.
+    {
+        std::latch task_1_done{1};
+        std::latch done{4};
+        work_stealing_pool pool{2};
+        std::vector<work_stealing_pool::task> tasks;
+        tasks.push_back([&task_1_done, &done](){
+            task_1_done.wait();
+            done.count_down();
+        });
+        tasks.push_back([&task_1_done, &done](){
+            task_1_done.count_down();
+            done.count_down();
+        });
+        tasks.push_back([&done](){ done.count_down(); });
+        tasks.push_back([&done](){ done.count_down(); });
+        pool.submit(std::move(tasks));
+        done.wait();
+    }
+
+    // Tasks submitted later are still picked up
+    {
+        std::atomic<int> sum{0};
+        {
+            work_stealing_pool pool{3};
+            for(int k = 0; k != 10; ++k)
+            {
+                std::vector<work_stealing_pool::task> tasks;
+                tasks.push_back([&sum, k](){ sum += k; });
+                pool.submit(std::move(tasks));
+            }
+            while(sum != 45)
+            { std::this_thread::yield(); }
+        }
+        assert(sum == 45);
+    }
+}